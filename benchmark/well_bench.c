@@ -5,18 +5,33 @@ Used to test speed of memorywell buffers with different
 
 Runs for a fixed time and then reports number of blocks pushed/pulled
 	from the buffer.
+
+With '--latency', producers stamp every block with the (CLOCK_MONOTONIC) time
+	at which it was written and consumers record the time elapsed until
+	they reserve it in a per-thread histogram;
+	histograms are merged at the end and percentiles reported.
+The stamp is taken when the block is written, not when it is released:
+	latency includes the producer's own release (and any wait to release
+	in order with '--ooo' off), not just time spent queued.
 */
 
 #include <well.h>
 #include <well_fail.h>
+#include <well_group.h>
+#include <well_backoff.h>
+#include <well_cache.h>
+#include <well_stats.h>
 
 #include <ndebug.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <getopt.h>
+#include <stdbool.h>
+#include <string.h> /* strcmp */
 #include <nonlibc.h> /* timing */
 
 #include <unistd.h> /* sleep */
+#include <time.h> /* clock_gettime */
 
 static size_t blk_cnt = 256; /* how many blocks in the cbuf */
 const static size_t blk_size = sizeof(size_t); /* in Bytes */
@@ -26,14 +41,157 @@ static size_t tx_thread_cnt = 1;
 static pthread_t *tx = NULL;
 static size_t rx_thread_cnt = 1;
 static pthread_t *rx = NULL;
+static void *ooo = NULL; /* completion bitmaps */
+static void *stats = NULL; /* per-side counters, if built with WELL_STATS */
 
 static size_t reservation = 1; /* how many blocks to reserve at once */
+static bool do_ooo = false; /* multi-threaded release with well_release_ooo() */
+static bool do_latency = false; /* measure enqueue -> dequeue latency */
+static unsigned alloc_flags = 0; /* WELL_ALLOC_*: use well_alloc_init() if set */
+static int numa_node = -1;
+static bool do_group = false; /* one shard per thread: see well_group.h */
+static bool do_adaptive = false; /* well_backoff instead of FAIL_DO() */
+static uint8_t technique = WELL_TECHNIQUE; /* WELL_DO_* */
+static size_t cache_cap = 0; /* one block at a time through a well_cache */
+static bool do_ptr = false; /* pointer queue: see well_ptr_init() */
+static __thread struct well_backoff backoff;
+static struct well_group grp = { 0 };
 
 static size_t waits = 0; /* how many times did threads wait? */
 
 static uint_fast8_t kill_flag = 0;
 
 
+/*
+	fail method name, for reporting
+*/
+#if (WELL_FAIL_METHOD == WELL_FAIL_SPIN)
+	#define FAIL_NAME "SPIN"
+#elif (WELL_FAIL_METHOD == WELL_FAIL_YIELD)
+	#define FAIL_NAME "YIELD"
+#elif (WELL_FAIL_METHOD == WELL_FAIL_SLEEP)
+	#define FAIL_NAME "SLEEP"
+#elif (WELL_FAIL_METHOD == WELL_FAIL_BOUNDED)
+	#define FAIL_NAME "BOUNDED"
+#else
+	#define FAIL_NAME "?"
+#endif
+
+
+/*
+	latency histogram
+
+HDR-style log-linear buckets: values below 2^HIST_SUB_BITS are exact,
+	above that every power of 2 is split into 2^HIST_SUB_BITS buckets
+	(about 3% precision).
+*/
+#define HIST_SUB_BITS	5
+#define HIST_SUB	(1UL << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist {
+	uint64_t	cnt[HIST_BUCKETS];
+	uint64_t	max;
+};
+
+static struct hist latency = { {0} }; /* merged from all consumer threads */
+
+/*	hist_idx()
+*/
+static inline size_t hist_idx(uint64_t val)
+{
+	if (val < HIST_SUB)
+		return val;
+	size_t exp = 63 - __builtin_clzl(val);
+	size_t sub = (val >> (exp - HIST_SUB_BITS)) & (HIST_SUB -1);
+	return (exp - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+/*	hist_val()
+Highest value which falls into bucket 'idx'.
+*/
+static uint64_t hist_val(size_t idx)
+{
+	if (idx < HIST_SUB)
+		return idx;
+	size_t exp = idx / HIST_SUB + HIST_SUB_BITS -1;
+	size_t sub = idx % HIST_SUB;
+	return ((HIST_SUB + sub + 1) << (exp - HIST_SUB_BITS)) -1;
+}
+
+/*	hist_add()
+*/
+static inline void hist_add(struct hist *h, uint64_t val)
+{
+	h->cnt[hist_idx(val)]++;
+	if (val > h->max)
+		h->max = val;
+}
+
+/*	hist_merge()
+Merge a thread's histogram into the global one.
+*/
+static void hist_merge(const struct hist *h)
+{
+	for (size_t i=0; i < HIST_BUCKETS; i++)
+		if (h->cnt[i])
+			__atomic_fetch_add(&latency.cnt[i], h->cnt[i], __ATOMIC_RELAXED);
+
+	uint64_t max = __atomic_load_n(&latency.max, __ATOMIC_RELAXED);
+	while (h->max > max && !__atomic_compare_exchange_n(&latency.max, &max, h->max,
+						1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*	hist_new()
+A consumer's histogram: NULL unless measuring latency.
+Running out of memory is fatal: without a histogram a consumer
+	would take the producer path in touch() and stamp blocks instead.
+*/
+static struct hist *hist_new()
+{
+	int err_cnt = 0;
+	struct hist *h = NULL;
+	if (do_latency)
+		NB_die_if(!(
+			h = calloc(1, sizeof(*h))
+			), "no memory for latency histogram");
+	return h;
+die:
+	exit(err_cnt);
+}
+
+/*	hist_pct()
+Value at percentile 'pct' (0 < pct <= 100).
+*/
+static uint64_t hist_pct(const struct hist *h, double pct)
+{
+	uint64_t total = 0;
+	for (size_t i=0; i < HIST_BUCKETS; i++)
+		total += h->cnt[i];
+
+	uint64_t rank = total * pct / 100;
+	if (rank < 1)
+		rank = 1;
+	uint64_t sum = 0;
+	for (size_t i=0; i < HIST_BUCKETS; i++) {
+		sum += h->cnt[i];
+		if (sum >= rank)
+			return hist_val(i) < h->max ? hist_val(i) : h->max;
+	}
+	return h->max;
+}
+
+/*	now_ns()
+*/
+static inline uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+
 /*	escape
 
 Tell compiler and optimized to keep their hands off 'unused'.
@@ -48,6 +206,80 @@ static void escape(size_t unused)
 }
 
 
+/*	fail()
+Back off after a failed reserve/release.
+*/
+static inline void fail()
+{
+	if (do_adaptive) {
+		wait_count++;
+		well_backoff_once(&backoff);
+	} else {
+		FAIL_DO();
+	}
+}
+
+
+/*	touch()
+Write to all blocks in 'res';
+	when measuring latency either stamp them (producer: 'hist' is NULL)
+	or record their latency in 'hist' (consumer).
+*/
+static inline void touch(struct well *buf, struct well_res res, size_t i, struct hist *hist)
+{
+	/* a wait (if any) ended successfully */
+	if (do_adaptive)
+		well_backoff_done(&backoff);
+
+	if (!do_latency) {
+		for (size_t j=0; j < res.cnt; j++)
+			escape(WELL_DEREF(size_t, res.pos, j, buf) = i + j);
+		return;
+	}
+
+	uint64_t now = now_ns();
+	if (!hist) {
+		for (size_t j=0; j < res.cnt; j++)
+			WELL_DEREF(uint64_t, res.pos, j, buf) = now;
+	} else {
+		for (size_t j=0; j < res.cnt; j++)
+			hist_add(hist, now - WELL_DEREF(uint64_t, res.pos, j, buf));
+	}
+}
+
+
+/*	io_cache()
+One block at a time through a per-thread well_cache (see well_cache.h);
+	'multi' if other threads use this side of the buffer.
+*/
+static size_t io_cache(	struct well *buf,
+			struct well_sym *get,
+			struct well_sym *put,
+			struct hist *hist,
+			bool multi)
+{
+	size_t i = 0;
+	struct well_cache c;
+	well_cache_init(&c, get, put, cache_cap, multi ? WELL_CACHE_OOO : 0);
+	well_backoff_init(&backoff, NULL);
+
+	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
+		struct well_res res = well_cache_next(&c);
+		if (res.cnt) {
+			touch(buf, res, i++, hist);
+			well_cache_commit(&c);
+		} else {
+			/* don't sit on committed blocks while waiting */
+			well_cache_flush(&c);
+			fail();
+		}
+	}
+	well_cache_flush(&c);
+
+	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
+	return i;
+}
+
 /*	io_single()
 Single-threaded I/O on one side of a buffer
 	(will NOT contend for this side of buffer,
@@ -55,22 +287,25 @@ Single-threaded I/O on one side of a buffer
 */
 static size_t io_single(	struct well *buf,
 				struct well_sym *get,
-				struct well_sym *put)
+				struct well_sym *put,
+				struct hist *hist)
 {
+	if (cache_cap)
+		return io_cache(buf, get, put, hist, false);
 	size_t i = 0;
 	struct well_res res = { 0 };
+	well_backoff_init(&backoff, NULL);
 
 	/* loop get -> put
 	Check kill flag after every failure to avoid spinning forever.
 	*/
 	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
 		if ((res = well_reserve(get, reservation)).cnt) {
-			for (size_t j=0; j < res.cnt; j++)
-				escape(WELL_DEREF(size_t, res.pos, j, buf) = i + j);
+			touch(buf, res, i, hist);
 			well_release_single(put, res.cnt);
 			i += res.cnt;
 		} else {
-			FAIL_DO();
+			fail();
 		}
 	}
 
@@ -83,10 +318,14 @@ Multi-threaded I/O on one side of a buffer (will contend for this side of buffer
 */
 static size_t io_multi(	struct well *buf,
 				struct well_sym *get,
-				struct well_sym *put)
+				struct well_sym *put,
+				struct hist *hist)
 {
+	if (cache_cap)
+		return io_cache(buf, get, put, hist, true);
 	size_t i = 0;
 	struct well_res res = { 0 };
+	well_backoff_init(&backoff, NULL);
 
 	/* loop get -> put
 
@@ -95,16 +334,21 @@ static size_t io_multi(	struct well *buf,
 	*/
 	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
 		if (res.cnt) {
-			if (well_release_multi(put, res)) {
+			if (do_ooo) {
+				/* never fails: don't count a wait */
+				well_release_ooo(put, res);
+				i += res.cnt;
+				res.cnt = 0;
+				continue;
+			} else if (well_release_multi(put, res)) {
 				i += res.cnt;
 				res.cnt = 0;
 			}
 		} else if ((res = well_reserve(get, reservation)).cnt) {
-			for (size_t j=0; j < res.cnt; j++)
-				escape(WELL_DEREF(size_t, res.pos, j, buf) = i + j);
+			touch(buf, res, i, hist);
 			continue;
 		}
-		FAIL_DO();
+		fail();
 	}
 
 	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
@@ -118,25 +362,127 @@ static size_t io_multi(	struct well *buf,
 void *tx_single(void* arg)
 {
 	struct well *buf = arg;
-	return (void *)io_single(buf, &buf->tx, &buf->rx);
+	return (void *)io_single(buf, &buf->tx, &buf->rx, NULL);
 }
 void *tx_multi(void* arg)
 {
 	struct well *buf = arg;
-	return (void *)io_multi(buf, &buf->tx, &buf->rx);
+	return (void *)io_multi(buf, &buf->tx, &buf->rx, NULL);
 }
 /*
-	rx side
+	rx side: each thread keeps its own latency histogram
 */
 void *rx_single(void* arg)
 {
 	struct well *buf = arg;
-	return (void *)io_single(buf, &buf->rx, &buf->tx);
+	struct hist *hist = hist_new();
+	size_t ret = io_single(buf, &buf->rx, &buf->tx, hist);
+	if (hist)
+		hist_merge(hist);
+	free(hist);
+	return (void *)ret;
 }
 void *rx_multi(void* arg)
 {
 	struct well *buf = arg;
-	return (void *)io_multi(buf, &buf->rx, &buf->tx);
+	struct hist *hist = hist_new();
+	size_t ret = io_multi(buf, &buf->rx, &buf->tx, hist);
+	if (hist)
+		hist_merge(hist);
+	free(hist);
+	return (void *)ret;
+}
+
+
+/*
+	group: thread index is its local shard
+*/
+void *tx_group(void* arg)
+{
+	size_t local = (size_t)arg;
+	size_t i = 0;
+	well_backoff_init(&backoff, NULL);
+	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
+		struct well_gres res = well_group_produce(&grp, local, reservation);
+		if (res.cnt) {
+			touch(res.shard, (struct well_res){ .cnt = res.cnt, .pos = res.pos }, i, NULL);
+			well_group_produced(res);
+			i += res.cnt;
+		} else {
+			fail();
+		}
+	}
+	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
+	return (void *)i;
+}
+void *rx_group(void* arg)
+{
+	size_t local = (size_t)arg;
+	size_t i = 0;
+	well_backoff_init(&backoff, NULL);
+	struct hist *hist = hist_new();
+	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
+		struct well_gres res = well_group_consume(&grp, local, reservation);
+		if (res.cnt) {
+			touch(res.shard, (struct well_res){ .cnt = res.cnt, .pos = res.pos }, i, hist);
+			well_group_consumed(res);
+			i += res.cnt;
+		} else {
+			fail();
+		}
+	}
+	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
+	if (hist)
+		hist_merge(hist);
+	free(hist);
+	return (void *)i;
+}
+
+
+/*
+	pointer queue: pointers are never NULL, so push 'i + 1'
+*/
+void *tx_ptr(void* arg)
+{
+	struct well *buf = arg;
+	size_t i = 0;
+	void *ptrs[reservation];
+	well_backoff_init(&backoff, NULL);
+	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
+		for (size_t j=0; j < reservation; j++)
+			ptrs[j] = (void *)(i + j + 1);
+		size_t n = well_ptr_push(buf, ptrs, reservation);
+		if (n) {
+			if (do_adaptive)
+				well_backoff_done(&backoff);
+			i += n;
+		} else {
+			fail();
+		}
+	}
+	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
+	return (void *)i;
+}
+void *rx_ptr(void* arg)
+{
+	struct well *buf = arg;
+	size_t i = 0;
+	void *ptrs[reservation];
+	well_backoff_init(&backoff, NULL);
+	while (! __atomic_load_n(&kill_flag, __ATOMIC_RELAXED)) {
+		size_t n = well_ptr_pop(buf, ptrs, reservation);
+		if (n) {
+			if (do_adaptive)
+				well_backoff_done(&backoff);
+			for (size_t j=0; j < n; j++)
+				escape((size_t)ptrs[j]);
+			i += n;
+		} else {
+			fail();
+		}
+	}
+	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
+	return (void *)i;
 }
 
 
@@ -156,6 +502,20 @@ Options:\n\
 -r, --reservation <res>	:	(Attempt to) reserve <res> blocks at once.\n\
 -t, --tx-threads	:	Number of TX threads.\n\
 -x, --rx-threads	:	Number of RX threads.\n\
+-T, --technique <name>	:	Contention technique: cas|xch|mtx|spl|tkt.\n\
+-o, --ooo		:	Release out-of-order when multi-threaded.\n\
+-l, --latency		:	Report write->dequeue latency percentiles\n\
+			\t(stamped when written, before release).\n\
+-H, --huge <2m|1g|thp>	:	Back buffer with huge pages.\n\
+-N, --node <node>	:	Bind buffer to NUMA node.\n\
+-P, --prefault		:	Pre-fault buffer before starting.\n\
+-g, --group		:	One well per thread pair, consumers steal.\n\
+-k, --cache <cap>	:	One block at a time through a per-thread\n\
+			\treservation cache of up to <cap> blocks.\n\
+-p, --pointer		:	Pointer queue (well_ptr_push()/well_ptr_pop()):\n\
+			\tno technique, reservation or release.\n\
+-a, --adaptive		:	Adaptive backoff (well_backoff.h) instead of\n\
+			\tcompile-time fail method.\n\
 -h, --help		:	Print this message and exit.\n",
 		pgm_name);
 }
@@ -169,6 +529,7 @@ int main(int argc, char **argv)
 		and directly affect the return code of main()
 	int err_cnt = 0;
 	*/
+	struct well buf = { {0} };
 
 
 	/*
@@ -181,10 +542,20 @@ int main(int argc, char **argv)
 		{ "reservation",required_argument,	0,	'r'},
 		{ "tx-threads",	required_argument,	0,	't'},
 		{ "rx-threads",	required_argument,	0,	'x'},
+		{ "technique",	required_argument,	0,	'T'},
+		{ "ooo",	no_argument,		0,	'o'},
+		{ "latency",	no_argument,		0,	'l'},
+		{ "huge",	required_argument,	0,	'H'},
+		{ "node",	required_argument,	0,	'N'},
+		{ "prefault",	no_argument,		0,	'P'},
+		{ "group",	no_argument,		0,	'g'},
+		{ "cache",	required_argument,	0,	'k'},
+		{ "pointer",	no_argument,		0,	'p'},
+		{ "adaptive",	no_argument,		0,	'a'},
 		{ "help",	no_argument,		0,	'h'}
 	};
 
-	while ((opt = getopt_long(argc, argv, "s:c:r:t:x:h", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "s:c:r:t:x:T:olH:N:Pgk:pah", long_options, NULL)) != -1) {
 		switch(opt)
 		{
 			case 's':
@@ -216,6 +587,57 @@ int main(int argc, char **argv)
 				NB_die_if(opt != 1, "invalid rx_thread_cnt '%s'", optarg);
 				break;
 
+			case 'o':
+				do_ooo = true;
+				break;
+
+			case 'l':
+				do_latency = true;
+				break;
+
+			case 'H':
+				if (!strcmp(optarg, "2m"))
+					alloc_flags |= WELL_ALLOC_HUGE_2M;
+				else if (!strcmp(optarg, "1g"))
+					alloc_flags |= WELL_ALLOC_HUGE_1G;
+				else if (!strcmp(optarg, "thp"))
+					alloc_flags |= WELL_ALLOC_THP;
+				else
+					NB_die("invalid huge page kind '%s'", optarg);
+				break;
+
+			case 'N':
+				opt = sscanf(optarg, "%d", &numa_node);
+				NB_die_if(opt != 1 || numa_node < 0, "invalid node '%s'", optarg);
+				break;
+
+			case 'P':
+				alloc_flags |= WELL_ALLOC_PREFAULT;
+				break;
+
+			case 'T':
+				NB_die_if(!(
+					technique = well_technique_parse(optarg)
+					), "invalid technique '%s'", optarg);
+				break;
+
+			case 'g':
+				do_group = true;
+				break;
+
+			case 'k':
+				opt = sscanf(optarg, "%zu", &cache_cap);
+				NB_die_if(opt != 1 || !cache_cap, "invalid cache cap '%s'", optarg);
+				break;
+
+			case 'p':
+				do_ptr = true;
+				break;
+
+			case 'a':
+				do_adaptive = true;
+				break;
+
 			case 'h':
 				usage(argv[0]);
 				goto die;
@@ -229,16 +651,46 @@ int main(int argc, char **argv)
 	NB_die_if(reservation > blk_cnt,
 		"would attempt to reserve %zu from buffer with %zu blocks",
 		reservation, blk_cnt);
+	NB_die_if(do_ptr && (do_group || cache_cap || do_ooo || do_latency),
+		"pointer queue excludes -g, -k, -o and -l");
 
 
 	/* create buffer */
-	struct well buf = { {0} };
 	NB_die_if(
 		well_params(blk_size, blk_cnt, &buf)
 		, "");
-	NB_die_if(
-		well_init(&buf, malloc(well_size(&buf)))
-		, "size %zu", well_size(&buf));
+	buf.ct.technique = technique;
+	if (alloc_flags || numa_node >= 0) {
+		NB_die_if(
+			well_alloc_init(&buf, alloc_flags, numa_node)
+			, "size %zu", well_size(&buf));
+	} else {
+		NB_die_if(
+			well_init(&buf, malloc(well_size(&buf)))
+			, "size %zu", well_size(&buf));
+	}
+	if (do_ptr)
+		NB_die_if(well_ptr_init(&buf), "");
+	/* multi-threaded caches release out-of-order */
+	if (cache_cap && (tx_thread_cnt > 1 || rx_thread_cnt > 1))
+		do_ooo = true;
+	if (do_ooo) {
+		NB_die_if(!(
+			ooo = malloc(well_ooo_size(&buf))
+			), "");
+		NB_die_if(well_ooo_init(&buf, ooo), "");
+	}
+	if (well_stats_size(&buf)) {
+		NB_die_if(!(
+			stats = aligned_alloc(NLC_CACHE_LINE, well_stats_size(&buf))
+			), "");
+		NB_die_if(well_stats_init(&buf, stats), "");
+	}
+
+	if (do_group) {
+		size_t shards = tx_thread_cnt > rx_thread_cnt ? tx_thread_cnt : rx_thread_cnt;
+		NB_die_if(well_group_init(&grp, shards, blk_size, blk_cnt, 0, technique), "");
+	}
 
 	void *(*tx_t)(void *) = tx_single;
 	if (tx_thread_cnt > 1)
@@ -250,6 +702,14 @@ int main(int argc, char **argv)
 	void *(*rx_t)(void *) = rx_single;
 	if (rx_thread_cnt > 1)
 		rx_t = rx_multi;
+	if (do_group) {
+		tx_t = tx_group;
+		rx_t = rx_group;
+	}
+	if (do_ptr) {
+		tx_t = tx_ptr;
+		rx_t = rx_ptr;
+	}
 	NB_die_if(!(
 		rx = malloc(sizeof(pthread_t) * rx_thread_cnt)
 		), "");
@@ -257,15 +717,23 @@ int main(int argc, char **argv)
 	/* print setup */
 	printf("secs %u; blk_size %zu; blk_count %zu; reservation %zu\n",
 		secs, blk_size, blk_cnt, reservation);
-	printf("TX threads %zu; RX threads %zu\n",
-		tx_thread_cnt, rx_thread_cnt);
+	printf("TX threads %zu; RX threads %zu%s\n",
+		tx_thread_cnt, rx_thread_cnt, do_ooo ? "; out-of-order release" : "");
+	printf("technique %s; fail method %s\n", well_technique_name(technique),
+		do_adaptive ? "ADAPTIVE" : FAIL_NAME);
+	if (do_group)
+		printf("group of %zu shards\n", grp.cnt);
+	if (do_ptr)
+		printf("pointer queue\n");
+	if (alloc_flags || numa_node >= 0)
+		printf("alloc flags 0x%x; NUMA node %d\n", alloc_flags, numa_node);
 
 	nlc_timing_start(t);
 		/* fire reader-writer threads */
 		for (size_t i=0; i < tx_thread_cnt; i++)
-			pthread_create(&tx[i], NULL, tx_t, &buf);
+			pthread_create(&tx[i], NULL, tx_t, do_group ? (void *)i : &buf);
 		for (size_t i=0; i < rx_thread_cnt; i++)
-			pthread_create(&rx[i], NULL, rx_t, &buf);
+			pthread_create(&rx[i], NULL, rx_t, do_group ? (void *)i : &buf);
 
 		/* set kill flag after time elapsed */
 		while ((secs = sleep(secs)))
@@ -289,12 +757,36 @@ int main(int argc, char **argv)
 	/* print stats */
 	printf("tx blocks %zu; rx blocks %zu; waits %zu\n",
 		tx_i_sum, rx_i_sum, waits);
+	if (do_latency) {
+		printf("latency ns: p50 %lu; p99 %lu; p99.9 %lu; max %lu\n",
+			hist_pct(&latency, 50), hist_pct(&latency, 99),
+			hist_pct(&latency, 99.9), latency.max);
+	}
+	if (stats) {
+		struct well_sym *sides[] = { &buf.tx, &buf.rx };
+		for (size_t i=0; i < 2; i++) {
+			struct well_stats st;
+			well_stats_read(sides[i], &st);
+			printf("%s: reserves %lu; blocks %lu; reserve fails %lu; "
+				"retries %lu; release fails %lu; hwm %lu\n",
+				i ? "rx" : "tx",
+				st.reserves, st.blocks, st.reserve_fails,
+				st.retries, st.release_fails, st.hwm);
+		}
+	}
 	printf("cpu time %.4lfs; wall time %.4lfs\n",
 		nlc_timing_cpu(t), nlc_timing_wall(t));
 
 die:
-	well_deinit(&buf);
-	free(well_mem(&buf));
+	if (buf.ct.flags & WELL_F_MAPPED) {
+		well_alloc_deinit(&buf);
+	} else {
+		well_deinit(&buf);
+		free(well_mem(&buf));
+	}
+	free(ooo);
+	free(stats);
+	well_group_deinit(&grp);
 	free(tx);
 	free(rx);
 	return err_cnt;
@@ -5,13 +5,19 @@
 #include <stdint.h>
 #include <nonlibc.h>
 #include <pthread.h>
+#include <time.h> /* struct timespec */
 
 #include <well_config.h> /* config header generated by build system */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 /*	well_const
 Data which should not change after initializiation; goes on it's own
 	cache line so it's never invalid.
+('buf' and 'overflow' only change in well_resize(), while nothing is reserved.)
 */
 struct well_const {
 	void		*buf;
@@ -21,56 +27,82 @@ struct well_const {
 					*/
 	size_t		blk_size;	/* Block size is a power of 2 */
 	uint8_t		blk_shift;	/* Multiply/divide by blk_sz using a shift */
+	uint8_t		flags;		/* WELL_F_* */
+	uint8_t		technique;	/* WELL_DO_*: see well_init_technique() */
 };
 
+/* 'buf' is mapped twice back-to-back: see well_mirror_init() */
+#define WELL_F_MIRROR	0x1
+/* well is shared between processes: set before well_init(), see well_shm.h */
+#define WELL_F_PSHARED	0x2
+/* 'buf' was mapped by well_alloc_init(); 1GiB-aligned if WELL_F_HUGE_1G */
+#define WELL_F_MAPPED	0x4
+#define WELL_F_HUGE_1G	0x8
+/* set after well_init(): by well_ptr_init() and well_sym_init() respectively */
+#define WELL_F_PTR	0x10
+#define WELL_F_SYMS	0x20
+
+
+struct well_stats_slot; /* see well_stats.h */
 
 /*	well_sym
 One (symmetrical) half of a circular buffer.
 All counts are in BLOCKS, not bytes.
 */
 struct well_sym {
+	/*
+		first cache line: touched by every reserve and release
+	*/
 	size_t		pos;	/* head/tail of buffer */
 	size_t		avail;	/* can be reserved */
+	uint8_t		technique;	/* WELL_DO_*: copied from 'ct' at init */
+	char		spl;		/* WELL_DO_SPL */
+	uint8_t		flags;		/* WELL_F_PSHARED: copied from 'ct' at init */
+	uint32_t	waiters;	/* threads parked in well_reserve_wait() */
+	uint32_t	armed;		/* event loop waits for blocks: see well_notify.h */
+	int		efd;		/* eventfd signalled when 'armed', or -1 */
+	/*
+		WELL_DO_TKT: unlike the other techniques a reservation is not
+		one atomic on 'avail' but two RMWs (take a ticket, then subtract
+		from 'avail') and a store to 'serving': FIFO fairness is paid for
+		with an extra round-trip on this line.
+	*/
+	size_t		ticket;		/* next ticket handed out */
+	size_t		serving;	/* ticket whose turn it is */
 
 	/*
 		multi-read or multi-write contention
 	*/
 	size_t		release_pos;	/* pos of earliest release */
+	uint64_t	*done;		/* completion bitmap for well_release_ooo() */
+	size_t		lap;		/* block count: selects 'done' polarity of a pos */
+
 	/*
-		locking
+		cold, or only used by one technique: after the hot line
 	*/
-#if (WELL_TECHNIQUE == WELL_DO_MTX)
-	pthread_mutex_t lock;
-#elif (WELL_TECHNIQUE == WELL_DO_SPL)
-	char		lock;
-#endif
+	pthread_mutex_t	mtx;		/* WELL_DO_MTX */
+	/* not conditional on WELL_STATS: layout is the same however callers are built */
+	struct well_stats_slot	*stats;	/* NULL unless well_stats_init() */
+	uint32_t	notifying;	/* releasers writing to 'efd': see well_notify_deinit() */
 };
 
 
-
-/* because some unices have big mutices */
-#if (WELL_TECHNIQUE == WELL_DO_MTX)
-	struct well {
-		struct well_const	ct;
-		struct well_sym		tx;
-		struct well_sym		rx;
-	};
-
+/* pad 'type' out to a whole number of cache lines */
+#define WELL_PAD_(type) \
+	((NLC_CACHE_LINE - sizeof(type) % NLC_CACHE_LINE) % NLC_CACHE_LINE)
 
 /* try and avoid false sharing by splitting cache lines */
-#else
-	struct well {
-		/* cache line 1: all the unchanging stuff that is never invalidated */
-		struct well_const	ct;
-		unsigned char		pad_ln1[NLC_CACHE_LINE - sizeof(struct well_const)];
-		/* cache line 2: tx side */
-		struct well_sym		tx;
-		unsigned char		pad_ln2[NLC_CACHE_LINE - sizeof(struct well_sym)];
-		/* cache line 3: rx side */
-		struct well_sym		rx;
-		unsigned char		pad_ln3[NLC_CACHE_LINE - sizeof(struct well_sym)];
-	};
-#endif
+struct well {
+	/* cache line 1: all the unchanging stuff that is never invalidated */
+	struct well_const	ct;
+	unsigned char		pad_ln1[WELL_PAD_(struct well_const)];
+	/* cache lines 2-3: tx side (hot line first; the mutex and cold fields follow) */
+	struct well_sym		tx;
+	unsigned char		pad_ln2[WELL_PAD_(struct well_sym)];
+	/* cache lines 4-5: rx side */
+	struct well_sym		rx;
+	unsigned char		pad_ln3[WELL_PAD_(struct well_sym)];
+};
 
 
 /*	well_size()
@@ -102,6 +134,7 @@ Access a block inside of a reservation;
 	returns a pointer to to the beginning of the block.
 ALWAYS use this function to access blocks - a particular reservation may
 	actually be split; with a portion of it looping around the end of the buffer!
+(Unless the well was set up with well_mirror_init(): see well_contiguous()).
 
 It's conceptually AND computationally cheaper to allow reservations with variable
 	numbers of blocks, and then just accessing each block through this function.
@@ -116,7 +149,18 @@ Both are inefficient.
 NLC_INLINE void *well_access(size_t pos, size_t i, const struct well *buf)
 {
 	size_t offt = (pos + i) << buf->ct.blk_shift;
-	return buf->ct.buf + (offt & buf->ct.overflow);
+	return (char *)buf->ct.buf + (offt & buf->ct.overflow);
+}
+
+/*	well_contiguous()
+Returns non-zero if every reservation is contiguous in memory,
+	which is the case for wells set up with well_mirror_init().
+well_access(pos, 0, buf) then points to all 'cnt << blk_shift' bytes
+	of a reservation, which can be handed whole to e.g. memcpy() or writev().
+*/
+NLC_INLINE int well_contiguous(const struct well *buf)
+{
+	return buf->ct.flags & WELL_F_MIRROR;
 }
 
 /*	WELL_DEREF()
@@ -151,8 +195,64 @@ NLC_PUBLIC int	well_params(	size_t		blk_size,
 NLC_PUBLIC int	well_init(	struct well	*buf,
 				void		*mem);
 
+NLC_PUBLIC int	well_init_technique(	struct well	*buf,
+					void		*mem,
+					uint8_t		technique);
+
+NLC_PUBLIC const char	*well_technique_name(	uint8_t		technique);
+
+NLC_PUBLIC uint8_t	well_technique_parse(	const char	*name);
+
+/*	well_technique()
+Returns the contention technique (WELL_DO_*) of 'buf'.
+*/
+NLC_INLINE uint8_t well_technique(const struct well *buf)
+{
+	return buf->ct.technique;
+}
+
+/*	well_ooo_size()
+Size of the memory required by well_ooo_init():
+	one completion bit per block, for each side.
+*/
+NLC_INLINE size_t well_ooo_size(const struct well *buf)
+{
+	return ((well_blk_count(buf) + 63) >> 6) * sizeof(uint64_t) * 2;
+}
+
+NLC_PUBLIC int	well_ooo_init(	struct well	*buf,
+				void		*mem);
+
+NLC_PUBLIC int	well_sym_init(	struct well		*buf,
+				struct well_sym		*sym,
+				void			*done);
+
+NLC_PUBLIC void	well_sym_deinit(	struct well_sym	*sym);
+
 NLC_PUBLIC void	well_deinit(	struct well	*buf);
 
+NLC_PUBLIC int	well_mirror_init(	struct well	*buf);
+
+NLC_PUBLIC void	well_mirror_deinit(	struct well	*buf);
+
+/* well_alloc_init() flags */
+#define WELL_ALLOC_HUGE_2M	0x1	/* hugetlbfs 2MiB pages (MAP_HUGETLB) */
+#define WELL_ALLOC_HUGE_1G	0x2	/* hugetlbfs 1GiB pages (MAP_HUGETLB) */
+#define WELL_ALLOC_THP		0x4	/* transparent huge pages (MADV_HUGEPAGE) */
+#define WELL_ALLOC_PREFAULT	0x8	/* touch every page before returning */
+
+NLC_PUBLIC int	well_alloc_init(	struct well	*buf,
+					unsigned	flags,
+					int		numa_node);
+
+NLC_PUBLIC void	well_alloc_deinit(	struct well	*buf);
+
+NLC_PUBLIC int	well_resize(	struct well		*buf,
+				void			*mem,
+				size_t			blk_cnt,
+				const struct timespec	*timeout,
+				uint64_t		*pause_ns);
+
 /*
 	reserve
 */
@@ -171,6 +271,19 @@ NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
 	well_reserve(	struct well_sym	*from,
 			size_t		max_count);
 
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_reserve_exact(	struct well_sym	*from,
+				size_t		count);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_reserve_wait(	struct well_sym	*from,
+				size_t		max_count);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_reserve_timed(	struct well_sym		*from,
+				size_t			max_count,
+				const struct timespec	*timeout);
+
 /*
 	release
 */
@@ -180,4 +293,63 @@ NLC_PUBLIC void	well_release_single(	struct well_sym	*to,
 NLC_PUBLIC __attribute__((warn_unused_result))
 	size_t	well_release_multi(	struct well_sym	*to,
 					struct well_res	res);
+
+NLC_PUBLIC void	well_release_ooo(	struct well_sym	*to,
+					struct well_res	res);
+
+NLC_PUBLIC size_t	well_unreserve(	struct well_sym	*from,
+					struct well_res	res);
+
+/*
+	bulk copy: reserve, copy, release in one call
+*/
+NLC_PUBLIC size_t	well_push(	struct well	*buf,
+					const void	*src,
+					size_t		cnt);
+
+NLC_PUBLIC size_t	well_pop(	struct well	*buf,
+					void		*dst,
+					size_t		cnt);
+
+/*
+	pointer queue: pointer-sized blocks, see well_ptr_init()
+*/
+NLC_PUBLIC int		well_ptr_init(	struct well	*buf);
+
+NLC_PUBLIC size_t	well_ptr_push(	struct well	*buf,
+					void *const	*ptrs,
+					size_t		cnt);
+
+NLC_PUBLIC size_t	well_ptr_pop(	struct well	*buf,
+					void		**ptrs,
+					size_t		max);
+
+/*
+	technique-specific entry points
+
+Each of the above dispatches on the technique the well was initialized with.
+Callers which know it at compile time may instead call e.g.
+	well_reserve_xch() directly; ONLY on wells using that technique.
+*/
+#define WELL_SPECIALIZED_(sfx) \
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res \
+	well_reserve_##sfx(		struct well_sym *from, size_t max_count); \
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res \
+	well_reserve_exact_##sfx(	struct well_sym *from, size_t count); \
+NLC_PUBLIC void	well_release_single_##sfx(	struct well_sym *to, size_t count); \
+NLC_PUBLIC __attribute__((warn_unused_result)) \
+	size_t	well_release_multi_##sfx(	struct well_sym *to, struct well_res res); \
+NLC_PUBLIC void	well_release_ooo_##sfx(		struct well_sym *to, struct well_res res);
+
+WELL_SPECIALIZED_(cas)
+WELL_SPECIALIZED_(xch)
+WELL_SPECIALIZED_(mtx)
+WELL_SPECIALIZED_(spl)
+WELL_SPECIALIZED_(tkt)
+
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* well_h_ */
@@ -0,0 +1,231 @@
+#ifndef well_hpp_
+#define well_hpp_
+
+/*	well.hpp
+
+Header-only C++ wrapper for memorywell.
+
+Well<T, N> is a well of (at least) N blocks, each holding one T;
+	block size and count are known at compile time so accessing
+	a block is a constant shift and mask.
+
+Reservations are RAII objects:
+	they are released into the opposite side when they go out of scope,
+	using the release policy (single, multi or ooo) given for that side.
+They can be indexed and iterated with range-for:
+
+	memorywell::Well<struct msg, 1024, memorywell::ooo> w;
+	...
+	if (auto res = w.produce(16))
+		for (struct msg &m : res)
+			fill(m);
+	...
+	for (struct msg &m : w.consume_wait(16))
+		handle(m);
+*/
+
+#include <well.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <sched.h>
+
+
+namespace memorywell {
+
+
+/*
+	release policies
+*/
+
+/*	single
+ONLY a single thread reserves from this side: well_release_single().
+*/
+struct single {
+	static void release(struct well_sym *to, struct well_res res)
+	{
+		well_release_single(to, res.cnt);
+	}
+};
+
+/*	multi
+Multiple threads: well_release_multi(), yielding until earlier reservations
+	have been released.
+*/
+struct multi {
+	static void release(struct well_sym *to, struct well_res res)
+	{
+		while (!well_release_multi(to, res))
+			sched_yield();
+	}
+};
+
+/*	ooo
+Multiple threads: well_release_ooo(), never waits.
+*/
+struct ooo {
+	static void release(struct well_sym *to, struct well_res res)
+	{
+		well_release_ooo(to, res);
+	}
+};
+
+
+/*	next_pow2()
+*/
+constexpr size_t next_pow2(size_t x, size_t p = 1)
+{
+	return p >= x ? p : next_pow2(x, p << 1);
+}
+
+
+/*	Well
+'Producers' is the release policy of threads reserving from 'tx',
+	'Consumers' that of threads reserving from 'rx'.
+*/
+template <typename T, size_t N, typename Producers = single, typename Consumers = single>
+class Well {
+public:
+	static constexpr size_t blk_size = next_pow2(sizeof(T));
+	static constexpr size_t blk_count = next_pow2(N);
+	static constexpr size_t mask = blk_count - 1;
+	static_assert(std::is_trivially_copyable<T>::value,
+		"blocks are copied as raw memory and never constructed or destroyed");
+
+	/*	Reservation
+	Blocks reserved from one side, released into 'to' on destruction.
+	*/
+	template <typename Policy>
+	class Reservation {
+	public:
+		class iterator {
+		public:
+			iterator(T *base, size_t pos) : base_(base), pos_(pos) {}
+			T &operator*() const { return Well::at(base_, pos_); }
+			T *operator->() const { return &Well::at(base_, pos_); }
+			iterator &operator++() { pos_++; return *this; }
+			bool operator!=(const iterator &o) const { return pos_ != o.pos_; }
+			bool operator==(const iterator &o) const { return pos_ == o.pos_; }
+		private:
+			T	*base_;
+			size_t	pos_;
+		};
+
+		Reservation(T *base, struct well_sym *to, struct well_res res)
+			: base_(base), to_(to), res_(res) {}
+		Reservation(Reservation &&o) noexcept
+			: base_(o.base_), to_(o.to_), res_(o.res_) { o.res_.cnt = 0; }
+		Reservation(const Reservation &) = delete;
+		Reservation &operator=(const Reservation &) = delete;
+		Reservation &operator=(Reservation &&) = delete;
+
+		~Reservation() { release(); }
+
+		/* release early; destructor then does nothing */
+		void release()
+		{
+			if (res_.cnt)
+				Policy::release(to_, res_);
+			res_.cnt = 0;
+		}
+
+		explicit operator bool() const { return res_.cnt; }
+		size_t size() const { return res_.cnt; }
+		T &operator[](size_t i) const { return Well::at(base_, res_.pos + i); }
+		iterator begin() const { return iterator(base_, res_.pos); }
+		iterator end() const { return iterator(base_, res_.pos + res_.cnt); }
+
+		/* the underlying C reservation */
+		struct well_res res() const { return res_; }
+
+	private:
+		T		*base_;
+		struct well_sym	*to_;
+		struct well_res	res_;
+	};
+
+	typedef Reservation<Producers>	produced;
+	typedef Reservation<Consumers>	consumed;
+
+
+	Well()
+		: buf_(), ooo_(NULL)
+	{
+		void *mem = NULL;
+		if (well_params(sizeof(T), blk_count, &buf_)
+			|| well_blk_size(&buf_) != blk_size
+			|| well_blk_count(&buf_) != blk_count)
+			throw std::bad_alloc();
+		size_t align = alignof(T) > blk_size ? alignof(T) : blk_size;
+		if (align < sizeof(void *))
+			align = sizeof(void *);
+		if (posix_memalign(&mem, align, well_size(&buf_)))
+			mem = NULL;
+		ooo_ = std::malloc(well_ooo_size(&buf_));
+		if (!mem || !ooo_ || well_init(&buf_, mem) || well_ooo_init(&buf_, ooo_)) {
+			std::free(mem);
+			std::free(ooo_);
+			throw std::bad_alloc();
+		}
+	}
+	~Well()
+	{
+		well_deinit(&buf_);
+		std::free(well_mem(&buf_));
+		std::free(ooo_);
+	}
+	Well(const Well &) = delete;
+	Well &operator=(const Well &) = delete;
+
+
+	/*	produce()
+	Reserve up to 'max_count' blocks from 'tx'; released into 'rx'.
+	Evaluates to 'false' if nothing was reserved.
+	*/
+	produced produce(size_t max_count)
+	{
+		return produced(base(), &buf_.rx, well_reserve(&buf_.tx, max_count));
+	}
+	produced produce_wait(size_t max_count)
+	{
+		return produced(base(), &buf_.rx, well_reserve_wait(&buf_.tx, max_count));
+	}
+
+	/*	consume()
+	Reserve up to 'max_count' blocks from 'rx'; released into 'tx'.
+	Evaluates to 'false' if nothing was reserved.
+	*/
+	consumed consume(size_t max_count)
+	{
+		return consumed(base(), &buf_.tx, well_reserve(&buf_.rx, max_count));
+	}
+	consumed consume_wait(size_t max_count)
+	{
+		return consumed(base(), &buf_.tx, well_reserve_wait(&buf_.rx, max_count));
+	}
+
+	/* the underlying C well, for use with the rest of the C API */
+	struct well *c_well() { return &buf_; }
+
+private:
+	T *base() const { return static_cast<T *>(buf_.ct.buf); }
+
+	/*	at()
+	Same as well_access(), with compile-time shift and mask.
+	*/
+	static T &at(T *base, size_t pos)
+	{
+		return *reinterpret_cast<T *>(
+			reinterpret_cast<char *>(base) + (pos & mask) * blk_size);
+	}
+
+	struct well	buf_;
+	void		*ooo_;
+};
+
+
+} /* namespace memorywell */
+
+#endif /* well_hpp_ */
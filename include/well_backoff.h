@@ -0,0 +1,86 @@
+#ifndef well_backoff_h_
+#define well_backoff_h_
+
+/*	well_backoff.h
+
+Adaptive backoff: what to do when reserve/release doesn't succeed,
+	decided at runtime rather than by WELL_FAIL_METHOD.
+
+A wait goes through three phases:
+	- spin: exponentially growing bursts of CPU 'pause' instructions;
+	- yield: sched_yield();
+	- park: sleep (on a futex, for well_reserve_backoff()).
+How long a thread spins and yields before parking is adapted from its own
+	recent history: waits which succeed while spinning grow the spin budget,
+	waits which end up parked shrink it - towards the bounds of a
+	'struct well_backoff_policy' shared by any number of threads.
+
+Use one 'struct well_backoff' per thread:
+
+	struct well_backoff bo;
+	well_backoff_init(&bo, NULL);
+	...
+	res = well_reserve_backoff(&buf.tx, 16, &bo);
+	...
+	while (!well_release_multi(&buf.rx, res))
+		well_backoff_once(&bo);
+	well_backoff_done(&bo);
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	well_backoff_policy
+Bounds within which each thread adapts.
+*/
+struct well_backoff_policy {
+	uint32_t	spin_min;	/* spin budget (in 'pause's) never shrinks below */
+	uint32_t	spin_max;	/* ... nor grows above */
+	uint32_t	yield_max;	/* yields before parking, at most */
+	uint32_t	park_ns;	/* longest single park */
+};
+
+NLC_PUBLIC extern const struct well_backoff_policy well_backoff_default;
+
+/* well_backoff_once() return: phase of the wait it just did */
+#define WELL_BACKOFF_SPIN	0
+#define WELL_BACKOFF_YIELD	1
+#define WELL_BACKOFF_PARK	2
+
+/*	well_backoff
+Per-thread state.
+*/
+struct well_backoff {
+	const struct well_backoff_policy	*pol;
+	uint32_t	spin_limit;	/* adapted spin budget */
+	uint32_t	yield_limit;	/* adapted yield budget */
+	/* current wait */
+	uint32_t	spun;		/* 'pause's so far */
+	uint32_t	burst;		/* 'pause's in next burst */
+	uint32_t	yielded;
+	uint32_t	parked;
+};
+
+
+NLC_PUBLIC void	well_backoff_init(	struct well_backoff			*bo,
+					const struct well_backoff_policy	*pol);
+
+NLC_PUBLIC int	well_backoff_once(	struct well_backoff	*bo);
+
+NLC_PUBLIC void	well_backoff_done(	struct well_backoff	*bo);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_reserve_backoff(	struct well_sym		*from,
+				size_t			max_count,
+				struct well_backoff	*bo);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_backoff_h_ */
@@ -0,0 +1,114 @@
+#ifndef well_bcast_h_
+#define well_bcast_h_
+
+/*	well_bcast.h
+
+Broadcast (single producer, multiple consumer fan-out):
+	EVERY consumer sees EVERY block, zero-copy.
+
+Each consumer has its own read cursor.
+The producer reserves from 'buf.tx' as usual and publishes with
+	well_bcast_publish() (instead of releasing into 'buf.rx');
+	blocks only return to 'buf.tx' once the slowest attached consumer
+	is done with them.
+
+A consumer which can't keep up holds up the producer.
+It may be detached (well_bcast_detach()), after which it is ignored;
+	with 'max_stall' set, the producer detaches the slowest consumer(s)
+	once it has failed to reserve 'max_stall' times in a row
+	without them releasing anything.
+Blocks a consumer was reading when it was detached may be overwritten
+	at any time: check well_bcast_attached() after processing them,
+	and discard the results if it returns 0.
+Consumers are fixed at init and never re-attach.
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* consumer states */
+#define WELL_BCAST_ATTACHED	0
+#define WELL_BCAST_DETACHED	1	/* by well_bcast_detach() */
+#define WELL_BCAST_LAGGED	2	/* by the producer: stalled it 'max_stall' times */
+
+/*	well_bcast_cur
+One consumer's cursor, on its own cache line(s).
+*/
+struct well_bcast_cur {
+	size_t		pos;		/* next block to read */
+	size_t		released;	/* all blocks before this one are done */
+	uint32_t	state;
+} __attribute__((aligned(NLC_CACHE_LINE)));
+
+/*	well_bcast
+*/
+struct well_bcast {
+	struct well		buf;
+	struct well_bcast_cur	*cur;
+	size_t			cnt;		/* number of consumers */
+	size_t			max_stall;	/* 0: never detach */
+	size_t			stall_cnt;	/* producer only: failed reserves ... */
+	size_t			stall_tail;	/* ... while 'tail' was here */
+	size_t			head __attribute__((aligned(NLC_CACHE_LINE)));
+						/* published by producer */
+	size_t			tail __attribute__((aligned(NLC_CACHE_LINE)));
+						/* returned to 'buf.tx' */
+};
+
+
+NLC_PUBLIC int	well_bcast_init(	struct well_bcast	*bc,
+					size_t			consumer_cnt,
+					size_t			blk_size,
+					size_t			blk_cnt,
+					size_t			max_stall);
+
+NLC_PUBLIC void	well_bcast_deinit(	struct well_bcast	*bc);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_bcast_reserve(	struct well_bcast	*bc,
+				size_t			max_count);
+
+NLC_PUBLIC void	well_bcast_publish(	struct well_bcast	*bc,
+					struct well_res		res);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_bcast_read(	struct well_bcast	*bc,
+				size_t			consumer,
+				size_t			max_count);
+
+NLC_PUBLIC void	well_bcast_done(	struct well_bcast	*bc,
+					size_t			consumer,
+					struct well_res		res);
+
+NLC_PUBLIC void	well_bcast_detach(	struct well_bcast	*bc,
+					size_t			consumer);
+
+
+/*	well_bcast_attached()
+Returns non-zero if 'consumer' is still attached.
+*/
+NLC_INLINE int well_bcast_attached(struct well_bcast *bc, size_t consumer)
+{
+	return __atomic_load_n(&bc->cur[consumer].state, __ATOMIC_SEQ_CST)
+		== WELL_BCAST_ATTACHED;
+}
+
+/*	well_bcast_lag()
+Blocks published but not yet released by 'consumer'.
+*/
+NLC_INLINE size_t well_bcast_lag(struct well_bcast *bc, size_t consumer)
+{
+	return __atomic_load_n(&bc->head, __ATOMIC_ACQUIRE)
+		- __atomic_load_n(&bc->cur[consumer].released, __ATOMIC_ACQUIRE);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_bcast_h_ */
@@ -0,0 +1,125 @@
+#ifndef well_cache_h_
+#define well_cache_h_
+
+/*	well_cache.h
+
+Per-thread reservation cache: amortize the atomics of reserve/release
+	over many single-block operations.
+
+A thread which handles one block at a time keeps a 'struct well_cache'
+	for its side of a well.
+well_cache_next() hands out one block at a time from a chunk of up to
+	'cap' blocks reserved in one go; well_cache_commit() marks the oldest
+	handed-out block as done.
+Committed blocks are released in one go when the whole chunk is done,
+	or on well_cache_flush() (e.g. before waiting for a reply,
+	or whenever the other side must see them NOW);
+	which also tries to give the rest of the chunk back (see below).
+
+	struct well_cache c;
+	well_cache_init(&c, &buf.tx, &buf.rx, 32, 0);
+	...
+	struct well_res res = well_cache_next(&c);
+	if (res.cnt) {
+		WELL_DEREF(struct item, res.pos, 0, &buf) = item;
+		well_cache_commit(&c);
+	}
+	...
+	well_cache_flush(&c);
+
+Blocks reserved but not yet handed out stay with the cache:
+	'cap' bounds how many blocks one thread can keep from the others.
+
+STARVATION HAZARD: held blocks belong to this thread alone until it
+	hands them out. If it stops (or idles) with blocks held, the other
+	side never sees them and, with WELL_CACHE_OOO, every release by
+	other threads after them is held up too: the whole well stalls.
+well_cache_flush() gives held blocks back (well_unreserve()),
+	but only while the chunk is still the latest reservation on its side:
+	a lone thread per side always gets them back, threads sharing
+	a side often don't.
+It returns how many blocks it could NOT give back; if that is not 0,
+	a thread which is about to stop must use them up itself
+	(well_cache_next() does not reserve while any are held):
+	a consumer processes them, a producer commits them with some
+	value its consumers ignore.
+
+Several threads on the same side (each with its own cache) must pass
+	WELL_CACHE_OOO, and well_ooo_init() must have been called on the well.
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* well_cache_init() flags */
+#define WELL_CACHE_OOO	0x1	/* release with well_release_ooo() */
+
+/*	well_cache
+One thread's cache for one side of a well.
+*/
+struct well_cache {
+	struct well_sym	*from;		/* reserve from */
+	struct well_sym	*to;		/* release into */
+	size_t		cap;		/* largest chunk reserved at once */
+	unsigned	flags;
+	struct well_res	res;		/* current chunk */
+	size_t		handed;		/* blocks of 'res' handed out ... */
+	size_t		committed;	/* ... committed ... */
+	size_t		released;	/* ... released into 'to' */
+};
+
+
+NLC_PUBLIC void	well_cache_init(	struct well_cache	*c,
+					struct well_sym		*from,
+					struct well_sym		*to,
+					size_t			cap,
+					unsigned		flags);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_cache_refill(	struct well_cache	*c);
+
+NLC_PUBLIC size_t	well_cache_flush(	struct well_cache	*c);
+
+
+/*	well_cache_held()
+Blocks reserved by the cache and not yet handed out.
+*/
+NLC_INLINE size_t well_cache_held(const struct well_cache *c)
+{
+	return c->res.cnt - c->handed;
+}
+
+/*	well_cache_next()
+Hand out one block, reserving a new chunk only if none are held.
+
+Returns a 'struct well_res' like well_reserve() with 'cnt' 1,
+	or 0 if nothing could be reserved (or the chunk is used up
+	and blocks are still waiting to be committed).
+*/
+NLC_INLINE struct well_res well_cache_next(struct well_cache *c)
+{
+	if (c->handed < c->res.cnt)
+		return (struct well_res){ .cnt = 1, .pos = c->res.pos + c->handed++ };
+	return well_cache_refill(c);
+}
+
+/*	well_cache_commit()
+Mark the oldest handed-out block as done:
+	releases the chunk once all of it is done.
+*/
+NLC_INLINE void well_cache_commit(struct well_cache *c)
+{
+	if (++c->committed == c->res.cnt)
+		well_cache_flush(c);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_cache_h_ */
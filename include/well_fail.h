@@ -6,34 +6,38 @@
 Failure strategies for well libraries.
 AKA: what to do when reserve/release doesn't succeed?
 
+Fixed at compile time by WELL_FAIL_METHOD;
+	see well_backoff.h for a strategy adapted at runtime.
+
 TODO:
 	- yield to a specific thread (eventing) instead of general yield()?
 */
 
 #include <stddef.h> /* size_t */
+#include <sched.h> /* sched_yield() */
+#include <unistd.h> /* usleep() */
 __thread size_t wait_count = 0;
 
 
 /* Warning: unsafe for high thread counts! */
-#if (FAIL_METHOD == WELL_FAIL_SPIN || FAIL_METHOD == COUNT)
+#if (WELL_FAIL_METHOD == WELL_FAIL_SPIN)
 	#define FAIL_DO() { wait_count++; }
 
 
-#elif (FAIL_METHOD == WELL_FAIL_YIELD) /* OS X scheduler seems to dislike yield() */
+#elif (WELL_FAIL_METHOD == WELL_FAIL_YIELD) /* OS X scheduler seems to dislike yield() */
 	#define FAIL_DO() { wait_count++; sched_yield(); }
 
 
 /* Warning: this is horrifyingly slow on OS X */
-#elif (FAIL_METHOD == WELL_FAIL_SLEEP)
-	#include <time.h>
+#elif (WELL_FAIL_METHOD == WELL_FAIL_SLEEP)
 	#define FAIL_DO() { wait_count++; usleep(1); }
 
 
-#elif (FAIL_METHOD == WELL_FAIL_SIGNAL)
+#elif (WELL_FAIL_METHOD == WELL_FAIL_SIGNAL)
 #error "signal not implemented"
 
 
-#elif (FAIL_METHOD == WELL_FAIL_BOUNDED)
+#elif (WELL_FAIL_METHOD == WELL_FAIL_BOUNDED)
 	/* spin only 8 iterations, then yield() */
 	#define FAIL_DO() if (!(++wait_count & 0x7)) { sched_yield(); }
 
@@ -0,0 +1,89 @@
+#ifndef well_file_h_
+#define well_file_h_
+
+/*	well_file.h
+
+Stream a (possibly huge) file through a well, zero-copy:
+	each block of the well is a window onto 'blk_size' bytes of the file.
+
+One thread runs well_file_pump(): it maps successive file windows
+	into free blocks and hands them to workers.
+Any number of worker threads loop on well_file_next() and process
+	(or, when writing, fill) the blocks they get in parallel,
+	then give them back with well_file_release() - in any order.
+Released windows are dropped from the process with MADV_DONTNEED
+	and remapped further along the file, so resident memory stays bounded
+	by the size of the well no matter the size of the file.
+
+Block 'i' of a reservation starts at file offset well_file_offt(wf, res.pos, i)
+	and holds well_file_len(wf, res.pos, i) valid bytes:
+	only the very last block of a file may be short.
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	well_file
+*/
+struct well_file {
+	struct well	buf;
+	int		fd;
+	int		prot;		/* PROT_* of mapped windows */
+	size_t		file_sz;
+	size_t		blk_total;	/* number of blocks in the file */
+	uint32_t	eof;		/* pump has mapped the last block */
+	void		*ooo;		/* completion bitmaps */
+};
+
+
+NLC_PUBLIC int	well_file_open_read(	struct well_file	*wf,
+					const char		*path,
+					size_t			blk_size,
+					size_t			blk_cnt);
+
+NLC_PUBLIC int	well_file_open_write(	struct well_file	*wf,
+					const char		*path,
+					size_t			file_sz,
+					size_t			blk_size,
+					size_t			blk_cnt);
+
+NLC_PUBLIC int	well_file_pump(		struct well_file	*wf);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_file_next(		struct well_file	*wf,
+				size_t			max_count);
+
+NLC_PUBLIC void	well_file_release(	struct well_file	*wf,
+					struct well_res		res);
+
+NLC_PUBLIC void	well_file_close(	struct well_file	*wf);
+
+
+/*	well_file_offt()
+File offset of block 'i' of the reservation at 'pos'.
+*/
+NLC_INLINE size_t well_file_offt(const struct well_file *wf, size_t pos, size_t i)
+{
+	return (pos + i) << wf->buf.ct.blk_shift;
+}
+
+/*	well_file_len()
+Number of valid bytes in block 'i' of the reservation at 'pos'.
+*/
+NLC_INLINE size_t well_file_len(const struct well_file *wf, size_t pos, size_t i)
+{
+	size_t offt = well_file_offt(wf, pos, i);
+	size_t left = wf->file_sz - offt;
+	return left < wf->buf.ct.blk_size ? left : wf->buf.ct.blk_size;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_file_h_ */
@@ -0,0 +1,96 @@
+#ifndef well_group_h_
+#define well_group_h_
+
+/*	well_group.h
+
+A group of wells ("shards"), e.g. one per core, so that threads on
+	different shards never contend on the same 'avail'/'pos' words.
+
+Each thread passes its own shard index ('local'):
+	- producers only ever push into their local shard;
+	- consumers drain their local shard first and, when it is empty,
+		steal a batch from the other shards in turn.
+
+NOTE: there is NO global order across a group:
+	blocks pushed into different shards may be consumed in any order.
+Within a shard, blocks are consumed in the order they were pushed.
+With WELL_GROUP_NO_STEAL consumers only ever drain their local shard:
+	with one consumer per shard, each shard is then a strict FIFO.
+
+Blocks of a reservation are accessed with well_access(res.pos, i, res.shard).
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* well_group_init() flags */
+#define WELL_GROUP_NO_STEAL	0x1	/* consumers never leave their local shard */
+
+
+/*	well_group
+*/
+struct well_group {
+	struct well	*shards;	/* 'cnt' wells, each on its own cache lines */
+	size_t		cnt;
+	unsigned	flags;
+	void		*mem;		/* buffers of all shards */
+	void		*ooo;		/* completion bitmaps of all shards */
+};
+
+/*	well_gres
+A reservation from one shard of a group.
+*/
+struct well_gres {
+	struct well	*shard;
+	size_t		cnt;
+	size_t		pos;
+};
+
+
+NLC_PUBLIC int	well_group_init(	struct well_group	*grp,
+					size_t			shard_cnt,
+					size_t			blk_size,
+					size_t			blk_cnt,
+					unsigned		flags,
+					uint8_t			technique);
+
+NLC_PUBLIC void	well_group_deinit(	struct well_group	*grp);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_gres
+	well_group_produce(	struct well_group	*grp,
+				size_t			local,
+				size_t			max_count);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_gres
+	well_group_consume(	struct well_group	*grp,
+				size_t			local,
+				size_t			max_count);
+
+/*	well_group_produced()
+Release blocks obtained from well_group_produce() to consumers;
+	any order, any number of producers per shard.
+*/
+NLC_INLINE void well_group_produced(struct well_gres res)
+{
+	well_release_ooo(&res.shard->rx, (struct well_res){ .cnt = res.cnt, .pos = res.pos });
+}
+
+/*	well_group_consumed()
+Release blocks obtained from well_group_consume() back to producers;
+	any order, any number of consumers per shard.
+*/
+NLC_INLINE void well_group_consumed(struct well_gres res)
+{
+	well_release_ooo(&res.shard->tx, (struct well_res){ .cnt = res.cnt, .pos = res.pos });
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_group_h_ */
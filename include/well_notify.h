@@ -0,0 +1,65 @@
+#ifndef well_notify_h_
+#define well_notify_h_
+
+/*	well_notify.h
+
+Event loop integration: an eventfd per well side which becomes readable
+	when that side goes from empty to non-empty,
+	so a well can sit in the same epoll set as sockets and timers.
+
+Notifications are edge-triggered and coalesced: arming the side
+	lets exactly one release write to the eventfd,
+	no matter how many releases follow before the next arming.
+The consumer drains the side until it is empty and then re-arms it;
+	well_notify_rearm() re-checks for blocks released meanwhile,
+	so no wake-up is lost:
+
+	well_notify_init(&buf.rx);
+	epoll_ctl(ep, EPOLL_CTL_ADD, well_notify_fd(&buf.rx),
+		&(struct epoll_event){ .events = EPOLLIN | EPOLLET, ... });
+	...
+	(readable)
+	do {
+		while ((res = well_reserve(&buf.rx, 16)).cnt)
+			(consume, release)
+	} while (well_notify_rearm(&buf.rx));
+
+... or let well_notify_drain() do the above.
+
+Linux only. The eventfd is local to the process which called well_notify_init():
+	wells shared between processes (WELL_F_PSHARED) are refused.
+well_notify_deinit() may run while other threads still release into the side.
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+NLC_PUBLIC int		well_notify_init(	struct well_sym	*sym);
+
+NLC_PUBLIC void		well_notify_deinit(	struct well_sym	*sym);
+
+NLC_PUBLIC int		well_notify_rearm(	struct well_sym	*sym);
+
+NLC_PUBLIC size_t	well_notify_drain(	struct well_sym	*from,
+						size_t		max_count,
+						void		(*fn)(struct well_res res, void *arg),
+						void		*arg);
+
+/*	well_notify_fd()
+The eventfd to poll for 'sym' (EPOLLIN), or -1 if not set up.
+*/
+NLC_INLINE int well_notify_fd(const struct well_sym *sym)
+{
+	return sym->efd;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_notify_h_ */
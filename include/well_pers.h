@@ -0,0 +1,120 @@
+#ifndef well_pers_h_
+#define well_pers_h_
+
+/*	well_pers.h
+
+Persistent wells: the buffer is a shared mapping of a file,
+	preceded in that file by a header holding two durable positions:
+	- 'head': every block before it was consumed;
+	- 'tail': every block before it holds data.
+After a crash, well_pers_open() on the same file resumes with the blocks
+	between 'head' and 'tail' queued for consumers again:
+	at-least-once delivery, without a separate write-ahead log.
+
+Producers reserve from 'wp.buf.tx' as usual, write their blocks, and hand them
+	to consumers with well_pers_commit().
+Consumers reserve from 'wp.buf.rx' as usual, and are done with blocks
+	once they call well_pers_done().
+Both may be called by any number of threads, in any order (see well_release_ooo()).
+
+Released blocks are made durable in batches by well_pers_sync():
+	the data between the old and new 'tail' is msync()ed, then the header.
+It runs automatically:
+	- from whichever thread's well_pers_commit() or well_pers_done()
+		finds 'sync_blocks' blocks released since the last one;
+	- if 'sync_ms' is not 0, from a helper thread started by well_pers_open(),
+		once blocks have been released and 'sync_ms' has passed since
+		the last sync: even if producers and consumers go quiet;
+or explicitly, e.g. by a producer wanting to know its data is durable.
+Consumed blocks are only handed back to producers once the 'head' past them
+	is durable, so a producer finding no free blocks should call well_pers_sync().
+
+A process crash loses nothing that well_pers_sync() has returned for.
+(Surviving power loss additionally relies on the 16 Bytes of 'head' and 'tail'
+	being written to the storage device atomically.)
+One process at a time: the file is locked with flock().
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define WELL_PERS_MAGIC		0x73726570 /* "pers" */
+#define WELL_PERS_VERSION	1
+
+/*	well_pers_hdr
+First thing in the file; the buffer follows at the next page boundary.
+Positions are absolute: they increase forever, across restarts.
+*/
+struct well_pers_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	blk_size;
+	uint64_t	blk_cnt;
+	uint64_t	head;		/* durable: blocks before this were consumed */
+	uint64_t	tail;		/* durable: blocks before this hold data */
+};
+
+/*	well_pers
+*/
+struct well_pers {
+	struct well		buf;
+	struct well_sym		consumed;	/* done, not yet durable */
+	struct well_pers_hdr	*hdr;		/* start of the mapping */
+	size_t			map_sz;
+	int			fd;
+	void			*ooo;		/* completion bitmaps: 'rx' and 'consumed' */
+	uint64_t		base;		/* absolute position of 'buf' position 0 */
+	size_t			head;		/* durable, as positions of 'buf' */
+	size_t			tail;
+	size_t			held;		/* taken from 'consumed', 'head' not yet past */
+	size_t			sync_blocks;
+	uint64_t		sync_ns;
+	size_t			pending;	/* released since last sync */
+	uint64_t		synced_at;	/* CLOCK_MONOTONIC ns */
+	pthread_mutex_t		sync_mtx;
+	/* 'sync_ms' helper thread */
+	pthread_t		timer;
+	pthread_mutex_t		timer_mtx;
+	pthread_cond_t		timer_cond;
+	uint8_t			timer_up;
+	uint8_t			timer_stop;
+};
+
+
+NLC_PUBLIC int	well_pers_open(	struct well_pers	*wp,
+				const char		*path,
+				size_t			blk_size,
+				size_t			blk_cnt,
+				size_t			sync_blocks,
+				uint32_t		sync_ms);
+
+NLC_PUBLIC void	well_pers_commit(	struct well_pers	*wp,
+					struct well_res		res);
+
+NLC_PUBLIC void	well_pers_done(	struct well_pers	*wp,
+				struct well_res		res);
+
+NLC_PUBLIC int	well_pers_sync(	struct well_pers	*wp);
+
+NLC_PUBLIC int	well_pers_close(	struct well_pers	*wp);
+
+
+/*	well_pers_abs()
+Absolute position of block 'i' of the reservation at 'pos':
+	the same block has the same absolute position across restarts.
+*/
+NLC_INLINE uint64_t well_pers_abs(const struct well_pers *wp, size_t pos, size_t i)
+{
+	return wp->base + pos + i;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_pers_h_ */
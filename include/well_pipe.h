@@ -0,0 +1,100 @@
+#ifndef well_pipe_h_
+#define well_pipe_h_
+
+/*	well_pipe.h
+
+A pipeline of N stages over the memory of a single well:
+	blocks go stage 0 -> stage 1 -> ... -> stage N-1 -> stage 0
+	without ever being copied.
+
+Stage 0 is the producer side ('buf.tx'), stage 1 is 'buf.rx',
+	further stages are extra well_sym cursors.
+A stage only ever reserves blocks which the previous stage released,
+	in the same order, so each block is processed by every stage in turn.
+Any stage may have several threads: they release with
+	well_pipe_release() (out-of-order, never waits).
+
+	struct well_res res = well_pipe_reserve(&pipe, k, 16);
+	for (size_t i=0; i < res.cnt; i++)
+		process(well_access(res.pos, i, &pipe.buf));
+	well_pipe_release(&pipe, k, res);
+
+With 2 stages, a pipeline is exactly a well.
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	well_stage
+An extra cursor, on its own cache line(s).
+*/
+struct well_stage {
+	struct well_sym	sym;
+} __attribute__((aligned(NLC_CACHE_LINE)));
+
+/*	well_pipe
+*/
+struct well_pipe {
+	struct well		buf;
+	struct well_stage	*extra;	/* stages 2 .. cnt-1 */
+	size_t			cnt;	/* number of stages */
+	void			*ooo;	/* completion bitmaps of all stages */
+};
+
+
+NLC_PUBLIC int	well_pipe_init(		struct well_pipe	*pipe,
+					size_t			stage_cnt,
+					size_t			blk_size,
+					size_t			blk_cnt);
+
+NLC_PUBLIC void	well_pipe_deinit(	struct well_pipe	*pipe);
+
+
+/*	well_pipe_stage()
+Cursor of stage 'k'.
+*/
+NLC_INLINE struct well_sym *well_pipe_stage(struct well_pipe *pipe, size_t k)
+{
+	if (k == 0)
+		return &pipe->buf.tx;
+	if (k == 1)
+		return &pipe->buf.rx;
+	return &pipe->extra[k - 2].sym;
+}
+
+/*	well_pipe_reserve()
+Reserve up to 'max_count' blocks released by the stage before 'k'.
+*/
+NLC_INLINE struct well_res well_pipe_reserve(struct well_pipe *pipe, size_t k,
+						size_t max_count)
+{
+	return well_reserve(well_pipe_stage(pipe, k), max_count);
+}
+
+/*	well_pipe_reserve_wait()
+*/
+NLC_INLINE struct well_res well_pipe_reserve_wait(struct well_pipe *pipe, size_t k,
+						size_t max_count)
+{
+	return well_reserve_wait(well_pipe_stage(pipe, k), max_count);
+}
+
+/*	well_pipe_release()
+Hand blocks reserved by stage 'k' to the next stage
+	(the last stage hands them back to stage 0).
+*/
+NLC_INLINE void well_pipe_release(struct well_pipe *pipe, size_t k, struct well_res res)
+{
+	well_release_ooo(well_pipe_stage(pipe, (k + 1) % pipe->cnt), res);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_pipe_h_ */
@@ -0,0 +1,103 @@
+#ifndef well_rec_h_
+#define well_rec_h_
+
+/*	well_rec.h
+
+Variable-length records on top of the fixed-size blocks of a well.
+
+A record is a 'struct well_rec_hdr' followed by 'len' bytes of payload,
+	occupying as many consecutive blocks as required.
+This allows a small 'blk_size' even when a minority of objects are large.
+
+Producers (single or multiple):
+	- well_rec_reserve() a record of 'len' bytes
+	- well_rec_write() the payload (or write through well_rec_data()
+		if well_contiguous())
+	- release the reservation to 'rx' as usual
+
+Consumer (SINGLE only: a record header must be read before knowing
+	how many blocks to reserve):
+	- well_rec_next() returns the blocks of the next whole record
+	- well_rec_read() the payload (or read through well_rec_data())
+	- well_release_single() the reservation back to 'tx'
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	well_rec_hdr
+Written at the beginning of the first block of every record.
+*/
+struct well_rec_hdr {
+	size_t		len;	/* payload length in Bytes */
+};
+
+
+/*	well_rec_it
+Consumer-side iterator: blocks reserved but not yet handed out as records.
+Initialize to '{ 0 }'.
+*/
+struct well_rec_it {
+	size_t		pos;
+	size_t		cnt;
+};
+
+
+/*	well_rec_blocks()
+Number of blocks occupied by a record with a 'len' Byte payload.
+*/
+NLC_INLINE size_t well_rec_blocks(const struct well *buf, size_t len)
+{
+	return (sizeof(struct well_rec_hdr) + len + well_blk_size(buf) -1)
+		>> buf->ct.blk_shift;
+}
+
+/*	well_rec_len()
+Payload length of the record starting at 'pos'.
+*/
+NLC_INLINE size_t well_rec_len(const struct well *buf, size_t pos)
+{
+	return ((struct well_rec_hdr *)well_access(pos, 0, buf))->len;
+}
+
+/*	well_rec_data()
+Pointer to the payload of the record starting at 'pos'.
+
+WARNING: the payload may loop around the end of the buffer;
+	this pointer is only valid for the whole payload if well_contiguous().
+Otherwise use well_rec_write() and well_rec_read().
+*/
+NLC_INLINE void *well_rec_data(const struct well *buf, size_t pos)
+{
+	return (char *)well_access(pos, 0, buf) + sizeof(struct well_rec_hdr);
+}
+
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_rec_reserve(	struct well	*buf,
+				size_t		len);
+
+NLC_PUBLIC void	well_rec_write(	const struct well	*buf,
+				size_t			pos,
+				const void		*src,
+				size_t			len);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_rec_next(	struct well		*buf,
+			struct well_rec_it	*it);
+
+NLC_PUBLIC size_t well_rec_read(	const struct well	*buf,
+					size_t			pos,
+					void			*dst,
+					size_t			max_len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_rec_h_ */
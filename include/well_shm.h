@@ -0,0 +1,67 @@
+#ifndef well_shm_h_
+#define well_shm_h_
+
+/*	well_shm.h
+
+Wells living in named shared memory, so that producer and consumer
+	may be separate processes.
+
+One process calls well_shm_create(): this places a header, 'struct well',
+	completion bitmaps (well_release_ooo() may be used) and the buffer
+	in a single segment named 'name' (see shm_open(3)).
+Other processes call well_shm_attach() with the same 'name' and get a pointer
+	to the same 'struct well', which is then used with the regular API.
+
+The well holds absolute pointers (to its buffer and bitmaps),
+	so every process maps the segment at the SAME address.
+On 64-bit platforms the creator picks it from 'name', in a range
+	kept clear of where mappings are placed at random (ASLR),
+	so unrelated (even exec()'d) processes find it free.
+well_shm_attach() fails if that address is nevertheless taken in the caller.
+The layout is checked on attach: processes must be built with the same
+	library version and word size (the technique is read from the well).
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define WELL_SHM_MAGIC		0x6c6c6577 /* "well" */
+#define WELL_SHM_VERSION	8
+
+/*	well_shm_hdr
+First thing in a shared segment; describes the layout of the rest.
+*/
+struct well_shm_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	technique;	/* WELL_DO_* the well was created with */
+	uint32_t	well_sz;	/* sizeof(struct well) of creator */
+	size_t		map_sz;		/* size of the whole segment */
+	void		*addr;		/* where the segment must be mapped */
+	uint32_t	ready;		/* set once creator has initialized the well */
+};
+
+
+NLC_PUBLIC int	well_shm_create(	const char	*name,
+					size_t		blk_size,
+					size_t		blk_cnt,
+					struct well	**out);
+
+NLC_PUBLIC int	well_shm_attach(	const char	*name,
+					struct well	**out);
+
+NLC_PUBLIC void	well_shm_detach(	struct well	*buf);
+
+NLC_PUBLIC void	well_shm_destroy(	const char	*name,
+					struct well	*buf);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_shm_h_ */
@@ -0,0 +1,82 @@
+#ifndef well_sock_h_
+#define well_sock_h_
+
+/*	well_sock.h
+
+Batched datagram I/O: one recvmmsg() or sendmmsg() for a whole run of blocks
+	instead of one syscall per datagram.
+
+Every block holds one datagram, as a single-block record (see well_rec.h):
+	a 'struct well_rec_hdr' with its length, then the payload,
+	read and written with well_rec_len() and well_rec_data().
+Datagrams longer than 'blk_size - sizeof(struct well_rec_hdr)' are truncated.
+
+A 'struct well_sock' is one thread's link between one socket
+	and one side of a well:
+	- ingest: reserve free blocks from 'tx', receive into them,
+		release exactly as many as were filled into 'rx';
+	- egress: reserve full blocks from 'rx', send them (on a connected socket),
+		release exactly as many as were sent back to 'tx'.
+Blocks reserved but not filled (or sent) yet are held for the next call.
+Releases use well_release_single(): the thread using a 'struct well_sock'
+	must be the only one reserving from and releasing into its sides.
+
+	struct well_sock in;
+	well_sock_init(&in, &buf, &buf.tx, &buf.rx, udp_fd);
+	...
+	size_t n = well_sock_recv(&in, 64, MSG_DONTWAIT);
+*/
+
+#include <well.h>
+#include <well_rec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* most datagrams per syscall */
+#define WELL_SOCK_BATCH	64
+
+/*	well_sock
+*/
+struct well_sock {
+	struct well	*buf;
+	struct well_sym	*from;	/* reserve from */
+	struct well_sym	*to;	/* release into */
+	int		fd;
+	struct well_res	held;	/* reserved, not yet received into (or sent) */
+};
+
+
+NLC_PUBLIC int	well_sock_init(	struct well_sock	*ws,
+				struct well		*buf,
+				struct well_sym		*from,
+				struct well_sym		*to,
+				int			fd);
+
+NLC_PUBLIC size_t	well_sock_recv(	struct well_sock	*ws,
+					size_t			max,
+					int			flags);
+
+NLC_PUBLIC size_t	well_sock_send(	struct well_sock	*ws,
+					size_t			max,
+					int			flags);
+
+NLC_PUBLIC void	well_sock_flush(	struct well_sock	*ws);
+
+
+/*	well_sock_payload()
+Largest datagram a block of 'buf' holds whole.
+*/
+NLC_INLINE size_t well_sock_payload(const struct well *buf)
+{
+	return well_blk_size(buf) - sizeof(struct well_rec_hdr);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_sock_h_ */
@@ -0,0 +1,87 @@
+#ifndef well_stats_h_
+#define well_stats_h_
+
+/*	well_stats.h
+
+Per-side counters: is a well chronically full, empty or contended?
+
+Compiled in only when WELL_STATS is defined (meson option 'stats'):
+	otherwise there is nothing in the hot path, well_stats_size() is 0
+	and snapshots read all zeroes, so callers need no #ifdefs.
+Only the counting is compiled out: the 'stats' pointer in struct well_sym
+	is always there (and stays NULL), so code built with and without
+	WELL_STATS agrees on the layout of a well.
+
+Counters live in WELL_STATS_SLOTS cache-line sized slots per side;
+	each thread picks a slot on first use, so threads only share
+	a slot (and its cache line) when there are more threads than slots.
+well_stats_read() adds up the slots of one side.
+
+	struct well buf;
+	...
+	well_init(&buf, mem);
+	well_stats_init(&buf, malloc(well_stats_size(&buf)));
+	...
+	struct well_stats st;
+	well_stats_read(&buf.rx, &st);
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define WELL_STATS_SLOTS	16
+
+/*	well_stats
+Counters for one side; reserve counters are kept by the side reserved from,
+	release counters by the side released into.
+*/
+struct well_stats {
+	uint64_t	reserves;	/* successful reservations */
+	uint64_t	blocks;		/* blocks reserved */
+	uint64_t	reserve_fails;	/* reservations which got nothing */
+	uint64_t	retries;	/* lost a CAS or found the lock taken */
+	uint64_t	release_fails;	/* well_release_multi() out of turn */
+	uint64_t	hwm;		/* most blocks ever available after a release:
+					on 'rx' the deepest backlog,
+					on 'tx' the most free space
+					*/
+};
+
+/*	well_stats_slot
+*/
+struct well_stats_slot {
+	struct well_stats	st;
+} __attribute__((aligned(NLC_CACHE_LINE)));
+
+
+/*	well_stats_size()
+Size of the memory required by well_stats_init(): one set of slots per side.
+*/
+NLC_INLINE size_t well_stats_size(const struct well *buf)
+{
+	(void)buf;
+#ifdef WELL_STATS
+	return sizeof(struct well_stats_slot) * WELL_STATS_SLOTS * 2;
+#else
+	return 0;
+#endif
+}
+
+NLC_PUBLIC int	well_stats_init(	struct well	*buf,
+					void		*mem);
+
+NLC_PUBLIC void	well_stats_read(	const struct well_sym	*sym,
+					struct well_stats	*out);
+
+NLC_PUBLIC void	well_stats_reset(	struct well_sym	*sym);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_stats_h_ */
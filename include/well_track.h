@@ -0,0 +1,102 @@
+#ifndef well_track_h_
+#define well_track_h_
+
+/*	well_track.h
+
+Ownership tracking for reservations released with well_release_multi().
+
+Releases happen strictly in order: a thread which reserves and then
+	never releases (it is cancelled, stuck, crashed) holds up every later
+	release on that side - forever.
+Reserving through a 'struct well_track' records who holds what and since when,
+	so that a watchdog can:
+	- find the oldest outstanding reservation and its age
+		(well_track_oldest(), well_claim_age());
+	- release it on behalf of its owner (well_track_force());
+	- or hand it to another owner to finish (well_track_reassign()).
+An owner whose claim was forced or reassigned away finds out because
+	well_track_release() keeps failing and well_track_owns() returns 0:
+	it must not touch those blocks again.
+
+Owners are caller-chosen ids (e.g. a thread index), anything except
+	WELL_TRACK_FREE and WELL_TRACK_BUSY.
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define WELL_TRACK_FREE	0		/* slot unused */
+#define WELL_TRACK_BUSY	UINT64_MAX	/* slot being filled or released */
+
+/*	well_claim
+One outstanding reservation.
+*/
+struct well_claim {
+	uint64_t	owner;
+	size_t		pos;
+	size_t		cnt;
+	uint64_t	stamp;	/* CLOCK_MONOTONIC ns at reserve (or reassign) */
+} __attribute__((aligned(NLC_CACHE_LINE)));
+
+/*	well_track
+*/
+struct well_track {
+	struct well_sym		*from;	/* reserve from */
+	struct well_sym		*to;	/* release into */
+	struct well_claim	*claims;
+	size_t			cnt;	/* most reservations outstanding at once */
+};
+
+
+NLC_PUBLIC int	well_track_init(	struct well_track	*tr,
+					struct well_sym		*from,
+					struct well_sym		*to,
+					size_t			max_claims);
+
+NLC_PUBLIC void	well_track_deinit(	struct well_track	*tr);
+
+NLC_PUBLIC __attribute__((warn_unused_result)) struct well_res
+	well_track_reserve(	struct well_track	*tr,
+				uint64_t		owner,
+				size_t			max_count);
+
+NLC_PUBLIC __attribute__((warn_unused_result))
+	size_t	well_track_release(	struct well_track	*tr,
+					uint64_t		owner,
+					struct well_res		res);
+
+NLC_PUBLIC int	well_track_owns(	struct well_track	*tr,
+					uint64_t		owner,
+					struct well_res		res);
+
+NLC_PUBLIC int	well_track_oldest(	struct well_track	*tr,
+					struct well_claim	*out);
+
+NLC_PUBLIC size_t	well_track_force(	struct well_track	*tr,
+						const struct well_claim	*claim);
+
+NLC_PUBLIC int	well_track_reassign(	struct well_track	*tr,
+					const struct well_claim	*claim,
+					uint64_t		new_owner);
+
+
+/*	well_claim_age()
+Nanoseconds since 'claim' was reserved (or reassigned).
+*/
+NLC_INLINE uint64_t well_claim_age(const struct well_claim *claim)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec - claim->stamp;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_track_h_ */
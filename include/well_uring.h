@@ -0,0 +1,157 @@
+#ifndef well_uring_h_
+#define well_uring_h_
+
+/*	well_uring.h
+
+I/O straight into and out of reservations, through io_uring:
+	no bounce buffer, no syscall per block.
+
+The whole buffer of the well is registered with the ring as a fixed buffer
+	(falling back to plain reads/writes if registration is refused,
+	e.g. by RLIMIT_MEMLOCK).
+A reservation handed to well_uring_read() is filled from a file, pipe or socket;
+	one handed to well_uring_write() is written out.
+Either way, once all of its bytes are transferred, its blocks are released
+	with well_release_single() into the side given with it.
+Releases happen in the order the reservations were handed to the ring,
+	whatever order the kernel completes them in.
+
+Short transfers are resubmitted for the remainder.
+A read hitting end-of-file, or any error, stops the ring at that reservation:
+	see well_uring_failed() and well_uring_resolve().
+
+I/O at an offset (files: 'off >= 0') runs in parallel;
+	I/O at the current position ('off < 0': pipes, sockets) is kept in order
+	by running one such reservation at a time.
+
+One thread drives a ring, and must be the only one releasing
+	into the sides it releases into. E.g. capture to disk:
+
+	(capture thread)
+	while (well_uring_space(&ur_in) && (res = well_reserve(&buf.tx, 64)).cnt)
+		well_uring_read(&ur_in, res, &buf.rx, sock, -1);
+	well_uring_submit(&ur_in, 1);
+	well_uring_complete(&ur_in);
+
+	(disk thread)
+	while (well_uring_space(&ur_out) && (res = well_reserve(&buf.rx, 64)).cnt) {
+		well_uring_write(&ur_out, res, &buf.tx, file, off);
+		off += res.cnt * well_blk_size(&buf);
+	}
+	well_uring_submit(&ur_out, 1);
+	well_uring_complete(&ur_out);
+
+Linux only; uses the io_uring system calls directly (no liburing).
+*/
+
+#include <well.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	well_uring_op
+One reservation in flight.
+*/
+struct well_uring_op {
+	struct well_res	res;
+	struct well_sym	*to;		/* release into when done */
+	int64_t		off;		/* file offset, or -1 for current position */
+	int		fd;
+	uint8_t		write;
+	uint8_t		state;		/* WELL_URING_* */
+	uint8_t		busy;		/* segments in flight */
+	int32_t		err;		/* -errno; -ENODATA at end-of-file */
+	size_t		done[2];	/* bytes transferred per segment */
+};
+
+#define WELL_URING_QUEUED	0	/* waiting for the stream ahead of it */
+#define WELL_URING_RUNNING	1
+#define WELL_URING_DONE		2
+#define WELL_URING_FAILED	3
+
+/*	well_uring
+*/
+struct well_uring {
+	struct well		*buf;
+	int			fd;		/* the ring */
+	uint8_t			fixed;		/* buffer registered */
+	/* submission queue */
+	unsigned		*sq_head;
+	unsigned		*sq_tail;
+	unsigned		sq_mask;
+	unsigned		*sq_array;
+	void			*sqes;
+	unsigned		sq_local;	/* tail, not yet published */
+	unsigned		sq_pending;	/* published, not yet submitted */
+	/* completion queue */
+	unsigned		*cq_head;
+	unsigned		*cq_tail;
+	unsigned		cq_mask;
+	void			*cqes;
+	/* mappings */
+	void			*ring_map;
+	size_t			ring_sz;
+	size_t			sqes_sz;
+	/* reservations, oldest first */
+	struct well_uring_op	*ops;
+	size_t			depth;
+	size_t			head;
+	size_t			tail;
+	uint8_t			streaming;	/* an 'off < 0' op is running */
+};
+
+
+NLC_PUBLIC int	well_uring_init(	struct well_uring	*ur,
+					struct well		*buf,
+					size_t			depth);
+
+NLC_PUBLIC void	well_uring_deinit(	struct well_uring	*ur);
+
+NLC_PUBLIC int	well_uring_read(	struct well_uring	*ur,
+					struct well_res		res,
+					struct well_sym		*to,
+					int			fd,
+					int64_t			off);
+
+NLC_PUBLIC int	well_uring_write(	struct well_uring	*ur,
+					struct well_res		res,
+					struct well_sym		*to,
+					int			fd,
+					int64_t			off);
+
+NLC_PUBLIC int	well_uring_submit(	struct well_uring	*ur,
+					unsigned		wait_nr);
+
+NLC_PUBLIC size_t	well_uring_complete(	struct well_uring	*ur);
+
+NLC_PUBLIC int	well_uring_failed(	const struct well_uring	*ur,
+					struct well_res		*res,
+					size_t			*done);
+
+NLC_PUBLIC void	well_uring_resolve(	struct well_uring	*ur);
+
+
+/*	well_uring_space()
+How many more reservations 'ur' can take.
+*/
+NLC_INLINE size_t well_uring_space(const struct well_uring *ur)
+{
+	return ur->depth - (ur->tail - ur->head);
+}
+
+/*	well_uring_inflight()
+How many reservations 'ur' has not yet released.
+*/
+NLC_INLINE size_t well_uring_inflight(const struct well_uring *ur)
+{
+	return ur->tail - ur->head;
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* well_uring_h_ */
@@ -1,36 +1,252 @@
 #include <ndebug.h>
 #include <well.h>
+#include <well_stats.h>
 #include <nmath.h>
+#include "well_relax.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <string.h> /* memset */
+#include <strings.h> /* strcasecmp */
+#ifdef __linux__
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
 
 /*
 	compile-time sanity
 */
 NLC_ASSERT(size_t_is_pointer, sizeof(size_t) == sizeof(void *));
 NLC_ASSERT(size_t_is_atomic, __atomic_always_lock_free(sizeof(size_t), 0) == 1);
+/* reserve/release only touch the first line of a side (see struct well_sym) */
+NLC_ASSERT(sym_hot_line, offsetof(struct well_sym, serving) + sizeof(size_t)
+				<= NLC_CACHE_LINE);
+
+
+/*
+	readability for locking implementations:
+	'tech' is always a constant, so these compile down to one or the other
+*/
+/* returns 0 if lock is acquired */
+NLC_INLINE int trylock_(struct well_sym *sym, const uint8_t tech)
+{
+	if (tech == WELL_DO_MTX)
+		return pthread_mutex_trylock(&sym->mtx);
+	return __atomic_test_and_set(&sym->spl, __ATOMIC_ACQUIRE);
+}
+NLC_INLINE void lock_(struct well_sym *sym, const uint8_t tech)
+{
+	if (tech == WELL_DO_MTX)
+		pthread_mutex_lock(&sym->mtx);
+	else while (__atomic_test_and_set(&sym->spl, __ATOMIC_ACQUIRE))
+		;
+}
+NLC_INLINE void unlock_(struct well_sym *sym, const uint8_t tech)
+{
+	if (tech == WELL_DO_MTX)
+		pthread_mutex_unlock(&sym->mtx);
+	else
+		__atomic_clear(&sym->spl, __ATOMIC_RELEASE);
+}
+
+
+/*
+	statistics: compiled out entirely unless WELL_STATS
+*/
+#ifdef WELL_STATS
+static unsigned stats_next_ = 0;
+static __thread unsigned stats_slot_ = UINT_MAX;
+
+/*	stats_()
+Returns this thread's slot of 'sym', or NULL if 'sym' is not counting.
+*/
+NLC_INLINE struct well_stats *stats_(struct well_sym *sym)
+{
+	if (!sym->stats)
+		return NULL;
+	if (stats_slot_ == UINT_MAX)
+		stats_slot_ = __atomic_fetch_add(&stats_next_, 1, __ATOMIC_RELAXED)
+				% WELL_STATS_SLOTS;
+	return &sym->stats[stats_slot_].st;
+}
+
+/* slots may be shared by threads: increments must be atomic */
+#define STAT_ADD_(sym, field, n) do { \
+		struct well_stats *st_ = stats_(sym); \
+		if (st_) \
+			__atomic_fetch_add(&st_->field, (n), __ATOMIC_RELAXED); \
+	} while (0)
+
+#define STAT_MAX_(sym, val) do { \
+		struct well_stats *st_ = stats_(sym); \
+		uint64_t v_ = (val); \
+		if (!st_) \
+			break; \
+		uint64_t m_ = __atomic_load_n(&st_->hwm, __ATOMIC_RELAXED); \
+		while (v_ > m_ && !__atomic_compare_exchange_n(&st_->hwm, &m_, v_, \
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) \
+			; \
+	} while (0)
+
+/*	stat_res_()
+Count the outcome of a reservation of up to 'asked' blocks.
+*/
+NLC_INLINE void stat_res_(struct well_sym *from, size_t asked, struct well_res res)
+{
+	struct well_stats *st = stats_(from);
+	if (!st || !asked)
+		return;
+	if (res.cnt) {
+		__atomic_fetch_add(&st->reserves, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&st->blocks, res.cnt, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_add(&st->reserve_fails, 1, __ATOMIC_RELAXED);
+	}
+}
+
+#else
+#define STAT_ADD_(sym, field, n) ((void)0)
+#define STAT_MAX_(sym, val) ((void)(val))
+#define stat_res_(from, asked, res) ((void)0)
+#endif
 
 
 /*
-	readability for locking implementations
-*/
-#if (WELL_TECHNIQUE == WELL_DO_MTX)
-	/* returns 0 if lock is acquired */
-	#define TRYLOCK_(lock_ptr) \
-		pthread_mutex_trylock(lock_ptr)
-	#define LOCK_(lock_ptr) \
-		pthread_mutex_lock(lock_ptr)
-	#define UNLOCK_(lock_ptr) \
-		pthread_mutex_unlock(lock_ptr)
-
-#elif (WELL_TECHNIQUE == WELL_DO_SPL)
-	#define TRYLOCK_(lock_ptr) \
-		__atomic_test_and_set(lock_ptr, __ATOMIC_ACQUIRE)
-		//__atomic_exchange_n(lock_ptr, 1, __ATOMIC_ACQUIRE)
-	#define LOCK_(lock_ptr) \
-		while (TRYLOCK_(lock_ptr)) \
-			;
-	#define UNLOCK_(lock_ptr) \
-		__atomic_clear(lock_ptr, __ATOMIC_RELEASE)
-		//__atomic_exchange_n(lock_ptr, 0, __ATOMIC_RELEASE)
+	tickets (WELL_DO_TKT): reservers on one side are served in FIFO order
+*/
+
+/*	WELL_TKT_QUEUE
+A reservation fails outright rather than queue behind this many others:
+	a ticket, once taken, must be waited out.
+*/
+#ifndef WELL_TKT_QUEUE
+#define WELL_TKT_QUEUE 64
+#endif
+
+/*	turn_take_()
+Take a ticket and wait for its turn; yield now and then
+	in case the thread being served was preempted.
+
+returns 0 when it is the caller's turn (call turn_done_() after),
+	non-zero if the queue was too long to join
+*/
+NLC_INLINE int turn_take_(struct well_sym *sym)
+{
+	if (__atomic_load_n(&sym->ticket, __ATOMIC_RELAXED)
+		- __atomic_load_n(&sym->serving, __ATOMIC_RELAXED) >= WELL_TKT_QUEUE)
+		return 1;
+
+	size_t t = __atomic_fetch_add(&sym->ticket, 1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&sym->serving, __ATOMIC_ACQUIRE) == t)
+		return 0;
+	STAT_ADD_(sym, retries, 1);
+	unsigned spins = 0;
+	while (__atomic_load_n(&sym->serving, __ATOMIC_ACQUIRE) != t)
+		relax_(&spins);
+	return 0;
+}
+
+/*	turn_done_()
+Serve the next ticket.
+*/
+NLC_INLINE void turn_done_(struct well_sym *sym)
+{
+	__atomic_store_n(&sym->serving,
+		__atomic_load_n(&sym->serving, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+	blocking waits: park on the 'avail' word of a well_sym
+*/
+#ifdef __linux__
+/*	avail_word_()
+A futex is 32 bits wide: point at the low-order half of 'avail'.
+This half is only 0 when all of 'avail' is 0 as long as the well
+	has fewer than 2^32 blocks.
+*/
+NLC_INLINE uint32_t *avail_word_(struct well_sym *sym)
+{
+#if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	return (uint32_t *)&sym->avail;
+#else
+	return (uint32_t *)&sym->avail + (sizeof(size_t) / sizeof(uint32_t) -1);
+#endif
+}
+
+/*	futex_wait_()
+Sleep while 'avail' is 0, or until (absolute, CLOCK_MONOTONIC) 'deadline'.
+NOTE: not FUTEX_PRIVATE: a well may live in memory shared between processes.
+
+returns 0 when woken (possibly spuriously) or ETIMEDOUT
+*/
+NLC_INLINE int futex_wait_(struct well_sym *sym, const struct timespec *deadline)
+{
+	if (!syscall(SYS_futex, avail_word_(sym), FUTEX_WAIT_BITSET, 0,
+			deadline, NULL, FUTEX_BITSET_MATCH_ANY))
+		return 0;
+	if (errno == ETIMEDOUT)
+		return ETIMEDOUT;
+	return 0; /* EAGAIN or EINTR: caller retries */
+}
+
+/*	notify_()
+Signal the eventfd of 'sym' if an event loop armed it (see well_notify.h);
+	only the first release after arming gets to write.
+'notifying' keeps well_notify_deinit() from closing 'efd' under us:
+	either it sees our increment and waits, or we see its -1.
+*/
+static void notify_(struct well_sym *sym)
+{
+	if (!__atomic_exchange_n(&sym->armed, 0, __ATOMIC_SEQ_CST))
+		return;
+	__atomic_add_fetch(&sym->notifying, 1, __ATOMIC_SEQ_CST);
+	int fd = __atomic_load_n(&sym->efd, __ATOMIC_SEQ_CST);
+	uint64_t one = 1;
+	/* can only fail if the counter is about to overflow: it's readable anyhow */
+	if (fd >= 0) {
+		ssize_t ret = write(fd, &one, sizeof(one));
+		(void)ret;
+	}
+	__atomic_sub_fetch(&sym->notifying, 1, __ATOMIC_RELEASE);
+}
+
+/*	wake_()
+Wake up to 'count' threads parked on 'sym', and any event loop waiting on it.
+Fast path is two loads (same cache line) when nobody is waiting.
+*/
+NLC_INLINE void wake_(struct well_sym *sym, size_t count)
+{
+	if (__atomic_load_n(&sym->armed, __ATOMIC_SEQ_CST))
+		notify_(sym);
+	if (!__atomic_load_n(&sym->waiters, __ATOMIC_SEQ_CST))
+		return;
+	if (count > INT_MAX)
+		count = INT_MAX;
+	syscall(SYS_futex, avail_word_(sym), FUTEX_WAKE, (int)count, NULL, NULL, 0);
+}
+
+#else
+/* no futexes: yield instead of parking, waking is a no-op */
+NLC_INLINE int futex_wait_(struct well_sym *sym, const struct timespec *deadline)
+{
+	sched_yield();
+	if (deadline) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > deadline->tv_sec
+			|| (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec))
+			return ETIMEDOUT;
+	}
+	return 0;
+}
+
+NLC_INLINE void wake_(struct well_sym *sym, size_t count)
+{
+	return;
+}
 #endif
 
 
@@ -50,6 +266,8 @@ int well_params(size_t blk_size, size_t blk_cnt, struct well *out)
 {
 	int err_cnt = 0;
 
+	out->ct.flags = 0;
+	out->ct.technique = WELL_TECHNIQUE;
 	/* should go away by the time compiler is through with it :P */
 	out->ct.blk_size = nm_next_pow2_64(blk_size);
 	NB_die_if(out->ct.blk_size < blk_size, "blk_size %zu overflow", blk_size);
@@ -75,10 +293,42 @@ die:
 }
 
 
+/*	lock_init_()
+Set the technique (and sharing) of 'sym', which belongs to 'buf', from 'buf->ct'
+	and initialize its lock (if any).
+*/
+static int lock_init_(const struct well *buf, struct well_sym *sym)
+{
+	int err_cnt = 0;
+	sym->technique = buf->ct.technique;
+	sym->flags = buf->ct.flags & WELL_F_PSHARED;
+	sym->spl = 0;
+	sym->ticket = sym->serving = 0;
+	if (sym->technique == WELL_DO_MTX) {
+		pthread_mutexattr_t attr;
+		NB_die_if(pthread_mutexattr_init(&attr), "");
+		int err = 0;
+		if (buf->ct.flags & WELL_F_PSHARED)
+			err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		if (!err)
+			err = pthread_mutex_init(&sym->mtx, &attr);
+		/* on success or failure alike */
+		pthread_mutexattr_destroy(&attr);
+		NB_die_if(err, "mutex: %s", strerror(err));
+	}
+die:
+	return err_cnt;
+}
+
+
 /*	well_init()
 Initialize an well struct 'buf' with (caller-allocated) 'mem'.
 This function expects 'buf' to have had well_params() successfully called on it,
 	and for 'mem' to be at least well_size(buf) large.
+If WELL_F_PSHARED is set in 'buf->ct.flags', locks are set up so they may be
+	shared between processes.
+The contention technique is 'buf->ct.technique': WELL_TECHNIQUE unless
+	changed after well_params() (or see well_init_technique()).
 
 The reason for this more complicated initialization pattern is to allow
 	caller full control over 'mem' without bringing complexities
@@ -90,37 +340,265 @@ int well_init(struct well *buf, void *mem)
 {
 	int err_cnt = 0;
 	NB_die_if(!buf, "");
+	NB_die_if(!well_technique_name(buf->ct.technique),
+		"technique %u not implemented", buf->ct.technique);
 	buf->tx.release_pos = buf->rx.release_pos = 0;
+	buf->tx.waiters = buf->rx.waiters = 0;
+	buf->tx.armed = buf->rx.armed = 0;
+	buf->tx.efd = buf->rx.efd = -1;
+	buf->tx.notifying = buf->rx.notifying = 0;
+	buf->tx.stats = buf->rx.stats = NULL;
 
 	NB_die_if(!mem, "");
 	buf->ct.buf = mem;
+	buf->ct.flags &= ~(WELL_F_MIRROR | WELL_F_PTR | WELL_F_SYMS);
 
 
-#if (WELL_TECHNIQUE == WELL_DO_MTX)
-	NB_die_if(pthread_mutex_init(&buf->tx.lock, NULL), "");
-	NB_die_if(pthread_mutex_init(&buf->rx.lock, NULL), "");
-#elif (WELL_TECHNIQUE == WELL_DO_SPL)
-	buf->tx.lock = buf->rx.lock = 0;
-#endif
+	NB_die_if(lock_init_(buf, &buf->tx), "");
+	NB_die_if(lock_init_(buf, &buf->rx), "");
 
 die:
 	return err_cnt;
 }
 
 
-/*	well_deinit()
+/*	well_init_technique()
+Like well_init(), but contend for 'buf' using 'technique' (WELL_DO_*)
+	rather than the build default WELL_TECHNIQUE.
+
+returns 0 on success
 */
-void well_deinit(struct well *buf)
+int well_init_technique(struct well *buf, void *mem, uint8_t technique)
+{
+	int err_cnt = 0;
+	NB_die_if(!buf, "");
+	buf->ct.technique = technique;
+	NB_die_if(well_init(buf, mem), "");
+die:
+	return err_cnt;
+}
+
+
+/*	well_technique_name()
+Returns the name of 'technique' (e.g. "XCH" for WELL_DO_XCH),
+	or NULL if it is not implemented.
+*/
+const char *well_technique_name(uint8_t technique)
+{
+	switch (technique) {
+	case WELL_DO_CAS:	return "CAS";
+	case WELL_DO_XCH:	return "XCH";
+	case WELL_DO_MTX:	return "MTX";
+	case WELL_DO_SPL:	return "SPL";
+	case WELL_DO_TKT:	return "TKT";
+	default:		return NULL;
+	}
+}
+
+/*	well_technique_parse()
+Returns the technique (WELL_DO_*) called 'name' (case-insensitive),
+	or 0 if there is none.
+*/
+uint8_t well_technique_parse(const char *name)
+{
+	for (uint8_t t=1; t < UINT8_MAX; t++) {
+		const char *n = well_technique_name(t);
+		if (!n)
+			break;
+		if (!strcasecmp(n, name))
+			return t;
+	}
+	return 0;
+}
+
+
+/*	well_ooo_init()
+Set up completion bitmaps so that well_release_ooo() may be used
+	on either side of 'buf'.
+This function expects 'buf' to have had well_params() successfully called on it,
+	and for 'mem' to be at least well_ooo_size(buf) large.
+Call before any blocks are reserved from 'buf'.
+'mem' is owned by the caller and must outlive 'buf'.
+
+returns 0 on success
+*/
+int well_ooo_init(struct well *buf, void *mem)
 {
-#if (WELL_TECHNIQUE == WELL_DO_MTX)
-	NB_die_if(pthread_mutex_destroy(&buf->tx.lock), "");
-	NB_die_if(pthread_mutex_destroy(&buf->rx.lock), "");
+	int err_cnt = 0;
+	NB_die_if(!buf, "");
+	NB_die_if(!mem, "");
+
+	memset(mem, 0x0, well_ooo_size(buf));
+	buf->tx.lap = buf->rx.lap = well_blk_count(buf);
+	buf->tx.done = mem;
+	buf->rx.done = buf->tx.done + ((buf->tx.lap + 63) >> 6);
+
+die:
+	return err_cnt;
+}
+
+
+/*	well_sym_init()
+Initialize an extra, empty, 'sym' sharing the memory of 'buf':
+	blocks only enter it when released into it
+	(e.g. the stages of a pipeline, see well_pipe.h).
+If 'done' is not NULL, it must be at least well_ooo_size(buf) / 2 large,
+	and lets well_release_ooo() release into 'sym'.
+
+returns 0 on success
+*/
+int well_sym_init(struct well *buf, struct well_sym *sym, void *done)
+{
+	int err_cnt = 0;
+	NB_die_if(!buf || !sym, "");
+
+	sym->pos = sym->avail = sym->release_pos = 0;
+	sym->waiters = 0;
+	sym->armed = 0;
+	sym->efd = -1;
+	sym->notifying = 0;
+	sym->stats = NULL;
+	sym->done = done;
+	sym->lap = 0;
+	if (done) {
+		memset(done, 0x0, well_ooo_size(buf) / 2);
+		sym->lap = well_blk_count(buf);
+	}
+	NB_die_if(lock_init_(buf, sym), "");
+	buf->ct.flags |= WELL_F_SYMS;
+
+die:
+	return err_cnt;
+}
+
+
+/*	well_sym_deinit()
+*/
+void well_sym_deinit(struct well_sym *sym)
+{
+	if (sym->technique == WELL_DO_MTX)
+		NB_die_if(pthread_mutex_destroy(&sym->mtx), "");
 die:
 	return;
-#endif
 }
 
 
+/*	well_deinit()
+*/
+void well_deinit(struct well *buf)
+{
+	well_sym_deinit(&buf->tx);
+	well_sym_deinit(&buf->rx);
+}
+
+
+/*
+	technique dispatch
+
+Every technique is compiled in: each operation below is a static inline
+	core taking a constant 'tech', specialized into one public entry point
+	per technique (see SPECIALIZE_() at the bottom of this file).
+The generic entry points (well_reserve() etc) switch on 'sym->technique',
+	which lives on the same cache line as 'avail' and never changes:
+	a direct, well-predicted branch rather than an indirect call.
+*/
+
+/*	reserve_do_()
+*/
+NLC_INLINE struct well_res reserve_do_(struct well_sym *from, size_t max_count,
+					const uint8_t tech)
+{
+	/* Callers must ASSUME 'pos' is garbage on failure;
+		zeroing is (nearly) free and keeps the inlined variants
+		free of maybe-uninitialized warnings.
+	*/
+	struct well_res ret = { 0 };
+
+	if (tech == WELL_DO_CAS) {
+		ret.cnt = __atomic_load_n(&from->avail, __ATOMIC_RELAXED);
+		for (;;) {
+			/* fail early and cheaply */
+			if (!ret.cnt)
+				return ret;
+			/* prevent CAS'ing a negative integer into 'avail' */
+			if (ret.cnt < max_count)
+				max_count = ret.cnt;
+			if (__atomic_compare_exchange_n(&from->avail, &ret.cnt, ret.cnt - max_count,
+							1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				break;
+			STAT_ADD_(from, retries, 1);
+		}
+		ret.pos = __atomic_fetch_add(&from->pos, max_count, __ATOMIC_RELAXED);
+		/* penalty for failing cheaply: succeed expensively */
+		ret.cnt = max_count;
+		return ret;
+
+
+	} else if (tech == WELL_DO_XCH) {
+		ret.cnt = __atomic_exchange_n(&from->avail, 0, __ATOMIC_ACQUIRE);
+		if (!ret.cnt)
+			return ret;
+
+		if (ret.cnt > max_count) {
+			__atomic_fetch_add(&from->avail, ret.cnt-max_count, __ATOMIC_SEQ_CST);
+			/* waiters may have seen the transient 0 */
+			wake_(from, ret.cnt-max_count);
+			ret.cnt = max_count;
+		}
+		ret.pos = __atomic_fetch_add(&from->pos, ret.cnt, __ATOMIC_RELAXED);
+		return ret;
+
+
+	} else if (tech == WELL_DO_TKT) {
+		/* fail early and cheaply: don't queue for nothing */
+		if (!__atomic_load_n(&from->avail, __ATOMIC_RELAXED) || turn_take_(from))
+			return ret;
+		/* our turn: only releasers (adding) race us on 'avail', nobody on 'pos' */
+		ret.cnt = __atomic_load_n(&from->avail, __ATOMIC_ACQUIRE);
+		if (ret.cnt) {
+			if (ret.cnt > max_count)
+				ret.cnt = max_count;
+			__atomic_fetch_sub(&from->avail, ret.cnt, __ATOMIC_RELAXED);
+			/* only the ticket holder writes 'pos', but others may read it */
+			ret.pos = __atomic_load_n(&from->pos, __ATOMIC_RELAXED);
+			__atomic_store_n(&from->pos, ret.pos + ret.cnt, __ATOMIC_RELAXED);
+		}
+		turn_done_(from);
+		return ret;
+
+
+	} else { /* WELL_DO_MTX || WELL_DO_SPL */
+		ret.cnt = 0;
+		if (trylock_(from, tech)) {
+			STAT_ADD_(from, retries, 1);
+		} else {
+			if (from->avail) {
+				if (from->avail < max_count) {
+					max_count = from->avail;
+					from->avail = 0;
+				} else {
+					from->avail -= max_count;
+				}
+				ret.pos = from->pos;
+				from->pos += max_count;
+				ret.cnt = max_count;
+			}
+			unlock_(from, tech);
+		}
+		return ret;
+	}
+}
+
+/*	reserve_()
+*/
+NLC_INLINE struct well_res reserve_(struct well_sym *from, size_t max_count,
+					const uint8_t tech)
+{
+	struct well_res ret = reserve_do_(from, max_count, tech);
+	stat_res_(from, max_count, ret);
+	return ret;
+}
+
 /*	well_reserve()
 Reserve up to 'max_count' buffer blocks;
 	single OR multiple producers/consumers.
@@ -134,72 +612,210 @@ Use _access() functions with 'pos' to obtain valid pointers.
 On failure, 'cnt == 0' and 'pos' is garbage.
 
 NOTE ON TIMING: will not wait; will not spin.
-	Caller decides whether to sleep(), yield() or whatever.
+	Caller decides whether to sleep(), yield() or whatever;
+	or calls well_reserve_wait() instead.
 */
 struct well_res	well_reserve(	struct well_sym	*from,
 				size_t		max_count)
 {
-	/* Don't waste cycles setting this; but must ASSUME it's garbage
-		until explicitly set.
-	*/
-	struct well_res ret;
+	switch (from->technique) {
+	case WELL_DO_CAS:	return reserve_(from, max_count, WELL_DO_CAS);
+	case WELL_DO_XCH:	return reserve_(from, max_count, WELL_DO_XCH);
+	case WELL_DO_MTX:	return reserve_(from, max_count, WELL_DO_MTX);
+	case WELL_DO_TKT:	return reserve_(from, max_count, WELL_DO_TKT);
+	default:		return reserve_(from, max_count, WELL_DO_SPL);
+	}
+}
 
-#if (WELL_TECHNIQUE == WELL_DO_CAS)
-	ret.cnt = __atomic_load_n(&from->avail, __ATOMIC_RELAXED);
-	do {
-		/* fail early and cheaply */
-		if (!ret.cnt)
+
+
+/*	reserve_exact_do_()
+*/
+NLC_INLINE struct well_res reserve_exact_do_(struct well_sym *from, size_t count,
+						const uint8_t tech)
+{
+	struct well_res ret = { 0 };
+
+	if (tech == WELL_DO_CAS) {
+		ret.cnt = __atomic_load_n(&from->avail, __ATOMIC_RELAXED);
+		for (;;) {
+			if (ret.cnt < count || !count) {
+				ret.cnt = 0;
+				return ret;
+			}
+			if (__atomic_compare_exchange_n(&from->avail, &ret.cnt, ret.cnt - count,
+							1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				break;
+			STAT_ADD_(from, retries, 1);
+		}
+		ret.pos = __atomic_fetch_add(&from->pos, count, __ATOMIC_RELAXED);
+		ret.cnt = count;
+		return ret;
+
+
+	} else if (tech == WELL_DO_XCH) {
+		ret.cnt = __atomic_exchange_n(&from->avail, 0, __ATOMIC_ACQUIRE);
+		if (ret.cnt < count || !count) {
+			/* put back whatever we took */
+			if (ret.cnt) {
+				__atomic_fetch_add(&from->avail, ret.cnt, __ATOMIC_SEQ_CST);
+				wake_(from, ret.cnt);
+			}
+			ret.cnt = 0;
 			return ret;
-		/* prevent CAS'ing a negative integer into 'avail' */
-		if (ret.cnt < max_count)
-			max_count = ret.cnt;
-	} while (!(__atomic_compare_exchange_n(&from->avail, &ret.cnt, ret.cnt - max_count,
-						1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)));
-	ret.pos = __atomic_fetch_add(&from->pos, max_count, __ATOMIC_RELAXED);
-	/* penalty for failing cheaply: succeed expensively */
-	ret.cnt = max_count;
-	return ret;
+		}
+
+		if (ret.cnt > count) {
+			__atomic_fetch_add(&from->avail, ret.cnt-count, __ATOMIC_SEQ_CST);
+			wake_(from, ret.cnt-count);
+			ret.cnt = count;
+		}
+		ret.pos = __atomic_fetch_add(&from->pos, ret.cnt, __ATOMIC_RELAXED);
+		return ret;
 
 
-#elif (WELL_TECHNIQUE == WELL_DO_XCH)
-	ret.cnt = __atomic_exchange_n(&from->avail, 0, __ATOMIC_ACQUIRE);
-	if (!ret.cnt)
+	} else if (tech == WELL_DO_TKT) {
+		if (!count || __atomic_load_n(&from->avail, __ATOMIC_RELAXED) < count
+				|| turn_take_(from))
+			return ret;
+		if (__atomic_load_n(&from->avail, __ATOMIC_ACQUIRE) >= count) {
+			__atomic_fetch_sub(&from->avail, count, __ATOMIC_RELAXED);
+			ret.pos = __atomic_load_n(&from->pos, __ATOMIC_RELAXED);
+			__atomic_store_n(&from->pos, ret.pos + count, __ATOMIC_RELAXED);
+			ret.cnt = count;
+		}
+		turn_done_(from);
 		return ret;
 
-	if (ret.cnt > max_count) {
-		__atomic_fetch_add(&from->avail, ret.cnt-max_count, __ATOMIC_RELAXED);
-		ret.cnt = max_count;
+
+	} else { /* WELL_DO_MTX || WELL_DO_SPL */
+		ret.cnt = 0;
+		if (!count) {
+			return ret;
+		} else if (trylock_(from, tech)) {
+			STAT_ADD_(from, retries, 1);
+		} else {
+			if (from->avail >= count) {
+				from->avail -= count;
+				ret.pos = from->pos;
+				from->pos += count;
+				ret.cnt = count;
+			}
+			unlock_(from, tech);
+		}
+		return ret;
 	}
-	ret.pos = __atomic_fetch_add(&from->pos, ret.cnt, __ATOMIC_RELAXED);
+}
+
+/*	reserve_exact_()
+*/
+NLC_INLINE struct well_res reserve_exact_(struct well_sym *from, size_t count,
+						const uint8_t tech)
+{
+	struct well_res ret = reserve_exact_do_(from, count, tech);
+	stat_res_(from, count, ret);
 	return ret;
+}
 
+/*	well_reserve_exact()
+Reserve exactly 'count' buffer blocks, or none at all;
+	single OR multiple producers/consumers.
 
-#elif (WELL_TECHNIQUE == WELL_DO_MTX || WELL_TECHNIQUE == WELL_DO_SPL)
-	ret.cnt = 0;
-	if (!TRYLOCK_(&from->lock)) {
-		if (from->avail) {
-			if (from->avail < max_count) {
-				max_count = from->avail;
-				from->avail = 0;
-			} else {
-				from->avail -= max_count;
-			}
-			ret.pos = from->pos;
-			from->pos += max_count;
-			ret.cnt = max_count;
+Returns a 'struct well_res' exactly like well_reserve(),
+	but 'cnt' is always either 'count' or 0.
+*/
+struct well_res	well_reserve_exact(	struct well_sym	*from,
+					size_t		count)
+{
+	switch (from->technique) {
+	case WELL_DO_CAS:	return reserve_exact_(from, count, WELL_DO_CAS);
+	case WELL_DO_XCH:	return reserve_exact_(from, count, WELL_DO_XCH);
+	case WELL_DO_MTX:	return reserve_exact_(from, count, WELL_DO_MTX);
+	case WELL_DO_TKT:	return reserve_exact_(from, count, WELL_DO_TKT);
+	default:		return reserve_exact_(from, count, WELL_DO_SPL);
+	}
+}
+
+
+/*	well_reserve_timed()
+Reserve up to 'max_count' buffer blocks, parking the calling thread
+	on a futex if none are available.
+Parked threads are woken by any release into 'from'.
+
+'timeout' is relative; NULL means wait forever.
+
+Returns a 'struct well_res' exactly like well_reserve();
+	'cnt == 0' only if 'timeout' elapsed (or 'max_count' is 0).
+
+NOTE: waiting relies on the low 32 bits of 'avail' being 0 only when
+	there are no blocks available: a well used with this function
+	must have less than 2^32 blocks.
+*/
+struct well_res	well_reserve_timed(	struct well_sym		*from,
+					size_t			max_count,
+					const struct timespec	*timeout)
+{
+	struct well_res ret;
+	struct timespec deadline;
+	if (timeout) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
 		}
-		UNLOCK_(&from->lock);
 	}
-	return ret;
 
+	while (!(ret = well_reserve(from, max_count)).cnt && max_count) {
+		int err = 0;
+		/* register as a waiter BEFORE the final check of 'avail':
+			releasers check 'waiters' AFTER publishing to 'avail'.
+		*/
+		__atomic_add_fetch(&from->waiters, 1, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&from->avail, __ATOMIC_SEQ_CST))
+			err = futex_wait_(from, timeout ? &deadline : NULL);
+		__atomic_sub_fetch(&from->waiters, 1, __ATOMIC_RELAXED);
 
-#else
-#error "well technique not implemented"
-#endif
+		/* one last try on timeout */
+		if (err == ETIMEDOUT)
+			return well_reserve(from, max_count);
+	}
+	return ret;
+}
+
+/*	well_reserve_wait()
+Reserve up to 'max_count' buffer blocks, waiting for as long as it takes.
+See well_reserve_timed().
+*/
+struct well_res	well_reserve_wait(	struct well_sym	*from,
+					size_t		max_count)
+{
+	return well_reserve_timed(from, max_count, NULL);
 }
 
 
 
+/*	release_single_()
+*/
+NLC_INLINE void release_single_(struct well_sym *to, size_t count, const uint8_t tech)
+{
+	/* WELL_DO_TKT only queues reservations */
+	if (tech == WELL_DO_CAS || tech == WELL_DO_XCH || tech == WELL_DO_TKT) {
+		STAT_MAX_(to, __atomic_add_fetch(&to->avail, count, __ATOMIC_SEQ_CST));
+
+	} else { /* WELL_DO_MTX || WELL_DO_SPL */
+		size_t now;
+		lock_(to, tech);
+			now = to->avail += count;
+		unlock_(to, tech);
+		STAT_MAX_(to, now);
+		/* order 'avail' store before 'waiters' load in wake_() */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+	wake_(to, count);
+}
+
 /*	well_release_single()
 Release 'count' buffer blocks.
 
@@ -212,22 +828,59 @@ NOTE RE LOCKING: this function will always succeed;
 void well_release_single(struct well_sym	*to,
 				size_t		count)
 {
-#if (WELL_TECHNIQUE == WELL_DO_CAS || WELL_TECHNIQUE == WELL_DO_XCH)
-	__atomic_add_fetch(&to->avail, count, __ATOMIC_RELEASE);
+	switch (to->technique) {
+	case WELL_DO_CAS:	release_single_(to, count, WELL_DO_CAS); return;
+	case WELL_DO_XCH:	release_single_(to, count, WELL_DO_XCH); return;
+	case WELL_DO_MTX:	release_single_(to, count, WELL_DO_MTX); return;
+	case WELL_DO_TKT:	release_single_(to, count, WELL_DO_TKT); return;
+	default:		release_single_(to, count, WELL_DO_SPL); return;
+	}
+}
 
 
-#elif (WELL_TECHNIQUE == WELL_DO_MTX || WELL_TECHNIQUE == WELL_DO_SPL)
-	LOCK_(&to->lock);
-		to->avail += count;
-	UNLOCK_(&to->lock);
 
+/*	release_multi_()
+*/
+NLC_INLINE size_t release_multi_(struct well_sym *to, struct well_res res,
+					const uint8_t tech)
+{
+	/* WELL_DO_TKT only queues reservations */
+	if (tech == WELL_DO_CAS || tech == WELL_DO_XCH || tech == WELL_DO_TKT) {
+		if (!__atomic_compare_exchange_n(&to->release_pos, &res.pos, res.pos + res.cnt,
+						0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			if (res.cnt)
+				STAT_ADD_(to, release_fails, 1);
+			return 0;
+		}
 
-#else
-#error "well technique not implemented"
-#endif
-}
+		STAT_MAX_(to, __atomic_add_fetch(&to->avail, res.cnt, __ATOMIC_SEQ_CST));
+		wake_(to, res.cnt);
+		return res.cnt;
 
 
+	} else { /* WELL_DO_MTX || WELL_DO_SPL */
+		size_t ret = 0;
+		size_t now = 0;
+		if (!trylock_(to, tech)) {
+			if (to->release_pos == res.pos) {
+				now = to->avail += res.cnt;
+				to->release_pos += res.cnt;
+				ret = res.cnt;
+			}
+			unlock_(to, tech);
+		} else {
+			STAT_ADD_(to, retries, 1);
+		}
+		if (ret) {
+			STAT_MAX_(to, now);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			wake_(to, ret);
+		} else if (res.cnt) {
+			STAT_ADD_(to, release_fails, 1);
+		}
+		return ret;
+	}
+}
 
 /*	well_release_multi()
 Release a reservation made under contention (multiple threads on RX or TX side).
@@ -243,29 +896,421 @@ returns 0 on failure, original value of 'count' on success.
 size_t	well_release_multi(struct well_sym	*to,
 			struct well_res		res)
 {
-#if (WELL_TECHNIQUE == WELL_DO_CAS || WELL_TECHNIQUE == WELL_DO_XCH)
-	if (!__atomic_compare_exchange_n(&to->release_pos, &res.pos, res.pos + res.cnt,
+	switch (to->technique) {
+	case WELL_DO_CAS:	return release_multi_(to, res, WELL_DO_CAS);
+	case WELL_DO_XCH:	return release_multi_(to, res, WELL_DO_XCH);
+	case WELL_DO_MTX:	return release_multi_(to, res, WELL_DO_MTX);
+	case WELL_DO_TKT:	return release_multi_(to, res, WELL_DO_TKT);
+	default:		return release_multi_(to, res, WELL_DO_SPL);
+	}
+}
+
+
+
+/*
+	out-of-order release: completion bitmap
+
+Every block has one bit in 'done'.
+Rather than clearing bits once released (which would race with
+	the next trip around the buffer), the meaning of a bit flips every lap:
+	a block is "done" when its bit is 1 on even laps and 0 on odd laps.
+Each block is toggled exactly once per lap.
+*/
+
+/*	mark_()
+Toggle the completion bits for 'cnt' blocks starting at 'pos'.
+*/
+static void mark_(struct well_sym *sym, size_t pos, size_t cnt)
+{
+	const size_t mask = sym->lap -1;
+	while (cnt) {
+		size_t idx = pos & mask;
+		size_t bit = idx & 63;
+		size_t n = 64 - bit;
+		if (n > sym->lap - idx)
+			n = sym->lap - idx;
+		if (n > cnt)
+			n = cnt;
+		uint64_t m = (n == 64) ? ~0UL : ((1UL << n) -1) << bit;
+		__atomic_fetch_xor(&sym->done[idx >> 6], m, __ATOMIC_SEQ_CST);
+		pos += n;
+		cnt -= n;
+	}
+}
+
+/*	scan_()
+Returns the end of the run of completed blocks starting at 'pos'
+	(which is 'pos' itself if block 'pos' is not yet done).
+*/
+static size_t scan_(struct well_sym *sym, size_t pos)
+{
+	const size_t mask = sym->lap -1;
+	size_t p = pos;
+	while (p - pos < sym->lap) {
+		size_t idx = p & mask;
+		size_t bit = idx & 63;
+		size_t n = 64 - bit;
+		if (n > sym->lap - idx)
+			n = sym->lap - idx;
+		if (n > sym->lap - (p - pos))
+			n = sym->lap - (p - pos);
+
+		uint64_t w = __atomic_load_n(&sym->done[idx >> 6], __ATOMIC_SEQ_CST);
+		if (p & sym->lap)
+			w = ~w;
+		w >>= bit;
+		size_t run = ~w ? __builtin_ctzl(~w) : 64;
+		if (run < n)
+			return p + run;
+		p += n;
+	}
+	return p;
+}
+
+
+/*	release_ooo_()
+*/
+NLC_INLINE void release_ooo_(struct well_sym *to, struct well_res res, const uint8_t tech)
+{
+	if (!res.cnt)
+		return;
+	mark_(to, res.pos, res.cnt);
+
+	/* WELL_DO_TKT only queues reservations */
+	if (tech == WELL_DO_CAS || tech == WELL_DO_XCH || tech == WELL_DO_TKT) {
+		/* A failed CAS means 'release_pos' moved under us
+			(and 'rp' is updated): rescan from there.
+		Our own mark is visible to anyone who moved it after we marked;
+			whoever moved it before will fail their CAS
+			or have already published our blocks.
+		*/
+		size_t rp = __atomic_load_n(&to->release_pos, __ATOMIC_SEQ_CST);
+		size_t end;
+		while ((end = scan_(to, rp)) != rp) {
+			if (__atomic_compare_exchange_n(&to->release_pos, &rp, end,
+						0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+				STAT_MAX_(to, __atomic_add_fetch(&to->avail, end - rp,
+								__ATOMIC_SEQ_CST));
+				wake_(to, end - rp);
+				return;
+			}
+		}
+
+
+	} else { /* WELL_DO_MTX || WELL_DO_SPL */
+		/* must not trylock: a lock holder may have scanned before our mark */
+		size_t cnt, now;
+		lock_(to, tech);
+			size_t end = scan_(to, to->release_pos);
+			cnt = end - to->release_pos;
+			now = to->avail += cnt;
+			to->release_pos = end;
+		unlock_(to, tech);
+		if (cnt) {
+			STAT_MAX_(to, now);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			wake_(to, cnt);
+		}
+	}
+}
+
+/*	well_release_ooo()
+Release a reservation made under contention, regardless of whether
+	earlier reservations have been released:
+	marks 'res' as complete and returns immediately.
+Whichever thread completes the earliest outstanding reservation
+	publishes all contiguous completed blocks to 'to'
+	with a single add to 'avail'.
+
+Requires well_ooo_init() to have been called on the buffer.
+WARNINGS:
+	- nonsense values of 'res' can lock up the entire buffer.
+	- NEVER mix _release_ooo() with _release_single() or _release_multi()
+		on the same side of the buffer.
+*/
+void	well_release_ooo(struct well_sym	*to,
+			struct well_res		res)
+{
+	switch (to->technique) {
+	case WELL_DO_CAS:	release_ooo_(to, res, WELL_DO_CAS); return;
+	case WELL_DO_XCH:	release_ooo_(to, res, WELL_DO_XCH); return;
+	case WELL_DO_MTX:	release_ooo_(to, res, WELL_DO_MTX); return;
+	case WELL_DO_TKT:	release_ooo_(to, res, WELL_DO_TKT); return;
+	default:		release_ooo_(to, res, WELL_DO_SPL); return;
+	}
+}
+
+
+
+/*	unreserve_()
+*/
+NLC_INLINE size_t unreserve_(struct well_sym *from, struct well_res res, const uint8_t tech)
+{
+	size_t end = res.pos + res.cnt;
+
+	if (tech == WELL_DO_CAS || tech == WELL_DO_XCH) {
+		/* A reserver which already took from 'avail' but has yet to
+			move 'pos' is handed (some of) these blocks instead:
+			they are ready, and its count of them is already paid for.
+		*/
+		if (!__atomic_compare_exchange_n(&from->pos, &end, res.pos,
 					0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
-		return 0;
+			return 0;
+		__atomic_add_fetch(&from->avail, res.cnt, __ATOMIC_SEQ_CST);
+
+	} else if (tech == WELL_DO_TKT) {
+		if (turn_take_(from))
+			return 0;
+		int ours = __atomic_load_n(&from->pos, __ATOMIC_RELAXED) == end;
+		if (ours) {
+			__atomic_store_n(&from->pos, res.pos, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&from->avail, res.cnt, __ATOMIC_SEQ_CST);
+		}
+		turn_done_(from);
+		if (!ours)
+			return 0;
 
-	__atomic_add_fetch(&to->avail, res.cnt, __ATOMIC_RELEASE);
+	} else { /* WELL_DO_MTX || WELL_DO_SPL */
+		lock_(from, tech);
+			int ours = from->pos == end;
+			if (ours) {
+				from->pos = res.pos;
+				from->avail += res.cnt;
+			}
+		unlock_(from, tech);
+		if (!ours)
+			return 0;
+		/* order 'avail' store before 'waiters' load in wake_() */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+	wake_(from, res.cnt);
 	return res.cnt;
+}
+
+/*	well_unreserve()
+Give back 'res', or the unused tail of a reservation
+	(the last 'cnt' blocks of it, ending where it ended), to 'from'
+	as if it had never been reserved: the next reservation gets its blocks.
 
+Only possible while it is the most recent reservation made from 'from':
+	nobody else has reserved since.
+A single reserver (or a reserver which just got a reservation while the side
+	is quiet) usually succeeds; under contention this is likely to fail,
+	in which case the blocks must be released as usual
+	(with a value whoever gets them knows to ignore).
 
-#elif (WELL_TECHNIQUE == WELL_DO_MTX || WELL_TECHNIQUE == WELL_DO_SPL)
-	size_t ret = 0;
-	if (!TRYLOCK_(&to->lock)) {
-		if (to->release_pos == res.pos) {
-			to->avail += res.cnt;
-			to->release_pos += res.cnt;
-			ret = res.cnt;
+Returns 'res.cnt' if the blocks were given back, 0 if not.
+*/
+size_t well_unreserve(struct well_sym *from, struct well_res res)
+{
+	if (!res.cnt)
+		return 0;
+	switch (from->technique) {
+	case WELL_DO_CAS:	return unreserve_(from, res, WELL_DO_CAS);
+	case WELL_DO_XCH:	return unreserve_(from, res, WELL_DO_XCH);
+	case WELL_DO_MTX:	return unreserve_(from, res, WELL_DO_MTX);
+	case WELL_DO_TKT:	return unreserve_(from, res, WELL_DO_TKT);
+	default:		return unreserve_(from, res, WELL_DO_SPL);
+	}
+}
+
+
+
+/*
+	online resize: withhold every block, then swap the buffer
+*/
+
+/*	withhold_()
+Take whatever is available on 'sym' without reserving it:
+	'pos' does not move, so nothing is owed back to 'release_pos'.
+Synchronizes with reservers exactly as the technique of 'sym' requires.
+*/
+static size_t withhold_(struct well_sym *sym)
+{
+	size_t got;
+	switch (sym->technique) {
+	case WELL_DO_MTX:
+		lock_(sym, WELL_DO_MTX);
+			got = sym->avail;
+			sym->avail = 0;
+		unlock_(sym, WELL_DO_MTX);
+		return got;
+	case WELL_DO_SPL:
+		lock_(sym, WELL_DO_SPL);
+			got = sym->avail;
+			sym->avail = 0;
+		unlock_(sym, WELL_DO_SPL);
+		return got;
+	case WELL_DO_TKT:
+		/* the ticket holder reads 'avail' before subtracting from it */
+		if (turn_take_(sym))
+			return 0;
+		got = __atomic_exchange_n(&sym->avail, 0, __ATOMIC_ACQUIRE);
+		turn_done_(sym);
+		return got;
+	default:
+		return __atomic_exchange_n(&sym->avail, 0, __ATOMIC_ACQUIRE);
+	}
+}
+
+/*	copy_blocks_()
+Copy blocks [pos, pos+cnt) of 'buf' to the same positions in 'mem',
+	a buffer 'overflow +1' Bytes long: whole runs at a time.
+*/
+static void copy_blocks_(const struct well *buf, void *mem, size_t overflow,
+			size_t pos, size_t cnt)
+{
+	const uint8_t shift = buf->ct.blk_shift;
+	while (cnt) {
+		size_t src = (pos << shift) & buf->ct.overflow;
+		size_t dst = (pos << shift) & overflow;
+		size_t n = (buf->ct.overflow +1 - src) >> shift;
+		if (n > ((overflow +1 - dst) >> shift))
+			n = (overflow +1 - dst) >> shift;
+		if (n > cnt)
+			n = cnt;
+		memcpy((char *)mem + dst, (char *)buf->ct.buf + src, n << shift);
+		pos += n;
+		cnt -= n;
+	}
+}
+
+/*	well_resize()
+Move 'buf' to 'mem', 'blk_cnt' blocks long (a power of 2, bigger or smaller),
+	while producers and consumers keep running.
+'mem' must be at least 'blk_cnt * well_blk_size(buf)' Bytes;
+	the caller gets the old buffer with well_mem() beforehand,
+	and frees it once this function succeeds.
+
+New reservations fail (or wait, in well_reserve_wait()) from the moment
+	this function is called.
+Once every outstanding reservation has been released,
+	the blocks holding data are copied to 'mem' (in order, none are dropped)
+	and both sides are reopened with the new block count.
+The pause, from the first reservation refused to the last block published,
+	is written to 'pause_ns' (if not NULL):
+	waiting out outstanding reservations, plus one copy of the data.
+
+'timeout' (relative, NULL to wait forever) bounds the wait for outstanding
+	reservations: once it elapses, 'buf' is reopened as it was.
+
+Only one thread may resize a well at a time.
+Not for wells shared between processes, mirrored or allocated by
+	well_alloc_init(), wells with completion bitmaps (well_ooo_init()),
+	pointer queues, or wells with extra sides (well_sym_init()):
+	every block must belong either to 'tx' or to 'rx'.
+Nor for wells used with well_uring_init(): the ring keeps the old buffer
+	registered, and I/O into or out of the new one fails with EFAULT.
+Reservations parked in a well_sock (its 'held' blocks) or a well_cache
+	count as outstanding: flush or drain them first (from the threads
+	owning them), else this times out.
+
+returns 0 on success,
+	ETIMEDOUT if reservations were still outstanding after 'timeout',
+	ENOBUFS if more than 'blk_cnt' blocks hold data,
+	other non-zero on bad arguments;
+	'buf' is unchanged unless 0 is returned
+*/
+int well_resize(struct well *buf, void *mem, size_t blk_cnt,
+		const struct timespec *timeout, uint64_t *pause_ns)
+{
+	int err_cnt = 0;
+	NB_die_if(!buf || !mem, "");
+	NB_die_if(!blk_cnt || (blk_cnt & (blk_cnt -1)),
+		"blk_cnt %zu not a power of 2", blk_cnt);
+	NB_die_if(blk_cnt > (SIZE_MAX >> buf->ct.blk_shift),
+		"%zu blocks of %zu overflows", blk_cnt, buf->ct.blk_size);
+	NB_die_if(buf->ct.flags & (WELL_F_MIRROR | WELL_F_PSHARED | WELL_F_MAPPED),
+		"well memory is not the caller's to swap (flags 0x%x)", buf->ct.flags);
+	NB_die_if(buf->ct.flags & (WELL_F_PTR | WELL_F_SYMS),
+		"blocks may be outside 'tx' and 'rx' (flags 0x%x)", buf->ct.flags);
+	NB_die_if(buf->tx.done || buf->rx.done,
+		"completion bitmaps are sized for %zu blocks", well_blk_count(buf));
+
+	const size_t old_cnt = well_blk_count(buf);
+	size_t free_cnt = 0, full_cnt = 0;
+	struct timespec start, now, deadline;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (timeout) {
+		deadline.tv_sec = start.tv_sec + timeout->tv_sec;
+		deadline.tv_nsec = start.tv_nsec + timeout->tv_nsec;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
 		}
-		UNLOCK_(&to->lock);
 	}
-	return ret;
 
+	/* quiescent once every block is withheld: none are reserved */
+	for (unsigned spins = 1; ; spins++) {
+		free_cnt += withhold_(&buf->tx);
+		full_cnt += withhold_(&buf->rx);
+		if (full_cnt > blk_cnt) {
+			err_cnt = ENOBUFS;
+			goto reopen;
+		}
+		if (free_cnt + full_cnt == old_cnt)
+			break;
 
-#else
-#error "well technique not implemented"
-#endif
+		if (spins & 0x3f) {
+			cpu_relax_();
+			continue;
+		}
+		sched_yield();
+		if (timeout) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec > deadline.tv_sec
+				|| (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec))
+			{
+				err_cnt = ETIMEDOUT;
+				goto reopen;
+			}
+		}
+	}
+
+	/* data is [rx.pos, tx.pos): same positions, new mask */
+	size_t overflow = (blk_cnt << buf->ct.blk_shift) -1;
+	copy_blocks_(buf, mem, overflow, buf->rx.pos, full_cnt);
+	buf->ct.buf = mem;
+	buf->ct.overflow = overflow;
+	free_cnt = blk_cnt - full_cnt;
+
+reopen:
+	/* publishes 'ct' to whoever reserves next */
+	if (full_cnt)
+		well_release_single(&buf->rx, full_cnt);
+	if (free_cnt)
+		well_release_single(&buf->tx, free_cnt);
+	if (pause_ns) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		*pause_ns = (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000
+			+ now.tv_nsec - start.tv_nsec;
+	}
+die:
+	return err_cnt;
 }
+
+
+
+/*	SPECIALIZE_()
+Public entry points for one technique, e.g. well_reserve_xch():
+	callers which know the technique of a well (because they chose it)
+	call these directly and skip even the dispatch branch.
+They must ONLY be used on wells initialized with that technique.
+*/
+#define SPECIALIZE_(sfx, tech) \
+struct well_res well_reserve_##sfx(struct well_sym *from, size_t max_count) \
+	{ return reserve_(from, max_count, tech); } \
+struct well_res well_reserve_exact_##sfx(struct well_sym *from, size_t count) \
+	{ return reserve_exact_(from, count, tech); } \
+void well_release_single_##sfx(struct well_sym *to, size_t count) \
+	{ release_single_(to, count, tech); } \
+size_t well_release_multi_##sfx(struct well_sym *to, struct well_res res) \
+	{ return release_multi_(to, res, tech); } \
+void well_release_ooo_##sfx(struct well_sym *to, struct well_res res) \
+	{ release_ooo_(to, res, tech); }
+
+SPECIALIZE_(cas, WELL_DO_CAS)
+SPECIALIZE_(xch, WELL_DO_XCH)
+SPECIALIZE_(mtx, WELL_DO_MTX)
+SPECIALIZE_(spl, WELL_DO_SPL)
+SPECIALIZE_(tkt, WELL_DO_TKT)
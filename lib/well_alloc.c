@@ -0,0 +1,165 @@
+/*	well_alloc.c
+
+Allocate the memory of a well with mmap(), optionally:
+	- backed by huge pages (hugetlbfs or transparent),
+	- bound to a NUMA node,
+	- pre-faulted, so the first pass over the buffer takes no page faults.
+*/
+#define _GNU_SOURCE /* MAP_HUGETLB */
+#include <ndebug.h>
+#include <well.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+	#include <linux/mempolicy.h>
+	#include <sys/syscall.h>
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+	#define MAP_HUGE_SHIFT	26
+#endif
+#ifndef MAP_HUGE_2MB
+	#define MAP_HUGE_2MB	(21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+	#define MAP_HUGE_1GB	(30 << MAP_HUGE_SHIFT)
+#endif
+
+#define ALIGN_2M_	((size_t)1 << 21)
+#define ALIGN_1G_	((size_t)1 << 30)
+
+
+/*	map_len_()
+Length actually mapped for 'buf': rounded up to a (huge) page.
+*/
+static size_t map_len_(const struct well *buf)
+{
+	size_t align = (buf->ct.flags & WELL_F_HUGE_1G) ? ALIGN_1G_ : ALIGN_2M_;
+	return (well_size(buf) + align -1) & ~(align -1);
+}
+
+
+/*	map_aligned_()
+Anonymous mapping of 'len' bytes aligned to 'align':
+	over-map, then trim head and tail.
+*/
+static void *map_aligned_(size_t len, size_t align)
+{
+	char *mem = mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return mem;
+
+	char *aligned = (char *)(((uintptr_t)mem + align -1) & ~(uintptr_t)(align -1));
+	if (aligned > mem)
+		munmap(mem, aligned - mem);
+	munmap(aligned + len, (mem + len + align) - (aligned + len));
+	return aligned;
+}
+
+
+/*	bind_()
+Bind 'len' bytes at 'mem' to NUMA node 'node'.
+*/
+static int bind_(void *mem, size_t len, int node)
+{
+	int err_cnt = 0;
+#ifdef __linux__
+	unsigned long mask[16] = { 0 };
+	const size_t bits = sizeof(mask) * 8;
+	NB_die_if(node < 0 || (size_t)node >= bits, "NUMA node %d out of range", node);
+	mask[node / (sizeof(long) * 8)] = 1UL << (node % (sizeof(long) * 8));
+	NB_die_if(syscall(SYS_mbind, mem, len, MPOL_BIND, mask, bits + 1,
+			MPOL_MF_STRICT | MPOL_MF_MOVE),
+		"mbind() to NUMA node %d", node);
+#else
+	NB_die("NUMA binding not supported on this platform");
+#endif
+die:
+	return err_cnt;
+}
+
+
+/*	well_alloc_init()
+Map memory for a well and initialize it.
+'flags' is any of WELL_ALLOC_*: at most one of the HUGE_ flags and THP.
+If 'numa_node' is not negative, memory is bound to that node
+	(before being pre-faulted, so pages land there).
+
+This function expects 'buf' to have had well_params() successfully called on it.
+Mapped length is rounded up to 2MiB (1GiB with WELL_ALLOC_HUGE_1G);
+	hugetlbfs pages must have been reserved by the administrator,
+	else this fails rather than silently falling back to small pages.
+Use well_alloc_deinit() instead of well_deinit() when done.
+
+returns 0 on success
+*/
+int well_alloc_init(struct well *buf, unsigned flags, int numa_node)
+{
+	int err_cnt = 0;
+	void *mem = MAP_FAILED;
+	NB_die_if(!buf, "");
+	unsigned huge = flags & (WELL_ALLOC_HUGE_2M | WELL_ALLOC_HUGE_1G | WELL_ALLOC_THP);
+	NB_die_if(huge & (huge -1), "more than one huge page kind requested: 0x%x", flags);
+
+	buf->ct.flags &= ~(WELL_F_MAPPED | WELL_F_HUGE_1G);
+	if (flags & WELL_ALLOC_HUGE_1G)
+		buf->ct.flags |= WELL_F_HUGE_1G;
+	size_t len = map_len_(buf);
+
+	if (flags & (WELL_ALLOC_HUGE_2M | WELL_ALLOC_HUGE_1G)) {
+#ifdef MAP_HUGETLB
+		int page = (flags & WELL_ALLOC_HUGE_1G) ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+		NB_die_if((
+			mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page, -1, 0)
+			) == MAP_FAILED, "no %s huge pages for %zu bytes",
+			(flags & WELL_ALLOC_HUGE_1G) ? "1GiB" : "2MiB", len);
+#else
+		NB_die("huge pages not supported on this platform");
+#endif
+	} else {
+		/* 2MiB-aligned so THP can back all of it */
+		NB_die_if((
+			mem = map_aligned_(len, ALIGN_2M_)
+			) == MAP_FAILED, "size %zu", len);
+#ifdef MADV_HUGEPAGE
+		if (flags & WELL_ALLOC_THP)
+			NB_die_if(madvise(mem, len, MADV_HUGEPAGE), "MADV_HUGEPAGE");
+#else
+		NB_die_if(flags & WELL_ALLOC_THP, "THP not supported on this platform");
+#endif
+	}
+
+	if (numa_node >= 0)
+		NB_die_if(bind_(mem, len, numa_node), "");
+
+	if (flags & WELL_ALLOC_PREFAULT) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		for (size_t i=0; i < len; i += page)
+			((volatile char *)mem)[i] = 0;
+	}
+
+	NB_die_if(well_init(buf, mem), "");
+	buf->ct.flags |= WELL_F_MAPPED;
+
+die:
+	if (err_cnt && mem != MAP_FAILED)
+		munmap(mem, len);
+	return err_cnt;
+}
+
+
+/*	well_alloc_deinit()
+Deinitialize a well set up with well_alloc_init() and unmap its memory.
+*/
+void well_alloc_deinit(struct well *buf)
+{
+	well_deinit(buf);
+	if (!(buf->ct.flags & WELL_F_MAPPED))
+		return;
+	munmap(buf->ct.buf, map_len_(buf));
+	buf->ct.buf = NULL;
+	buf->ct.flags &= ~(WELL_F_MAPPED | WELL_F_HUGE_1G);
+}
@@ -0,0 +1,130 @@
+/*	well_backoff.c
+
+Adaptive backoff: see well_backoff.h
+*/
+#include <ndebug.h>
+#include <well_backoff.h>
+#include "well_relax.h"
+
+#include <sched.h>
+#include <time.h>
+
+
+const struct well_backoff_policy well_backoff_default = {
+	.spin_min = 16,
+	.spin_max = 1 << 10,
+	.yield_max = 16,
+	.park_ns = 100000
+};
+
+
+
+/*	well_backoff_init()
+Set up per-thread backoff state 'bo' following 'pol'
+	(or well_backoff_default if NULL), which must outlive 'bo'.
+Budgets start halfway between the bounds.
+*/
+void well_backoff_init(struct well_backoff *bo, const struct well_backoff_policy *pol)
+{
+	if (!pol)
+		pol = &well_backoff_default;
+	*bo = (struct well_backoff){
+		.pol = pol,
+		.spin_limit = pol->spin_min + (pol->spin_max - pol->spin_min) / 2,
+		.yield_limit = pol->yield_max / 2,
+		.burst = 1
+	};
+}
+
+
+/*	well_backoff_once()
+Back off once after a failure; the wait gets longer with every call
+	until well_backoff_done().
+
+returns the phase (WELL_BACKOFF_*) this call was in
+*/
+int well_backoff_once(struct well_backoff *bo)
+{
+	if (bo->spun < bo->spin_limit) {
+		for (uint32_t i=0; i < bo->burst; i++)
+			cpu_relax_();
+		bo->spun += bo->burst;
+		if (bo->spun < bo->spin_limit && bo->burst < bo->spin_limit - bo->spun)
+			bo->burst <<= 1;
+		return WELL_BACKOFF_SPIN;
+	}
+
+	if (bo->yielded < bo->yield_limit) {
+		bo->yielded++;
+		sched_yield();
+		return WELL_BACKOFF_YIELD;
+	}
+
+	/* park: successive parks double in length, up to 'park_ns' */
+	uint64_t ns = (uint64_t)bo->pol->park_ns >> (bo->parked < 6 ? 6 - bo->parked : 0);
+	struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+	bo->parked++;
+	nanosleep(&ts, NULL);
+	return WELL_BACKOFF_PARK;
+}
+
+
+/*	well_backoff_done()
+The wait succeeded: adapt budgets to the phase it succeeded in,
+	and reset for the next wait.
+*/
+void well_backoff_done(struct well_backoff *bo)
+{
+	const struct well_backoff_policy *pol = bo->pol;
+
+	if (bo->parked || bo->yielded) {
+		/* spinning was wasted */
+		bo->spin_limit -= (bo->spin_limit - pol->spin_min + 1) / 2;
+	}
+	if (bo->parked) {
+		/* yielding longer might have avoided the (expensive) park */
+		if (bo->yield_limit < pol->yield_max)
+			bo->yield_limit++;
+	} else if (bo->yielded) {
+		/* move towards twice what was needed */
+		uint32_t want = bo->yielded * 2;
+		bo->yield_limit = (bo->yield_limit + (want < pol->yield_max ? want : pol->yield_max)) / 2;
+	} else if (bo->spun) {
+		/* spinning pays: allow a little more of it */
+		uint32_t grow = bo->spin_limit / 8 + 1;
+		bo->spin_limit = pol->spin_max - bo->spin_limit > grow
+			? bo->spin_limit + grow : pol->spin_max;
+	}
+
+	bo->spun = bo->yielded = bo->parked = 0;
+	bo->burst = 1;
+}
+
+
+/*	well_reserve_backoff()
+Reserve up to 'max_count' blocks, backing off per 'bo' until successful;
+	parking happens on the futex of 'from' (see well_reserve_timed()),
+	so a release into 'from' ends it early.
+
+Returns 'cnt == 0' only if 'max_count' is 0.
+*/
+struct well_res well_reserve_backoff(struct well_sym *from, size_t max_count,
+					struct well_backoff *bo)
+{
+	struct well_res res;
+	while (!(res = well_reserve(from, max_count)).cnt && max_count) {
+		if (bo->spun < bo->spin_limit || bo->yielded < bo->yield_limit) {
+			well_backoff_once(bo);
+			continue;
+		}
+		const struct timespec park = {
+			.tv_sec = bo->pol->park_ns / 1000000000,
+			.tv_nsec = bo->pol->park_ns % 1000000000
+		};
+		bo->parked++;
+		if ((res = well_reserve_timed(from, max_count, &park)).cnt)
+			break;
+	}
+	well_backoff_done(bo);
+	return res;
+}
@@ -0,0 +1,188 @@
+/*	well_bcast.c
+
+Broadcast fan-out: see well_bcast.h
+
+'head' is where the producer has published up to,
+	'tail' is where blocks have been handed back to 'buf.tx':
+	it only moves to the smallest 'released' of all attached consumers.
+*/
+#include <ndebug.h>
+#include <well_bcast.h>
+
+#include <stdlib.h>
+
+
+/*	well_bcast_init()
+Set up a broadcast well for 'consumer_cnt' consumers (numbered from 0),
+	of 'blk_cnt' blocks of 'blk_size' bytes; see well_params().
+'max_stall' is 0 or the number of consecutive failed well_bcast_reserve()
+	calls, with no progress from the slowest consumer, after which
+	the producer detaches it rather than keep waiting.
+
+returns 0 on success
+*/
+int well_bcast_init(struct well_bcast *bc, size_t consumer_cnt,
+			size_t blk_size, size_t blk_cnt, size_t max_stall)
+{
+	int err_cnt = 0;
+	NB_die_if(!bc, "");
+	*bc = (struct well_bcast){ .cnt = consumer_cnt, .max_stall = max_stall };
+	NB_die_if(!consumer_cnt, "broadcast needs at least one consumer");
+
+	NB_die_if(posix_memalign((void **)&bc->cur, NLC_CACHE_LINE,
+			sizeof(*bc->cur) * consumer_cnt), "");
+	for (size_t i=0; i < consumer_cnt; i++)
+		bc->cur[i] = (struct well_bcast_cur){ .state = WELL_BCAST_ATTACHED };
+
+	NB_die_if(well_params(blk_size, blk_cnt, &bc->buf), "");
+	NB_die_if(
+		well_init(&bc->buf, malloc(well_size(&bc->buf)))
+		, "size %zu", well_size(&bc->buf));
+
+	return 0;
+die:
+	if (bc) {
+		free(bc->cur);
+		bc->cur = NULL;
+		bc->cnt = 0;
+	}
+	return err_cnt;
+}
+
+
+/*	well_bcast_deinit()
+*/
+void well_bcast_deinit(struct well_bcast *bc)
+{
+	if (!bc || !bc->cnt)
+		return;
+	well_deinit(&bc->buf);
+	free(well_mem(&bc->buf));
+	free(bc->cur);
+	*bc = (struct well_bcast){ .cnt = 0 };
+}
+
+
+/*	advance_()
+Move 'tail' up to the slowest attached consumer,
+	handing freed blocks back to the producer.
+Called by any consumer (and the producer): 'tail' is CAS'ed so every
+	block is only handed back once.
+*/
+static void advance_(struct well_bcast *bc)
+{
+	size_t tail = __atomic_load_n(&bc->tail, __ATOMIC_ACQUIRE);
+	while (1) {
+		size_t min = __atomic_load_n(&bc->head, __ATOMIC_ACQUIRE);
+		for (size_t i=0; i < bc->cnt; i++) {
+			if (__atomic_load_n(&bc->cur[i].state, __ATOMIC_SEQ_CST) != WELL_BCAST_ATTACHED)
+				continue;
+			size_t rel = __atomic_load_n(&bc->cur[i].released, __ATOMIC_SEQ_CST);
+			if (rel < min)
+				min = rel;
+		}
+		if (min <= tail)
+			return;
+		if (__atomic_compare_exchange_n(&bc->tail, &tail, min,
+						0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			well_release_single(&bc->buf.tx, min - tail);
+			return;
+		}
+		/* lost the race: 'tail' has been reloaded, check again */
+	}
+}
+
+
+/*	well_bcast_reserve()
+Producer: reserve up to 'max_count' free blocks.
+If 'max_stall' is set and this is the 'max_stall'th failure in a row
+	without 'tail' moving, first detach the consumer(s) holding 'tail'
+	(their state becomes WELL_BCAST_LAGGED).
+
+'cnt == 0' if none are free.
+*/
+struct well_res well_bcast_reserve(struct well_bcast *bc, size_t max_count)
+{
+	struct well_res res = well_reserve(&bc->buf.tx, max_count);
+	if (res.cnt)
+		return res;
+
+	/* consumers only advance 'tail' while attached: catch up after detaches */
+	advance_(bc);
+	if ((res = well_reserve(&bc->buf.tx, max_count)).cnt || !bc->max_stall)
+		return res;
+
+	size_t tail = __atomic_load_n(&bc->tail, __ATOMIC_ACQUIRE);
+	if (tail != bc->stall_tail) {
+		bc->stall_tail = tail;
+		bc->stall_cnt = 0;
+	}
+	if (++bc->stall_cnt < bc->max_stall)
+		return res;
+
+	bc->stall_cnt = 0;
+	for (size_t i=0; i < bc->cnt; i++) {
+		uint32_t state = WELL_BCAST_ATTACHED;
+		if (__atomic_load_n(&bc->cur[i].released, __ATOMIC_ACQUIRE) == tail)
+			__atomic_compare_exchange_n(&bc->cur[i].state, &state,
+					WELL_BCAST_LAGGED, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	}
+	advance_(bc);
+	return well_reserve(&bc->buf.tx, max_count);
+}
+
+
+/*	well_bcast_publish()
+Producer: make blocks reserved with well_bcast_reserve() visible to all
+	consumers; in order of reservation.
+*/
+void well_bcast_publish(struct well_bcast *bc, struct well_res res)
+{
+	__atomic_store_n(&bc->head, res.pos + res.cnt, __ATOMIC_RELEASE);
+}
+
+
+/*	well_bcast_read()
+Consumer 'consumer': get up to 'max_count' blocks it has not yet seen.
+Each consumer must be used by a single thread.
+
+'cnt == 0' if there is nothing new, or 'consumer' was detached.
+*/
+struct well_res well_bcast_read(struct well_bcast *bc, size_t consumer, size_t max_count)
+{
+	struct well_bcast_cur *cur = &bc->cur[consumer];
+	struct well_res res = { .cnt = 0, .pos = cur->pos };
+	if (!well_bcast_attached(bc, consumer))
+		return res;
+
+	size_t avail = __atomic_load_n(&bc->head, __ATOMIC_ACQUIRE) - cur->pos;
+	res.cnt = avail < max_count ? avail : max_count;
+	cur->pos += res.cnt;
+	return res;
+}
+
+
+/*	well_bcast_done()
+Consumer 'consumer': done with blocks from well_bcast_read(),
+	in the order they were read.
+*/
+void well_bcast_done(struct well_bcast *bc, size_t consumer, struct well_res res)
+{
+	if (!res.cnt)
+		return;
+	__atomic_store_n(&bc->cur[consumer].released, res.pos + res.cnt, __ATOMIC_SEQ_CST);
+	if (well_bcast_attached(bc, consumer))
+		advance_(bc);
+}
+
+
+/*	well_bcast_detach()
+Stop waiting for 'consumer': the producer no longer waits for it.
+*/
+void well_bcast_detach(struct well_bcast *bc, size_t consumer)
+{
+	uint32_t state = WELL_BCAST_ATTACHED;
+	if (__atomic_compare_exchange_n(&bc->cur[consumer].state, &state,
+				WELL_BCAST_DETACHED, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		advance_(bc);
+}
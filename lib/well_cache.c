@@ -0,0 +1,79 @@
+/*	well_cache.c
+
+Per-thread reservation cache: see well_cache.h
+*/
+#include <ndebug.h>
+#include <well_cache.h>
+
+
+/*	well_cache_init()
+Set up 'c' to reserve from 'from' and release into 'to',
+	at most 'cap' blocks at a time.
+*/
+void well_cache_init(struct well_cache *c, struct well_sym *from, struct well_sym *to,
+			size_t cap, unsigned flags)
+{
+	*c = (struct well_cache){
+		.from = from,
+		.to = to,
+		.cap = cap ? cap : 1,
+		.flags = flags
+	};
+}
+
+
+/*	well_cache_refill()
+Slow path of well_cache_next(): the current chunk is used up.
+*/
+struct well_res well_cache_refill(struct well_cache *c)
+{
+	struct well_res ret = { 0 };
+	/* blocks handed out but not committed: can't let go of the chunk */
+	if (c->committed < c->res.cnt)
+		return ret;
+
+	c->res = well_reserve(c->from, c->cap);
+	c->handed = c->committed = c->released = 0;
+	if (c->res.cnt) {
+		ret.cnt = 1;
+		ret.pos = c->res.pos;
+		c->handed = 1;
+	}
+	return ret;
+}
+
+
+/*	well_cache_flush()
+Release all committed blocks not yet released,
+	and give the held (never handed out) blocks back to 'from'
+	if nobody has reserved from it since: see well_unreserve().
+
+returns number of blocks still held
+*/
+size_t well_cache_flush(struct well_cache *c)
+{
+	size_t cnt = c->committed - c->released;
+	if (cnt) {
+		if (c->flags & WELL_CACHE_OOO) {
+			well_release_ooo(c->to, (struct well_res){
+				.cnt = cnt,
+				.pos = c->res.pos + c->released
+			});
+		} else {
+			well_release_single(c->to, cnt);
+		}
+		c->released = c->committed;
+	}
+
+	size_t held = well_cache_held(c);
+	if (held && well_unreserve(c->from, (struct well_res){
+				.cnt = held,
+				.pos = c->res.pos + c->handed
+			}))
+	{
+		/* chunk now ends at the last block handed out */
+		c->res.cnt = c->handed;
+		held = 0;
+	}
+	return held;
+}
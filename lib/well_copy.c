@@ -0,0 +1,196 @@
+/*	well_copy.c
+
+Bulk copy-in/copy-out: reserve, copy whole runs of blocks
+	in (at most) two contiguous segments, release.
+*/
+#include <ndebug.h>
+#include <well.h>
+
+#include <string.h>
+#if defined(__x86_64__)
+	#include <immintrin.h>
+#endif
+
+
+/*	WELL_STREAM_MIN
+Copies into the well of at least this many bytes use non-temporal
+	(streaming) stores, when the CPU has them:
+	a copy this large would evict most of the producer's cache
+	for data only the consumer (likely on another core) is going to read.
+Smaller copies stay in cache, where the consumer can snoop them cheaply.
+*/
+#ifndef WELL_STREAM_MIN
+#define WELL_STREAM_MIN (256 * 1024)
+#endif
+
+
+#if defined(__x86_64__)
+/*	stream_avx512_()
+'dst' is 64B aligned, 'len' a multiple of 64.
+*/
+__attribute__((target("avx512f")))
+static void stream_avx512_(char *dst, const char *src, size_t len)
+{
+	for (size_t i=0; i < len; i += 64)
+		_mm512_stream_si512((void *)(dst + i),
+				_mm512_loadu_si512((const void *)(src + i)));
+}
+
+/*	stream_avx2_()
+'dst' is 64B aligned, 'len' a multiple of 64.
+*/
+__attribute__((target("avx2")))
+static void stream_avx2_(char *dst, const char *src, size_t len)
+{
+	for (size_t i=0; i < len; i += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+		_mm256_stream_si256((__m256i *)(dst + i), a);
+		_mm256_stream_si256((__m256i *)(dst + i + 32), b);
+	}
+}
+
+/* 0: unknown; 1: none; 2: AVX2; 3: AVX-512 */
+static int simd_ = 0;
+
+/*	simd_level_()
+Probe the CPU once; racing threads agree on the result.
+*/
+static int simd_level_()
+{
+	int lvl = __atomic_load_n(&simd_, __ATOMIC_RELAXED);
+	if (!lvl) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			lvl = 3;
+		else if (__builtin_cpu_supports("avx2"))
+			lvl = 2;
+		else
+			lvl = 1;
+		__atomic_store_n(&simd_, lvl, __ATOMIC_RELAXED);
+	}
+	return lvl;
+}
+#endif
+
+
+/*	stream_()
+Copy 'len' bytes using non-temporal stores where possible.
+
+returns non-zero if streaming stores were used
+	(and an sfence is required before publishing them)
+*/
+static int stream_(void *dst, const void *src, size_t len)
+{
+#if defined(__x86_64__)
+	int lvl = simd_level_();
+	if (lvl < 2 || len < 128) {
+		memcpy(dst, src, len);
+		return 0;
+	}
+
+	/* head: up to the first cache-line boundary */
+	size_t head = -(uintptr_t)dst & 63;
+	memcpy(dst, src, head);
+	char *d = (char *)dst + head;
+	const char *s = (const char *)src + head;
+	size_t body = (len - head) & ~(size_t)63;
+
+	if (lvl == 3)
+		stream_avx512_(d, s, body);
+	else
+		stream_avx2_(d, s, body);
+
+	/* tail */
+	memcpy(d + body, s + body, len - head - body);
+	return 1;
+#else
+	memcpy(dst, src, len);
+	return 0;
+#endif
+}
+
+
+/*	copy_in_()
+Copy 'cnt' blocks from 'src' into the reservation at 'pos'.
+*/
+static void copy_in_(const struct well *buf, size_t pos, const void *src, size_t cnt)
+{
+	size_t len = cnt << buf->ct.blk_shift;
+	size_t offt = (pos << buf->ct.blk_shift) & buf->ct.overflow;
+	size_t first = well_size(buf) - offt;
+	if (well_contiguous(buf) || len <= first)
+		first = len;
+
+	int nt;
+	if (len >= WELL_STREAM_MIN) {
+		nt = stream_((char *)buf->ct.buf + offt, src, first);
+		nt |= stream_(buf->ct.buf, (const char *)src + first, len - first);
+	} else {
+		memcpy((char *)buf->ct.buf + offt, src, first);
+		memcpy(buf->ct.buf, (const char *)src + first, len - first);
+		nt = 0;
+	}
+
+#if defined(__x86_64__)
+	/* streaming stores are weakly ordered: drain them before releasing */
+	if (nt)
+		_mm_sfence();
+#else
+	(void)nt;
+#endif
+}
+
+/*	copy_out_()
+Copy 'cnt' blocks from the reservation at 'pos' into 'dst'.
+No streaming stores: whoever pops is about to read 'dst'.
+*/
+static void copy_out_(const struct well *buf, size_t pos, void *dst, size_t cnt)
+{
+	size_t len = cnt << buf->ct.blk_shift;
+	size_t offt = (pos << buf->ct.blk_shift) & buf->ct.overflow;
+	size_t first = well_size(buf) - offt;
+	if (well_contiguous(buf) || len <= first)
+		first = len;
+
+	memcpy(dst, (char *)buf->ct.buf + offt, first);
+	memcpy((char *)dst + first, buf->ct.buf, len - first);
+}
+
+
+/*	well_push()
+Copy up to 'cnt' blocks from 'src' (which is 'cnt * well_blk_size(buf)' bytes)
+	into 'buf' and release them to the consumer(s), all in one go.
+
+WARNING: ONLY call from a SINGLE producer (releases with well_release_single()).
+
+Returns number of blocks pushed, which may be 0 if 'buf' is full.
+*/
+size_t well_push(struct well *buf, const void *src, size_t cnt)
+{
+	struct well_res res = well_reserve(&buf->tx, cnt);
+	if (!res.cnt)
+		return 0;
+	copy_in_(buf, res.pos, src, res.cnt);
+	well_release_single(&buf->rx, res.cnt);
+	return res.cnt;
+}
+
+/*	well_pop()
+Copy up to 'cnt' blocks out of 'buf' into 'dst'
+	(which has room for 'cnt * well_blk_size(buf)' bytes),
+	and release them back to the producer(s).
+
+WARNING: ONLY call from a SINGLE consumer (releases with well_release_single()).
+
+Returns number of blocks popped, which may be 0 if 'buf' is empty.
+*/
+size_t well_pop(struct well *buf, void *dst, size_t cnt)
+{
+	struct well_res res = well_reserve(&buf->rx, cnt);
+	if (!res.cnt)
+		return 0;
+	copy_out_(buf, res.pos, dst, res.cnt);
+	well_release_single(&buf->tx, res.cnt);
+	return res.cnt;
+}
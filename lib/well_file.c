@@ -0,0 +1,255 @@
+/*	well_file.c
+
+Stream a file through a well: see well_file.h
+
+The well's memory is an address range reserved PROT_NONE;
+	well_file_pump() maps file windows over its blocks with MAP_FIXED.
+Positions in a well only ever increase, so a block's position is also
+	its index in the file.
+*/
+#include <ndebug.h>
+#include <well_file.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* how long workers sleep between checks for end-of-file once starved */
+#define EOF_POLL_NS_	1000000
+
+
+/*	open_()
+Common setup for reading and writing: 'wf->fd' and 'wf->file_sz' must be set.
+*/
+static int open_(struct well_file *wf, size_t blk_size, size_t blk_cnt)
+{
+	int err_cnt = 0;
+	void *mem = MAP_FAILED;
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	NB_die_if(well_params(blk_size, blk_cnt, &wf->buf), "");
+	NB_die_if(well_blk_size(&wf->buf) % page,
+		"block size %zu not a multiple of page size %zu",
+		well_blk_size(&wf->buf), page);
+
+	wf->blk_total = (wf->file_sz + well_blk_size(&wf->buf) -1) >> wf->buf.ct.blk_shift;
+	wf->eof = 0;
+
+	/* address space only: file windows get mapped over it */
+	NB_die_if((
+		mem = mmap(NULL, well_size(&wf->buf), PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+		) == MAP_FAILED, "size %zu", well_size(&wf->buf));
+	NB_die_if(well_init(&wf->buf, mem), "");
+	NB_die_if(!(
+		wf->ooo = malloc(well_ooo_size(&wf->buf))
+		), "");
+	NB_die_if(well_ooo_init(&wf->buf, wf->ooo), "");
+
+	posix_fadvise(wf->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return 0;
+
+die:
+	if (mem != MAP_FAILED) {
+		well_deinit(&wf->buf);
+		munmap(mem, well_size(&wf->buf));
+	}
+	wf->buf.ct.buf = NULL;
+	free(wf->ooo);
+	wf->ooo = NULL;
+	return err_cnt;
+}
+
+
+/*	well_file_open_read()
+Set up 'wf' to stream the file at 'path' in blocks of 'blk_size' bytes,
+	at most 'blk_cnt' of which are mapped at any time.
+'blk_size' (after rounding to a power of 2) must be a multiple of the page size.
+
+returns 0 on success
+*/
+int well_file_open_read(struct well_file *wf, const char *path,
+			size_t blk_size, size_t blk_cnt)
+{
+	int err_cnt = 0;
+	NB_die_if(!wf || !path, "");
+	*wf = (struct well_file){ .fd = -1, .prot = PROT_READ };
+
+	NB_die_if((
+		wf->fd = open(path, O_RDONLY | O_CLOEXEC)
+		) == -1, "open('%s')", path);
+	struct stat st;
+	NB_die_if(fstat(wf->fd, &st), "");
+	wf->file_sz = st.st_size;
+
+	NB_die_if(open_(wf, blk_size, blk_cnt), "");
+	return 0;
+
+die:
+	if (wf && wf->fd != -1) {
+		close(wf->fd);
+		wf->fd = -1;
+	}
+	return err_cnt;
+}
+
+
+/*	well_file_open_write()
+Create (or truncate) the file at 'path' with a size of 'file_sz' bytes,
+	and set up 'wf' so workers can fill it in blocks of 'blk_size' bytes.
+See well_file_open_read().
+
+returns 0 on success
+*/
+int well_file_open_write(struct well_file *wf, const char *path, size_t file_sz,
+			size_t blk_size, size_t blk_cnt)
+{
+	int err_cnt = 0;
+	NB_die_if(!wf || !path, "");
+	*wf = (struct well_file){ .fd = -1, .prot = PROT_READ | PROT_WRITE };
+
+	NB_die_if((
+		wf->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+		) == -1, "open('%s')", path);
+	NB_die_if(ftruncate(wf->fd, file_sz), "size %zu", file_sz);
+	wf->file_sz = file_sz;
+
+	NB_die_if(open_(wf, blk_size, blk_cnt), "");
+	return 0;
+
+die:
+	if (wf && wf->fd != -1) {
+		close(wf->fd);
+		wf->fd = -1;
+	}
+	return err_cnt;
+}
+
+
+/*	map_run_()
+Map 'cnt' blocks starting at block 'pos', which must not wrap
+	around the end of the well.
+The last block of the file is only mapped up to the page containing EOF:
+	touching whole pages past EOF would SIGBUS.
+*/
+static int map_run_(struct well_file *wf, size_t pos, size_t cnt)
+{
+	int err_cnt = 0;
+	void *addr = well_access(pos, 0, &wf->buf);
+	size_t offt = well_file_offt(wf, pos, 0);
+	size_t len = cnt << wf->buf.ct.blk_shift;
+
+	if (len > wf->file_sz - offt) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		len = (wf->file_sz - offt + page -1) & ~(page -1);
+	}
+
+	NB_die_if(mmap(addr, len, wf->prot, MAP_SHARED | MAP_FIXED, wf->fd, offt)
+		== MAP_FAILED, "offset %zu len %zu", offt, len);
+	if (!(wf->prot & PROT_WRITE)) {
+		madvise(addr, len, MADV_SEQUENTIAL);
+		madvise(addr, len, MADV_WILLNEED);
+	}
+
+die:
+	return err_cnt;
+}
+
+
+/*	well_file_pump()
+Map every window of the file in turn, handing blocks to workers as soon as
+	they are mapped and re-using blocks as soon as workers release them.
+Call from exactly one thread; returns once the last block has been mapped.
+
+returns 0 on success
+*/
+int well_file_pump(struct well_file *wf)
+{
+	int err_cnt = 0;
+	size_t mask = well_blk_count(&wf->buf) -1;
+
+	for (size_t next = 0; next < wf->blk_total; ) {
+		struct well_res res = well_reserve_wait(&wf->buf.tx, wf->blk_total - next);
+
+		/* split mappings where the reservation wraps around the well */
+		size_t first = well_blk_count(&wf->buf) - (res.pos & mask);
+		if (first > res.cnt)
+			first = res.cnt;
+		NB_die_if(map_run_(wf, res.pos, first), "");
+		if (res.cnt > first)
+			NB_die_if(map_run_(wf, res.pos + first, res.cnt - first), "");
+
+		well_release_single(&wf->buf.rx, res.cnt);
+		next += res.cnt;
+	}
+
+die:
+	/* on error, workers drain what was mapped and then see EOF */
+	__atomic_store_n(&wf->eof, 1, __ATOMIC_RELEASE);
+	return err_cnt;
+}
+
+
+/*	well_file_next()
+Reserve up to 'max_count' mapped blocks, waiting if none are available.
+May be called by any number of threads.
+
+Returns 'cnt == 0' only once the whole file has been handed out.
+*/
+struct well_res well_file_next(struct well_file *wf, size_t max_count)
+{
+	const struct timespec poll = { .tv_nsec = EOF_POLL_NS_ };
+	struct well_res res;
+
+	while (!(res = well_reserve_timed(&wf->buf.rx, max_count, &poll)).cnt) {
+		if (__atomic_load_n(&wf->eof, __ATOMIC_ACQUIRE))
+			return well_reserve(&wf->buf.rx, max_count);
+	}
+	return res;
+}
+
+
+/*	well_file_release()
+Give back blocks obtained from well_file_next(), in any order:
+	they are dropped from memory and become free for the pump.
+When writing, the data stays in the file (page cache) once released.
+*/
+void well_file_release(struct well_file *wf, struct well_res res)
+{
+	size_t mask = well_blk_count(&wf->buf) -1;
+	size_t first = well_blk_count(&wf->buf) - (res.pos & mask);
+	if (first > res.cnt)
+		first = res.cnt;
+
+	madvise(well_access(res.pos, 0, &wf->buf), first << wf->buf.ct.blk_shift,
+		MADV_DONTNEED);
+	if (res.cnt > first)
+		madvise(well_access(res.pos + first, 0, &wf->buf),
+			(res.cnt - first) << wf->buf.ct.blk_shift, MADV_DONTNEED);
+
+	well_release_ooo(&wf->buf.tx, res);
+}
+
+
+/*	well_file_close()
+Unmap everything and close the file.
+Call once the pump has returned and workers are done.
+*/
+void well_file_close(struct well_file *wf)
+{
+	if (!wf)
+		return;
+	if (well_mem(&wf->buf)) {
+		well_deinit(&wf->buf);
+		munmap(well_mem(&wf->buf), well_size(&wf->buf));
+		wf->buf.ct.buf = NULL;
+	}
+	free(wf->ooo);
+	wf->ooo = NULL;
+	if (wf->fd != -1)
+		close(wf->fd);
+	wf->fd = -1;
+}
@@ -0,0 +1,117 @@
+/*	well_group.c
+
+Sharded wells with work stealing: see well_group.h
+*/
+#include <ndebug.h>
+#include <well_group.h>
+
+#include <stdlib.h>
+
+
+/*	well_group_init()
+Set up 'shard_cnt' wells of 'blk_cnt' blocks of 'blk_size' bytes;
+	see well_params().
+'flags' is 0 or WELL_GROUP_NO_STEAL.
+Every shard contends using 'technique' (WELL_DO_*; see well_init_technique()).
+
+returns 0 on success
+*/
+int well_group_init(struct well_group *grp, size_t shard_cnt,
+			size_t blk_size, size_t blk_cnt, unsigned flags,
+			uint8_t technique)
+{
+	int err_cnt = 0;
+	size_t init_cnt = 0;
+	NB_die_if(!grp, "");
+	*grp = (struct well_group){ .cnt = shard_cnt, .flags = flags };
+	NB_die_if(!shard_cnt, "group needs at least one shard");
+
+	struct well params = { .ct = { 0 } };
+	NB_die_if(well_params(blk_size, blk_cnt, &params), "");
+	size_t size = well_size(&params);
+	size_t ooo_size = well_ooo_size(&params);
+
+	/* struct well is a whole number of cache lines: keep shards aligned to them */
+	NB_die_if(posix_memalign((void **)&grp->shards, NLC_CACHE_LINE,
+			sizeof(struct well) * shard_cnt), "");
+	NB_die_if(posix_memalign(&grp->mem, well_blk_size(&params) < NLC_CACHE_LINE
+				? NLC_CACHE_LINE : well_blk_size(&params),
+			size * shard_cnt), "%zu shards of %zu", shard_cnt, size);
+	NB_die_if(!(
+		grp->ooo = malloc(ooo_size * shard_cnt)
+		), "");
+
+	for (; init_cnt < shard_cnt; init_cnt++) {
+		struct well *shard = &grp->shards[init_cnt];
+		*shard = params;
+		NB_die_if(well_init_technique(shard, (char *)grp->mem + size * init_cnt, technique),
+			"technique %u", technique);
+		NB_die_if(well_ooo_init(shard, (char *)grp->ooo + ooo_size * init_cnt), "");
+	}
+
+	return 0;
+die:
+	if (grp) {
+		for (size_t i=0; i < init_cnt; i++)
+			well_deinit(&grp->shards[i]);
+		free(grp->shards);
+		free(grp->mem);
+		free(grp->ooo);
+		*grp = (struct well_group){ 0 };
+	}
+	return err_cnt;
+}
+
+
+/*	well_group_deinit()
+*/
+void well_group_deinit(struct well_group *grp)
+{
+	if (!grp)
+		return;
+	for (size_t i=0; i < grp->cnt; i++)
+		well_deinit(&grp->shards[i]);
+	free(grp->shards);
+	free(grp->mem);
+	free(grp->ooo);
+	*grp = (struct well_group){ 0 };
+}
+
+
+/*	well_group_produce()
+Reserve up to 'max_count' free blocks from shard 'local' (modulo shard count).
+Never touches other shards.
+
+'cnt == 0' if the shard is full.
+*/
+struct well_gres well_group_produce(struct well_group *grp, size_t local, size_t max_count)
+{
+	struct well *shard = &grp->shards[local % grp->cnt];
+	struct well_res res = well_reserve(&shard->tx, max_count);
+	return (struct well_gres){ .shard = shard, .cnt = res.cnt, .pos = res.pos };
+}
+
+
+/*	well_group_consume()
+Reserve up to 'max_count' blocks from shard 'local' (modulo shard count);
+	if it is empty (and stealing is allowed), from the next shard
+	which is not, trying each once.
+
+'cnt == 0' if all shards visited were empty.
+*/
+struct well_gres well_group_consume(struct well_group *grp, size_t local, size_t max_count)
+{
+	size_t tries = (grp->flags & WELL_GROUP_NO_STEAL) ? 1 : grp->cnt;
+	struct well_res res = { 0 };
+	struct well *shard = NULL;
+
+	for (size_t i=0; i < tries; i++) {
+		shard = &grp->shards[(local + i) % grp->cnt];
+		/* peek first: a failed reserve may still write (e.g. XCH) */
+		if (!__atomic_load_n(&shard->rx.avail, __ATOMIC_RELAXED))
+			continue;
+		if ((res = well_reserve(&shard->rx, max_count)).cnt)
+			break;
+	}
+	return (struct well_gres){ .shard = shard, .cnt = res.cnt, .pos = res.pos };
+}
@@ -0,0 +1,96 @@
+/*	well_mirror.c
+
+Map the memory of a well twice, back-to-back, so that a reservation
+	which wraps past the end of the buffer is still contiguous in memory.
+*/
+#define _GNU_SOURCE /* memfd_create() */
+#include <ndebug.h>
+#include <well.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/*	mirror_fd_()
+Returns an anonymous file descriptor which can be mapped shared,
+	or -1 on error.
+*/
+static int mirror_fd_()
+{
+#ifdef __linux__
+	return memfd_create("well_mirror", MFD_CLOEXEC);
+#else
+	char name[32];
+	snprintf(name, sizeof(name), "/well_mirror.%d", (int)getpid());
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd != -1)
+		shm_unlink(name);
+	return fd;
+#endif
+}
+
+
+/*	well_mirror_init()
+Allocate memory for a well and initialize it, mapping the underlying
+	buffer twice back-to-back:
+	reservations are then contiguous (see well_contiguous()).
+
+This function expects 'buf' to have had well_params() successfully called on it,
+	and well_size(buf) to be a multiple of the page size.
+Use well_mirror_deinit() instead of well_deinit() when done.
+
+returns 0 on success
+*/
+int well_mirror_init(struct well *buf)
+{
+	int err_cnt = 0;
+	int fd = -1;
+	void *mem = MAP_FAILED;
+	size_t size = 0;
+	NB_die_if(!buf, "");
+
+	size = well_size(buf);
+	long page = sysconf(_SC_PAGESIZE);
+	NB_die_if(size % page, "well size %zu not a multiple of page size %ld",
+		size, page);
+
+	NB_die_if((
+		fd = mirror_fd_()
+		) == -1, "");
+	NB_die_if(ftruncate(fd, size), "size %zu", size);
+
+	/* reserve address space for both copies, then map 'fd' over each half */
+	NB_die_if((
+		mem = mmap(NULL, size << 1, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+		) == MAP_FAILED, "size %zu", size << 1);
+	NB_die_if(mmap(mem, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED, "");
+	NB_die_if(mmap(mem + size, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED, "");
+
+	NB_die_if(well_init(buf, mem), "");
+	buf->ct.flags |= WELL_F_MIRROR;
+
+die:
+	if (fd != -1)
+		close(fd);
+	if (err_cnt && mem != MAP_FAILED)
+		munmap(mem, size << 1);
+	return err_cnt;
+}
+
+
+/*	well_mirror_deinit()
+Deinitialize a well set up with well_mirror_init() and unmap its memory.
+*/
+void well_mirror_deinit(struct well *buf)
+{
+	well_deinit(buf);
+	if (!(buf->ct.flags & WELL_F_MIRROR))
+		return;
+	munmap(buf->ct.buf, well_size(buf) << 1);
+	buf->ct.buf = NULL;
+	buf->ct.flags &= ~WELL_F_MIRROR;
+}
@@ -0,0 +1,119 @@
+/*	well_notify.c
+
+Event loop integration: see well_notify.h
+Releases signal the eventfd from wake_() in well.c.
+
+No lost wake-ups: the releaser publishes to 'avail' and then checks 'armed';
+	the consumer sets 'armed' and then checks 'avail'
+	(both sequentially consistent): at least one of them sees the other.
+
+No writes to a closed (or reused) fd: a releaser counts itself in 'notifying'
+	before loading 'efd', deinit stores -1 to 'efd' before waiting for
+	'notifying' to drop to 0.
+*/
+#include <ndebug.h>
+#include <well_notify.h>
+#include "well_relax.h"
+
+#ifdef __linux__
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+#endif
+
+
+/*	well_notify_init()
+Create an eventfd for 'sym' and arm it.
+If 'sym' already holds blocks, the eventfd starts out readable.
+Call after well_init() (or well_sym_init()).
+Refused for wells shared between processes (WELL_F_PSHARED):
+	the eventfd would mean nothing to the other processes.
+
+returns 0 on success
+*/
+int well_notify_init(struct well_sym *sym)
+{
+	int err_cnt = 0;
+	NB_die_if(!sym, "");
+	NB_die_if(sym->flags & WELL_F_PSHARED, "eventfd can't be shared between processes");
+	NB_die_if(sym->efd >= 0, "already set up");
+#ifdef __linux__
+	NB_die_if((
+		sym->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)
+		) < 0, "eventfd()");
+	if (well_notify_rearm(sym)) {
+		uint64_t one = 1;
+		NB_die_if(write(sym->efd, &one, sizeof(one)) != sizeof(one), "");
+	}
+#else
+	NB_die("eventfd not supported on this platform");
+#endif
+die:
+	return err_cnt;
+}
+
+
+/*	well_notify_deinit()
+Stop notifying and close the eventfd of 'sym'.
+Safe while other threads keep releasing into 'sym':
+	waits for any release already writing to the eventfd.
+*/
+void well_notify_deinit(struct well_sym *sym)
+{
+	int fd = sym->efd;
+	if (fd < 0)
+		return;
+	__atomic_store_n(&sym->efd, -1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&sym->armed, 0, __ATOMIC_SEQ_CST);
+	unsigned spins = 0;
+	while (__atomic_load_n(&sym->notifying, __ATOMIC_ACQUIRE))
+		relax_(&spins);
+#ifdef __linux__
+	close(fd);
+#endif
+}
+
+
+/*	well_notify_rearm()
+Having found 'sym' empty, clear its eventfd and arm it again.
+
+returns 0 if armed: go back to the event loop;
+	non-zero if blocks arrived meanwhile: keep draining
+	(the eventfd may then also turn readable: a harmless spurious wake-up).
+*/
+int well_notify_rearm(struct well_sym *sym)
+{
+#ifdef __linux__
+	uint64_t cnt;
+	/* EAGAIN just means it was already clear */
+	ssize_t ret = read(sym->efd, &cnt, sizeof(cnt));
+	(void)ret;
+#endif
+	__atomic_store_n(&sym->armed, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&sym->avail, __ATOMIC_SEQ_CST))
+		return 0;
+	__atomic_store_n(&sym->armed, 0, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+
+/*	well_notify_drain()
+Reserve up to 'max_count' blocks at a time from 'from' and hand each
+	reservation to 'fn' (which must release it), until 'from' is empty
+	and re-armed.
+Call when the eventfd of 'from' is readable.
+
+returns number of blocks handed to 'fn'
+*/
+size_t well_notify_drain(struct well_sym *from, size_t max_count,
+			void (*fn)(struct well_res res, void *arg), void *arg)
+{
+	size_t n = 0;
+	do {
+		struct well_res res;
+		while ((res = well_reserve(from, max_count)).cnt) {
+			fn(res, arg);
+			n += res.cnt;
+		}
+	} while (well_notify_rearm(from));
+	return n;
+}
@@ -0,0 +1,383 @@
+/*	well_pers.c
+
+Persistent wells: see well_pers.h
+
+File layout:
+	- struct well_pers_hdr
+	- the buffer itself (page-aligned)
+
+Producers release into 'rx' and consumers into 'consumed', both out of order:
+	'rx.release_pos' is then the tail and 'consumed' holds the blocks
+	that may go to 'tx' once a head past them is durable.
+Only well_pers_sync() (serialized by 'sync_mtx') reserves from 'consumed'
+	and releases into 'tx'.
+
+The 'sync_ms' deadline is kept by a helper thread sleeping on 'timer_cond'
+	(CLOCK_MONOTONIC), so releases never look at the clock.
+
+On open, positions are rebased so that 'head' falls in the first lap:
+	'base' is the absolute position of position 0.
+*/
+#include <ndebug.h>
+#include <well_pers.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*	now_ns_()
+*/
+static uint64_t now_ns_()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*	prime_()
+Make the completion bitmap of 'sym' read "not done" for the lap of positions
+	starting at 'start', as well_ooo_init() does for a lap starting at 0:
+	a 0 bit means done on odd laps.
+*/
+static void prime_(struct well_sym *sym, size_t start)
+{
+	memset(sym->done, 0x0, ((sym->lap + 63) >> 6) * sizeof(uint64_t));
+	for (size_t p = start; p < start + sym->lap; p++) {
+		if (p & sym->lap) {
+			size_t idx = p & (sym->lap -1);
+			sym->done[idx >> 6] |= 1UL << (idx & 63);
+		}
+	}
+}
+
+/*	msync_blocks_()
+Write blocks [pos, pos+cnt) out to the file, and wait for them.
+*/
+static int msync_blocks_(struct well_pers *wp, size_t pos, size_t cnt)
+{
+	int err_cnt = 0;
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t blk_cnt = well_blk_count(&wp->buf);
+	while (cnt) {
+		size_t idx = pos & (blk_cnt -1);
+		size_t n = blk_cnt - idx;
+		if (n > cnt)
+			n = cnt;
+		/* the buffer starts on a page boundary */
+		size_t from = (idx << wp->buf.ct.blk_shift) & ~(page -1);
+		size_t to = (idx + n) << wp->buf.ct.blk_shift;
+		NB_die_if(msync((char *)well_mem(&wp->buf) + from, to - from, MS_SYNC),
+			"msync %zu Bytes", to - from);
+		pos += n;
+		cnt -= n;
+	}
+die:
+	return err_cnt;
+}
+
+/*	sync_locked_()
+well_pers_sync() with 'sync_mtx' held.
+*/
+static int sync_locked_(struct well_pers *wp)
+{
+	int err_cnt = 0;
+	__atomic_store_n(&wp->pending, 0, __ATOMIC_RELAXED);
+
+	/* head first: consumers can only be done with blocks before the tail */
+	wp->held += well_reserve(&wp->consumed, -1).cnt;
+	size_t head = wp->head + wp->held;
+	size_t tail = __atomic_load_n(&wp->buf.rx.release_pos, __ATOMIC_ACQUIRE);
+
+	/* data, then the positions covering it */
+	NB_die_if(msync_blocks_(wp, wp->tail, tail - wp->tail), "");
+	wp->hdr->tail = wp->base + tail;
+	wp->hdr->head = wp->base + head;
+	NB_die_if(msync(wp->hdr, sizeof(*wp->hdr), MS_SYNC), "msync header");
+	wp->tail = tail;
+	wp->head = head;
+
+	/* durably consumed: producers may overwrite */
+	if (wp->held)
+		well_release_single(&wp->buf.tx, wp->held);
+	wp->held = 0;
+	__atomic_store_n(&wp->synced_at, now_ns_(), __ATOMIC_RELAXED);
+
+die:
+	return err_cnt;
+}
+
+/*	maybe_sync_()
+Sync if 'cnt' more released blocks are due;
+	unless another thread is already at it.
+*/
+static void maybe_sync_(struct well_pers *wp, size_t cnt)
+{
+	if (__atomic_add_fetch(&wp->pending, cnt, __ATOMIC_RELAXED) < wp->sync_blocks)
+		return;
+	if (pthread_mutex_trylock(&wp->sync_mtx))
+		return;
+	sync_locked_(wp);
+	pthread_mutex_unlock(&wp->sync_mtx);
+}
+
+/*	timer_()
+Helper thread: sync whatever is pending once 'sync_ns' has passed
+	since the last sync (by anyone), until told to stop.
+*/
+static void *timer_(void *arg)
+{
+	struct well_pers *wp = arg;
+	pthread_mutex_lock(&wp->timer_mtx);
+	uint64_t due = now_ns_() + wp->sync_ns;
+	while (!wp->timer_stop) {
+		struct timespec ts = { .tv_sec = due / 1000000000, .tv_nsec = due % 1000000000 };
+		pthread_cond_timedwait(&wp->timer_cond, &wp->timer_mtx, &ts);
+		if (wp->timer_stop)
+			break;
+		uint64_t now = now_ns_();
+		if (now < due)
+			continue;
+		if (__atomic_load_n(&wp->pending, __ATOMIC_RELAXED)) {
+			pthread_mutex_unlock(&wp->timer_mtx);
+			well_pers_sync(wp);
+			pthread_mutex_lock(&wp->timer_mtx);
+			now = now_ns_();
+		}
+		/* a sync by a releaser meanwhile pushes the deadline out */
+		uint64_t last = __atomic_load_n(&wp->synced_at, __ATOMIC_RELAXED);
+		due = (last > now ? last : now) + wp->sync_ns;
+	}
+	pthread_mutex_unlock(&wp->timer_mtx);
+	return NULL;
+}
+
+/*	timer_stop_()
+*/
+static void timer_stop_(struct well_pers *wp)
+{
+	if (!wp->timer_up)
+		return;
+	pthread_mutex_lock(&wp->timer_mtx);
+	wp->timer_stop = 1;
+	pthread_cond_signal(&wp->timer_cond);
+	pthread_mutex_unlock(&wp->timer_mtx);
+	pthread_join(wp->timer, NULL);
+	pthread_cond_destroy(&wp->timer_cond);
+	pthread_mutex_destroy(&wp->timer_mtx);
+	wp->timer_up = 0;
+}
+
+/*	timer_start_()
+*/
+static int timer_start_(struct well_pers *wp)
+{
+	int err_cnt = 0;
+	int mtx_up = 0, cond_up = 0;
+	NB_die_if(pthread_mutex_init(&wp->timer_mtx, NULL), "");
+	mtx_up = 1;
+
+	pthread_condattr_t attr;
+	int err = pthread_condattr_init(&attr);
+	if (!err) {
+		err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		if (!err)
+			err = pthread_cond_init(&wp->timer_cond, &attr);
+		pthread_condattr_destroy(&attr);
+	}
+	NB_die_if(err, "condvar: %s", strerror(err));
+	cond_up = 1;
+
+	NB_die_if(pthread_create(&wp->timer, NULL, timer_, wp), "sync timer thread");
+	wp->timer_up = 1;
+	return 0;
+
+die:
+	if (cond_up)
+		pthread_cond_destroy(&wp->timer_cond);
+	if (mtx_up)
+		pthread_mutex_destroy(&wp->timer_mtx);
+	return err_cnt;
+}
+
+
+/*	well_pers_open()
+Open the file at 'path' as a well of 'blk_cnt' blocks of 'blk_size' Bytes
+	(see well_params()), creating it if it does not exist (or is empty).
+An existing file must have been created with the same block size and count:
+	its blocks between the durable head and tail are queued for consumers again.
+
+Released blocks are synced once 'sync_blocks' of them are pending
+	(0 or more than half the well means half the well),
+	or, if 'sync_ms' is not 0, once that long has passed since the last sync
+	(by a helper thread, whether or not anything else is going on).
+
+returns 0 on success
+*/
+int well_pers_open(struct well_pers *wp, const char *path,
+		size_t blk_size, size_t blk_cnt, size_t sync_blocks, uint32_t sync_ms)
+{
+	int err_cnt = 0;
+	void *map = MAP_FAILED;
+	NB_die_if(!wp || !path, "");
+	*wp = (struct well_pers){ .fd = -1 };
+
+	NB_die_if(well_params(blk_size, blk_cnt, &wp->buf), "");
+	const size_t cnt = well_blk_count(&wp->buf);
+	const size_t page = sysconf(_SC_PAGESIZE);
+	size_t buf_offt = (sizeof(struct well_pers_hdr) + page -1) & ~(page -1);
+	NB_die_if(__builtin_add_overflow(buf_offt, well_size(&wp->buf), &wp->map_sz),
+		"well size %zu overflow", well_size(&wp->buf));
+
+	NB_die_if((
+		wp->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)
+		) == -1, "open('%s')", path);
+	NB_die_if(flock(wp->fd, LOCK_EX | LOCK_NB), "'%s' is open in another process", path);
+	struct stat st;
+	NB_die_if(fstat(wp->fd, &st), "");
+	int fresh = !st.st_size;
+	if (fresh)
+		NB_die_if(ftruncate(wp->fd, wp->map_sz), "size %zu", wp->map_sz);
+	else
+		NB_die_if((size_t)st.st_size < wp->map_sz,
+			"'%s' is %zu Bytes, expected %zu", path, (size_t)st.st_size, wp->map_sz);
+
+	NB_die_if((
+		map = mmap(NULL, wp->map_sz, PROT_READ | PROT_WRITE, MAP_SHARED, wp->fd, 0)
+		) == MAP_FAILED, "size %zu", wp->map_sz);
+	wp->hdr = map;
+
+	if (fresh) {
+		*wp->hdr = (struct well_pers_hdr){
+			.magic = WELL_PERS_MAGIC,
+			.version = WELL_PERS_VERSION,
+			.blk_size = well_blk_size(&wp->buf),
+			.blk_cnt = cnt
+		};
+		NB_die_if(msync(wp->hdr, sizeof(*wp->hdr), MS_SYNC), "msync header");
+	}
+	const struct well_pers_hdr *hdr = wp->hdr;
+	NB_die_if(hdr->magic != WELL_PERS_MAGIC, "'%s' is not a persistent well", path);
+	NB_die_if(hdr->version != WELL_PERS_VERSION,
+		"'%s' layout version %u != %u", path, hdr->version, WELL_PERS_VERSION);
+	NB_die_if(hdr->blk_size != well_blk_size(&wp->buf) || hdr->blk_cnt != cnt,
+		"'%s' has %zu blocks of %zu, not %zu of %zu", path,
+		(size_t)hdr->blk_cnt, (size_t)hdr->blk_size, cnt, well_blk_size(&wp->buf));
+	NB_die_if(hdr->tail < hdr->head || hdr->tail - hdr->head > cnt,
+		"'%s' head %zu tail %zu corrupt", path, (size_t)hdr->head, (size_t)hdr->tail);
+
+	/* rebase */
+	wp->base = hdr->head & ~(uint64_t)(cnt -1);
+	wp->head = hdr->head - wp->base;
+	wp->tail = hdr->tail - wp->base;
+
+	NB_die_if(well_init(&wp->buf, (char *)map + buf_offt), "");
+	NB_die_if(!(
+		wp->ooo = malloc(well_ooo_size(&wp->buf))
+		), "");
+	NB_die_if(well_sym_init(&wp->buf, &wp->consumed,
+		(char *)wp->ooo + well_ooo_size(&wp->buf) / 2), "");
+	wp->buf.rx.done = wp->ooo;
+	wp->buf.rx.lap = cnt;
+	prime_(&wp->buf.rx, wp->tail);
+	prime_(&wp->consumed, wp->head);
+
+	/* resume: [head, tail) is queued, the rest is free */
+	wp->buf.rx.pos = wp->head;
+	wp->buf.rx.avail = wp->tail - wp->head;
+	wp->buf.rx.release_pos = wp->tail;
+	wp->buf.tx.pos = wp->buf.tx.release_pos = wp->tail;
+	wp->buf.tx.avail = cnt - (wp->tail - wp->head);
+	wp->consumed.pos = wp->consumed.release_pos = wp->head;
+
+	wp->sync_blocks = sync_blocks;
+	if (!wp->sync_blocks || wp->sync_blocks > cnt / 2)
+		wp->sync_blocks = cnt / 2;
+	wp->sync_ns = (uint64_t)sync_ms * 1000000;
+	wp->synced_at = now_ns_();
+	NB_die_if(pthread_mutex_init(&wp->sync_mtx, NULL), "");
+	if (wp->sync_ns && timer_start_(wp)) {
+		pthread_mutex_destroy(&wp->sync_mtx);
+		NB_die("");
+	}
+	return 0;
+
+die:
+	if (wp && wp->consumed.technique)
+		well_sym_deinit(&wp->consumed);
+	if (wp && wp->buf.ct.buf)
+		well_deinit(&wp->buf);
+	if (map != MAP_FAILED)
+		munmap(map, wp->map_sz);
+	if (wp && wp->fd != -1)
+		close(wp->fd);
+	if (wp) {
+		free(wp->ooo);
+		*wp = (struct well_pers){ .fd = -1 };
+	}
+	return err_cnt;
+}
+
+
+/*	well_pers_commit()
+Hand blocks reserved from 'wp->buf.tx' (and written) to consumers.
+*/
+void well_pers_commit(struct well_pers *wp, struct well_res res)
+{
+	well_release_ooo(&wp->buf.rx, res);
+	maybe_sync_(wp, res.cnt);
+}
+
+
+/*	well_pers_done()
+Mark blocks reserved from 'wp->buf.rx' as consumed:
+	they are not delivered again once the next sync completes.
+*/
+void well_pers_done(struct well_pers *wp, struct well_res res)
+{
+	well_release_ooo(&wp->consumed, res);
+	maybe_sync_(wp, res.cnt);
+}
+
+
+/*	well_pers_sync()
+Make every block committed so far durable, along with every block consumed so far
+	(as far as contiguous from the head: see well_release_ooo()).
+
+returns 0 on success
+*/
+int well_pers_sync(struct well_pers *wp)
+{
+	pthread_mutex_lock(&wp->sync_mtx);
+	int ret = sync_locked_(wp);
+	pthread_mutex_unlock(&wp->sync_mtx);
+	return ret;
+}
+
+
+/*	well_pers_close()
+Sync, then release everything; the file stays, ready to be opened again.
+No reservations may be outstanding.
+
+returns 0 if the final sync succeeded
+*/
+int well_pers_close(struct well_pers *wp)
+{
+	if (!wp || wp->fd == -1)
+		return 0;
+	timer_stop_(wp);
+	int ret = well_pers_sync(wp);
+	pthread_mutex_destroy(&wp->sync_mtx);
+	well_sym_deinit(&wp->consumed);
+	well_deinit(&wp->buf);
+	munmap(wp->hdr, wp->map_sz);
+	close(wp->fd);
+	free(wp->ooo);
+	*wp = (struct well_pers){ .fd = -1 };
+	return ret;
+}
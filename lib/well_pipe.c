@@ -0,0 +1,76 @@
+/*	well_pipe.c
+
+Multi-stage pipelines over a single well: see well_pipe.h
+*/
+#include <ndebug.h>
+#include <well_pipe.h>
+
+#include <stdlib.h>
+
+
+/*	well_pipe_init()
+Set up a pipeline of 'stage_cnt' (at least 2) stages over a well of
+	'blk_cnt' blocks of 'blk_size' bytes; see well_params().
+All blocks start out available to stage 0.
+
+returns 0 on success
+*/
+int well_pipe_init(struct well_pipe *pipe, size_t stage_cnt,
+			size_t blk_size, size_t blk_cnt)
+{
+	int err_cnt = 0;
+	size_t init_cnt = 0;
+	NB_die_if(!pipe, "");
+	*pipe = (struct well_pipe){ .cnt = stage_cnt };
+	NB_die_if(stage_cnt < 2, "pipeline needs at least 2 stages, not %zu", stage_cnt);
+
+	NB_die_if(well_params(blk_size, blk_cnt, &pipe->buf), "");
+	size_t sym_ooo = well_ooo_size(&pipe->buf) / 2;
+	NB_die_if(!(
+		pipe->ooo = malloc(sym_ooo * stage_cnt)
+		), "");
+
+	NB_die_if(
+		well_init(&pipe->buf, malloc(well_size(&pipe->buf)))
+		, "size %zu", well_size(&pipe->buf));
+	NB_die_if(well_ooo_init(&pipe->buf, pipe->ooo), "");
+
+	if (stage_cnt > 2) {
+		NB_die_if(posix_memalign((void **)&pipe->extra, NLC_CACHE_LINE,
+				sizeof(struct well_stage) * (stage_cnt - 2)), "");
+		for (; init_cnt < stage_cnt - 2; init_cnt++)
+			NB_die_if(well_sym_init(&pipe->buf, &pipe->extra[init_cnt].sym,
+					(char *)pipe->ooo + sym_ooo * (init_cnt + 2)), "");
+	}
+
+	return 0;
+die:
+	if (pipe) {
+		for (size_t i=0; i < init_cnt; i++)
+			well_sym_deinit(&pipe->extra[i].sym);
+		free(pipe->extra);
+		if (well_mem(&pipe->buf)) {
+			well_deinit(&pipe->buf);
+			free(well_mem(&pipe->buf));
+		}
+		free(pipe->ooo);
+		*pipe = (struct well_pipe){ .cnt = 0 };
+	}
+	return err_cnt;
+}
+
+
+/*	well_pipe_deinit()
+*/
+void well_pipe_deinit(struct well_pipe *pipe)
+{
+	if (!pipe || !pipe->cnt)
+		return;
+	for (size_t i=0; i < pipe->cnt - 2; i++)
+		well_sym_deinit(&pipe->extra[i].sym);
+	free(pipe->extra);
+	well_deinit(&pipe->buf);
+	free(well_mem(&pipe->buf));
+	free(pipe->ooo);
+	*pipe = (struct well_pipe){ .cnt = 0 };
+}
@@ -0,0 +1,141 @@
+/*	well_ptr.c
+
+Pointer queue: for wells whose blocks are pointers, and which
+	only exist to hand those pointers from one thread to another.
+
+Every block is a slot holding either a pointer or NULL (empty).
+'tx.pos' counts pointers ever pushed, 'rx.pos' pointers ever popped;
+	each is only written by its own side.
+Producers claim slots by advancing 'tx.pos' (as long as it stays
+	less than a lap ahead of 'rx.pos'), then CAS each slot from NULL to their pointer;
+	consumers claim by advancing 'rx.pos' (as long as it stays behind 'tx.pos'),
+	then exchange each slot for NULL until they get a pointer out of it.
+There is no 'avail' count shared by both sides, no release ordering
+	and no locking: the well's technique is not used.
+
+Claims only bound how many threads may be at a slot, not which lap each is on:
+	the producer of the next lap may get to a slot before the producer
+	(or consumer) of this one.
+The hand-off itself is therefore atomic on both ends: only one producer
+	fills an empty slot, only one consumer empties a full one,
+	and every claim eventually finds a peer to pair with.
+Pointers of different producers may then swap laps;
+	those of a single producer never do (it fills its slots in order).
+
+A slot is only waited on when its claim raced a peer still busy with it,
+	which is a matter of a few instructions unless that peer is descheduled.
+*/
+#include <ndebug.h>
+#include <well.h>
+#include "well_relax.h"
+
+#include <string.h>
+
+
+/*	slot_()
+*/
+NLC_INLINE void **slot_(const struct well *buf, size_t pos)
+{
+	return well_access(pos, 0, buf);
+}
+
+
+/*	well_ptr_init()
+Use 'buf' (after well_init(), before any other use) as a pointer queue:
+	blocks must be pointer-sized.
+Such a well is then ONLY accessed through well_ptr_push() and well_ptr_pop():
+	never reserve from or release into it.
+
+returns 0 on success
+*/
+int well_ptr_init(struct well *buf)
+{
+	int err_cnt = 0;
+	NB_die_if(!buf || !buf->ct.buf, "");
+	NB_die_if(buf->ct.blk_size != sizeof(void *),
+		"blk_size %zu is not pointer-sized", buf->ct.blk_size);
+	NB_die_if(buf->tx.pos || buf->rx.pos, "well already in use");
+	memset(buf->ct.buf, 0x0, well_size(buf));
+	buf->ct.flags |= WELL_F_PTR;
+die:
+	return err_cnt;
+}
+
+
+/*	well_ptr_push()
+Push up to 'cnt' pointers from 'ptrs' (none of which may be NULL),
+	from any number of producer threads.
+
+Returns number of pointers pushed, which may be 0 if 'buf' is full.
+*/
+size_t well_ptr_push(struct well *buf, void *const *ptrs, size_t cnt)
+{
+	size_t blk_cnt = well_blk_count(buf);
+	size_t pos = __atomic_load_n(&buf->tx.pos, __ATOMIC_RELAXED);
+	size_t k;
+	for (;;) {
+		size_t used = pos - __atomic_load_n(&buf->rx.pos, __ATOMIC_ACQUIRE);
+		/* 'pos' is stale: consumers already got past it */
+		if (used > blk_cnt) {
+			pos = __atomic_load_n(&buf->tx.pos, __ATOMIC_RELAXED);
+			continue;
+		}
+		k = blk_cnt - used;
+		if (k > cnt)
+			k = cnt;
+		if (!k)
+			return 0;
+		if (__atomic_compare_exchange_n(&buf->tx.pos, &pos, pos + k,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+
+	for (size_t i=0; i < k; i++) {
+		void **slot = slot_(buf, pos + i);
+		unsigned spins = 0;
+		void *empty = NULL;
+		while (!__atomic_compare_exchange_n(slot, &empty, ptrs[i],
+					0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			empty = NULL;
+			relax_(&spins);
+		}
+	}
+	return k;
+}
+
+/*	well_ptr_pop()
+Pop up to 'max' pointers into 'ptrs',
+	from any number of consumer threads.
+
+Returns number of pointers popped, which may be 0 if 'buf' is empty.
+*/
+size_t well_ptr_pop(struct well *buf, void **ptrs, size_t max)
+{
+	size_t blk_cnt = well_blk_count(buf);
+	size_t pos = __atomic_load_n(&buf->rx.pos, __ATOMIC_RELAXED);
+	size_t k;
+	for (;;) {
+		k = __atomic_load_n(&buf->tx.pos, __ATOMIC_ACQUIRE) - pos;
+		/* 'pos' is stale: other consumers got further than 'tx.pos' we read */
+		if (k > blk_cnt) {
+			pos = __atomic_load_n(&buf->rx.pos, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (k > max)
+			k = max;
+		if (!k)
+			return 0;
+		if (__atomic_compare_exchange_n(&buf->rx.pos, &pos, pos + k,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+
+	for (size_t i=0; i < k; i++) {
+		void **slot = slot_(buf, pos + i);
+		unsigned spins = 0;
+		while (!__atomic_load_n(slot, __ATOMIC_RELAXED)
+			|| !(ptrs[i] = __atomic_exchange_n(slot, NULL, __ATOMIC_ACQUIRE)))
+			relax_(&spins);
+	}
+	return k;
+}
@@ -0,0 +1,125 @@
+/*	well_rec.c
+
+Variable-length records on top of the fixed-size blocks of a well.
+See well_rec.h
+*/
+#include <ndebug.h>
+#include <well_rec.h>
+#include <string.h>
+
+
+/*	offt_()
+Byte offset inside the buffer of 'pos'.
+*/
+NLC_INLINE size_t offt_(const struct well *buf, size_t pos)
+{
+	return (pos << buf->ct.blk_shift) & buf->ct.overflow;
+}
+
+
+/*	well_rec_reserve()
+Reserve enough consecutive blocks from 'tx' for a record
+	with a 'len' Byte payload, and write the record header.
+
+Returns a 'struct well_res' covering all blocks of the record:
+	write the payload and then release it to 'rx' as usual.
+On failure (not enough blocks available right now) 'cnt == 0';
+	a record larger than the whole buffer will never succeed,
+	nor will any record if 'blk_size' is smaller than the record header.
+*/
+struct well_res well_rec_reserve(struct well *buf, size_t len)
+{
+	struct well_res res = { 0 };
+	size_t cnt = well_rec_blocks(buf, len);
+	if (cnt > well_blk_count(buf) || well_blk_size(buf) < sizeof(struct well_rec_hdr))
+		return res;
+
+	res = well_reserve_exact(&buf->tx, cnt);
+	if (res.cnt)
+		((struct well_rec_hdr *)well_access(res.pos, 0, buf))->len = len;
+	return res;
+}
+
+
+/*	well_rec_write()
+Copy 'len' Bytes from 'src' into the payload of the record at 'pos',
+	looping around the end of the buffer if necessary.
+*/
+void well_rec_write(const struct well *buf, size_t pos, const void *src, size_t len)
+{
+	size_t offt = (offt_(buf, pos) + sizeof(struct well_rec_hdr)) & buf->ct.overflow;
+	size_t first = well_size(buf) - offt;
+	if (first > len || well_contiguous(buf))
+		first = len;
+
+	memcpy((char *)buf->ct.buf + offt, src, first);
+	memcpy(buf->ct.buf, (const char *)src + first, len - first);
+}
+
+
+/*	well_rec_read()
+Copy the payload of the record at 'pos' into 'dst' (at most 'max_len' Bytes),
+	looping around the end of the buffer if necessary.
+
+Returns the number of Bytes copied.
+*/
+size_t well_rec_read(const struct well *buf, size_t pos, void *dst, size_t max_len)
+{
+	size_t len = well_rec_len(buf, pos);
+	if (len > max_len)
+		len = max_len;
+
+	size_t offt = (offt_(buf, pos) + sizeof(struct well_rec_hdr)) & buf->ct.overflow;
+	size_t first = well_size(buf) - offt;
+	if (first > len || well_contiguous(buf))
+		first = len;
+
+	memcpy(dst, (const char *)buf->ct.buf + offt, first);
+	memcpy((char *)dst + first, buf->ct.buf, len - first);
+	return len;
+}
+
+
+/*	well_rec_next()
+Return the blocks of the next whole record on 'rx'.
+Reserves from 'rx' as required, keeping track of reserved blocks in 'it'.
+
+Returns a 'struct well_res' covering all blocks of the record:
+	read the payload and then well_release_single() it to 'tx'.
+On failure (no whole record available right now) 'cnt == 0'.
+
+WARNING: ONLY call from a SINGLE consumer.
+*/
+struct well_res well_rec_next(struct well *buf, struct well_rec_it *it)
+{
+	struct well_res ret = { 0 };
+
+	/* need at least the header */
+	if (!it->cnt) {
+		struct well_res res = well_reserve(&buf->rx, well_blk_count(buf));
+		if (!res.cnt)
+			return ret;
+		it->pos = res.pos;
+		it->cnt = res.cnt;
+	}
+
+	/* producers release whole records; but we may not have reserved
+		all of this one yet.
+	Being the only consumer, further reservations are contiguous.
+	*/
+	size_t cnt = well_rec_blocks(buf, well_rec_len(buf, it->pos));
+	if (cnt > it->cnt) {
+		struct well_res res = well_reserve(&buf->rx, cnt - it->cnt);
+		NB_wrn_if(res.cnt && res.pos != it->pos + it->cnt,
+			"non-contiguous reservation: multiple consumers?");
+		it->cnt += res.cnt;
+		if (cnt > it->cnt)
+			return ret;
+	}
+
+	ret.pos = it->pos;
+	ret.cnt = cnt;
+	it->pos += cnt;
+	it->cnt -= cnt;
+	return ret;
+}
@@ -0,0 +1,40 @@
+#ifndef well_relax_h_
+#define well_relax_h_
+
+/*	well_relax.h
+
+PRIVATE to the library: waiting on a peer for a few instructions.
+*/
+
+#include <nonlibc.h>
+#include <sched.h>
+
+
+/*	cpu_relax_()
+Tell the CPU we are spinning (and, on SMT, let the sibling thread run).
+*/
+NLC_INLINE void cpu_relax_()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/*	relax_()
+Spin once; yield every 64th call of a wait ('*spins' counts them)
+	in case the peer being waited on was preempted.
+*/
+NLC_INLINE void relax_(unsigned *spins)
+{
+	if (!(++(*spins) & 0x3f))
+		sched_yield();
+	else
+		cpu_relax_();
+}
+
+
+#endif /* well_relax_h_ */
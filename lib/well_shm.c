@@ -0,0 +1,243 @@
+/*	well_shm.c
+
+Wells in named shared memory: see well_shm.h
+
+Segment layout:
+	- struct well_shm_hdr
+	- struct well (at SHM_WELL_OFFT_, cache-line aligned)
+	- completion bitmaps for well_release_ooo()
+	- the buffer itself (page-aligned)
+
+Segment address:
+	the creator maps at an address derived from 'name', in a range
+	(SHM_BASE_ onwards) which neither the kernel nor the loader hand out
+	on their own, probing the next slots if that address is taken.
+Attachers, including freshly exec()'d processes whose own mappings
+	are placed at random (ASLR), then find the address free.
+Where that range does not exist (32-bit, small address spaces)
+	the kernel picks the address, as it would for any mapping.
+*/
+#define _GNU_SOURCE /* MAP_FIXED_NOREPLACE */
+#include <ndebug.h>
+#include <well_shm.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define SHM_WELL_OFFT_ \
+	((sizeof(struct well_shm_hdr) + NLC_CACHE_LINE -1) & ~(size_t)(NLC_CACHE_LINE -1))
+
+#define SHM_HDR_(buf) \
+	((struct well_shm_hdr *)((char *)(buf) - SHM_WELL_OFFT_))
+
+#if UINTPTR_MAX > 0xffffffff
+	#define SHM_BASE_	((uintptr_t)0x200000000000)	/* 32TiB */
+	#define SHM_SLOT_SHIFT_	32				/* 4GiB apart */
+	#define SHM_SLOTS_	4096				/* up to 48TiB */
+	#define SHM_PROBES_	64
+#endif
+
+
+/*	map_named_()
+Map 'map_sz' bytes of 'fd' at the address derived from 'name' (see above),
+	or wherever the kernel likes if no address in the range is free.
+*/
+static void *map_named_(const char *name, int fd, size_t map_sz)
+{
+	void *mem = MAP_FAILED;
+#if defined(SHM_BASE_) && defined(MAP_FIXED_NOREPLACE)
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const char *c = name; *c; c++)
+		hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+
+	for (size_t i=0; i < SHM_PROBES_; i++) {
+		uintptr_t slot = (hash + i) % SHM_SLOTS_;
+		void *addr = (void *)(SHM_BASE_ + (slot << SHM_SLOT_SHIFT_));
+		mem = mmap(addr, map_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+		if (mem == addr)
+			return mem;
+		/* kernels before 4.17 take the flag as a mere hint */
+		if (mem != MAP_FAILED)
+			munmap(mem, map_sz);
+	}
+	NB_wrn("no free address for '%s' at 0x%lx+: attachers may not map it",
+		name, (unsigned long)SHM_BASE_);
+#endif
+	return mmap(NULL, map_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+}
+
+
+/*	well_shm_create()
+Create a shared memory segment 'name' (which must not exist yet)
+	holding a well of 'blk_cnt' blocks of 'blk_size' bytes;
+	see well_params().
+Write a pointer to the (initialized) well into '*out'.
+
+Release with well_shm_destroy() once no other process is attached.
+
+returns 0 on success
+*/
+int well_shm_create(const char *name, size_t blk_size, size_t blk_cnt, struct well **out)
+{
+	int err_cnt = 0;
+	int fd = -1;
+	char *mem = MAP_FAILED;
+	size_t map_sz = 0;
+	NB_die_if(!name || !out, "");
+
+	struct well params = { .ct = { 0 } };
+	NB_die_if(well_params(blk_size, blk_cnt, &params), "");
+
+	/* work out layout */
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t ooo_offt = (SHM_WELL_OFFT_ + sizeof(struct well) + 7) & ~(size_t)7;
+	size_t buf_offt = (ooo_offt + well_ooo_size(&params) + page -1) & ~(page -1);
+	NB_die_if(__builtin_add_overflow(buf_offt, well_size(&params), &map_sz),
+		"well size %zu overflow", well_size(&params));
+
+	NB_die_if((
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)
+		) == -1, "shm_open('%s')", name);
+	NB_die_if(ftruncate(fd, map_sz), "size %zu", map_sz);
+	NB_die_if((
+		mem = map_named_(name, fd, map_sz)
+		) == MAP_FAILED, "size %zu", map_sz);
+
+	struct well_shm_hdr *hdr = (struct well_shm_hdr *)mem;
+	*hdr = (struct well_shm_hdr){
+		.magic = WELL_SHM_MAGIC,
+		.version = WELL_SHM_VERSION,
+		.technique = params.ct.technique,
+		.well_sz = sizeof(struct well),
+		.map_sz = map_sz,
+		.addr = mem
+	};
+
+	struct well *buf = (struct well *)(mem + SHM_WELL_OFFT_);
+	*buf = params;
+	buf->ct.flags |= WELL_F_PSHARED;
+	NB_die_if(well_init(buf, mem + buf_offt), "");
+	NB_die_if(well_ooo_init(buf, mem + ooo_offt), "");
+
+	/* attachers may now use it */
+	__atomic_store_n(&hdr->ready, 1, __ATOMIC_RELEASE);
+	*out = buf;
+
+die:
+	if (fd != -1)
+		close(fd);
+	if (err_cnt) {
+		if (mem != MAP_FAILED)
+			munmap(mem, map_sz);
+		if (fd != -1)
+			shm_unlink(name);
+	}
+	return err_cnt;
+}
+
+
+/*	well_shm_attach()
+Map the segment 'name' created with well_shm_create() by another process,
+	and write a pointer to its well into '*out'.
+
+Fails if the segment was created with an incompatible layout,
+	is not yet initialized, or cannot be mapped at the creator's address.
+Release with well_shm_detach().
+
+returns 0 on success
+*/
+int well_shm_attach(const char *name, struct well **out)
+{
+	int err_cnt = 0;
+	int fd = -1;
+	struct well_shm_hdr *peek = MAP_FAILED;
+	void *mem = MAP_FAILED;
+	size_t map_sz = 0;
+	NB_die_if(!name || !out, "");
+
+	NB_die_if((
+		fd = shm_open(name, O_RDWR, 0)
+		) == -1, "shm_open('%s')", name);
+	struct stat st;
+	NB_die_if(fstat(fd, &st), "");
+	NB_die_if((size_t)st.st_size < sizeof(*peek), "'%s' too small", name);
+
+	/* check header before mapping everything;
+		copy it out and unmap so 'peek' does not occupy the target address
+	*/
+	NB_die_if((
+		peek = mmap(NULL, sizeof(*peek), PROT_READ, MAP_SHARED, fd, 0)
+		) == MAP_FAILED, "");
+	struct well_shm_hdr hdr = *peek;
+	hdr.ready = __atomic_load_n(&peek->ready, __ATOMIC_ACQUIRE);
+	munmap(peek, sizeof(*peek));
+	peek = MAP_FAILED;
+
+	NB_die_if(hdr.magic != WELL_SHM_MAGIC, "'%s' is not a well", name);
+	NB_die_if(hdr.version != WELL_SHM_VERSION,
+		"'%s' layout version %u != %u", name, hdr.version, WELL_SHM_VERSION);
+	NB_die_if(!well_technique_name(hdr.technique),
+		"'%s' technique %u not implemented", name, hdr.technique);
+	NB_die_if(hdr.well_sz != sizeof(struct well),
+		"'%s' struct well size %u != %zu", name, hdr.well_sz, sizeof(struct well));
+	NB_die_if(!hdr.ready, "'%s' not yet initialized", name);
+	map_sz = hdr.map_sz;
+	void *addr = hdr.addr;
+	NB_die_if((size_t)st.st_size < map_sz, "'%s' truncated", name);
+
+#ifdef MAP_FIXED_NOREPLACE
+	const int flags = MAP_SHARED | MAP_FIXED_NOREPLACE;
+#else
+	const int flags = MAP_SHARED;
+#endif
+	NB_die_if((
+		mem = mmap(addr, map_sz, PROT_READ | PROT_WRITE, flags, fd, 0)
+		) == MAP_FAILED, "cannot map '%s' at %p", name, addr);
+	/* without MAP_FIXED_NOREPLACE (or on old kernels) 'addr' is only a hint */
+	NB_die_if(mem != addr, "'%s' mapped at %p instead of %p", name, mem, addr);
+
+	*out = (struct well *)((char *)mem + SHM_WELL_OFFT_);
+
+die:
+	if (peek != MAP_FAILED)
+		munmap(peek, sizeof(*peek));
+	if (fd != -1)
+		close(fd);
+	if (err_cnt && mem != MAP_FAILED)
+		munmap(mem, map_sz);
+	return err_cnt;
+}
+
+
+/*	well_shm_detach()
+Unmap a well obtained from well_shm_create() or well_shm_attach().
+Does not affect other processes.
+*/
+void well_shm_detach(struct well *buf)
+{
+	if (!buf)
+		return;
+	struct well_shm_hdr *hdr = SHM_HDR_(buf);
+	munmap(hdr, hdr->map_sz);
+}
+
+
+/*	well_shm_destroy()
+Deinitialize a well created with well_shm_create(), unmap it
+	and remove the segment 'name'.
+Call only once all other processes have detached.
+*/
+void well_shm_destroy(const char *name, struct well *buf)
+{
+	if (buf) {
+		well_deinit(buf);
+		well_shm_detach(buf);
+	}
+	if (name)
+		shm_unlink(name);
+}
@@ -0,0 +1,149 @@
+/*	well_sock.c
+
+Batched datagram I/O: see well_sock.h
+*/
+#define _GNU_SOURCE /* recvmmsg(), sendmmsg() */
+#include <ndebug.h>
+#include <well_sock.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+
+/*	well_sock_init()
+Link socket 'fd' to 'buf': reserve from 'from', release into 'to'.
+
+returns 0 on success
+*/
+int well_sock_init(struct well_sock *ws, struct well *buf,
+			struct well_sym *from, struct well_sym *to, int fd)
+{
+	int err_cnt = 0;
+	NB_die_if(!ws || !buf || !from || !to, "");
+	NB_die_if(well_blk_size(buf) <= sizeof(struct well_rec_hdr),
+		"blk_size %zu leaves no room for a datagram", well_blk_size(buf));
+	*ws = (struct well_sock){
+		.buf = buf,
+		.from = from,
+		.to = to,
+		.fd = fd
+	};
+die:
+	return err_cnt;
+}
+
+
+/*	top_up_()
+Hold up to 'max' (and at most WELL_SOCK_BATCH) blocks.
+Blocks reserved by the one thread on a side follow each other:
+	a new reservation extends the held one.
+
+returns the number of blocks held
+*/
+static size_t top_up_(struct well_sock *ws, size_t max)
+{
+	if (max > WELL_SOCK_BATCH)
+		max = WELL_SOCK_BATCH;
+	if (ws->held.cnt < max) {
+		struct well_res res = well_reserve(ws->from, max - ws->held.cnt);
+		if (res.cnt) {
+			if (!ws->held.cnt)
+				ws->held.pos = res.pos;
+			ws->held.cnt += res.cnt;
+		}
+	}
+	return ws->held.cnt < max ? ws->held.cnt : max;
+}
+
+/*	done_()
+Release the first 'n' held blocks.
+*/
+static void done_(struct well_sock *ws, size_t n)
+{
+	well_release_single(ws->to, n);
+	ws->held.pos += n;
+	ws->held.cnt -= n;
+}
+
+
+/*	well_sock_recv()
+Receive up to 'max' datagrams (at most WELL_SOCK_BATCH) with one recvmmsg(),
+	passing 'flags' (e.g. MSG_DONTWAIT or MSG_WAITFORONE).
+Each datagram goes into its own block, which is released once filled.
+
+returns number of datagrams received (and blocks released):
+	0 if there was nothing to receive, no free block, or an error (see errno)
+*/
+size_t well_sock_recv(struct well_sock *ws, size_t max, int flags)
+{
+	struct mmsghdr msg[WELL_SOCK_BATCH];
+	struct iovec iov[WELL_SOCK_BATCH];
+	size_t cnt = top_up_(ws, max);
+	if (!cnt)
+		return 0;
+
+	const size_t len = well_sock_payload(ws->buf);
+	for (size_t i=0; i < cnt; i++) {
+		iov[i] = (struct iovec){
+			.iov_base = well_rec_data(ws->buf, ws->held.pos + i),
+			.iov_len = len
+		};
+		msg[i] = (struct mmsghdr){ .msg_hdr = { .msg_iov = &iov[i], .msg_iovlen = 1 } };
+	}
+
+	int n = recvmmsg(ws->fd, msg, cnt, flags, NULL);
+	if (n <= 0)
+		return 0;
+	for (int i=0; i < n; i++)
+		((struct well_rec_hdr *)well_access(ws->held.pos, i, ws->buf))->len = msg[i].msg_len;
+	done_(ws, n);
+	return n;
+}
+
+
+/*	well_sock_send()
+Send up to 'max' datagrams (at most WELL_SOCK_BATCH), one per block,
+	with one sendmmsg() passing 'flags'; the socket must be connected.
+Blocks are released once sent.
+
+returns number of datagrams sent (and blocks released):
+	0 if there was nothing to send, the socket would block, or an error (see errno)
+*/
+size_t well_sock_send(struct well_sock *ws, size_t max, int flags)
+{
+	struct mmsghdr msg[WELL_SOCK_BATCH];
+	struct iovec iov[WELL_SOCK_BATCH];
+	size_t cnt = top_up_(ws, max);
+	if (!cnt)
+		return 0;
+
+	for (size_t i=0; i < cnt; i++) {
+		size_t pos = ws->held.pos + i;
+		iov[i] = (struct iovec){
+			.iov_base = well_rec_data(ws->buf, pos),
+			.iov_len = well_rec_len(ws->buf, pos)
+		};
+		msg[i] = (struct mmsghdr){ .msg_hdr = { .msg_iov = &iov[i], .msg_iovlen = 1 } };
+	}
+
+	int n = sendmmsg(ws->fd, msg, cnt, flags);
+	if (n <= 0)
+		return 0;
+	done_(ws, n);
+	return n;
+}
+
+
+/*	well_sock_flush()
+Give up on held blocks (e.g. before closing the socket):
+	they are released as empty datagrams.
+*/
+void well_sock_flush(struct well_sock *ws)
+{
+	for (size_t i=0; i < ws->held.cnt; i++)
+		((struct well_rec_hdr *)well_access(ws->held.pos, i, ws->buf))->len = 0;
+	if (ws->held.cnt)
+		done_(ws, ws->held.cnt);
+}
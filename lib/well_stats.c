@@ -0,0 +1,80 @@
+/*	well_stats.c
+
+Per-side counters: see well_stats.h
+Counting itself happens in well.c.
+*/
+#include <ndebug.h>
+#include <well_stats.h>
+
+#include <string.h>
+
+
+/*	well_stats_init()
+Start counting on both sides of 'buf', using (caller-allocated) 'mem'
+	of at least well_stats_size(buf), which must outlive 'buf'
+	and be aligned to a cache line.
+Call after well_init(), before the well is used.
+Does nothing (successfully) unless built with WELL_STATS.
+
+returns 0 on success
+*/
+int well_stats_init(struct well *buf, void *mem)
+{
+	int err_cnt = 0;
+	NB_die_if(!buf, "");
+#ifdef WELL_STATS
+	NB_die_if(!mem, "");
+	NB_die_if((uintptr_t)mem & (NLC_CACHE_LINE -1), "%p not cache-aligned", mem);
+	memset(mem, 0x0, well_stats_size(buf));
+	buf->tx.stats = mem;
+	buf->rx.stats = buf->tx.stats + WELL_STATS_SLOTS;
+#else
+	(void)mem;
+#endif
+die:
+	return err_cnt;
+}
+
+
+/*	well_stats_read()
+Add up the counters of all slots of 'sym' into '*out'.
+Counters are read one at a time while they may be changing:
+	the snapshot is consistent per counter, not across counters.
+*/
+void well_stats_read(const struct well_sym *sym, struct well_stats *out)
+{
+	memset(out, 0x0, sizeof(*out));
+	if (!sym->stats)
+		return;
+	for (size_t i=0; i < WELL_STATS_SLOTS; i++) {
+		const struct well_stats *st = &sym->stats[i].st;
+		out->reserves += __atomic_load_n(&st->reserves, __ATOMIC_RELAXED);
+		out->blocks += __atomic_load_n(&st->blocks, __ATOMIC_RELAXED);
+		out->reserve_fails += __atomic_load_n(&st->reserve_fails, __ATOMIC_RELAXED);
+		out->retries += __atomic_load_n(&st->retries, __ATOMIC_RELAXED);
+		out->release_fails += __atomic_load_n(&st->release_fails, __ATOMIC_RELAXED);
+		uint64_t hwm = __atomic_load_n(&st->hwm, __ATOMIC_RELAXED);
+		if (hwm > out->hwm)
+			out->hwm = hwm;
+	}
+}
+
+
+/*	well_stats_reset()
+Zero all counters of 'sym' (e.g. at the start of each export interval).
+Increments racing with the reset may be lost.
+*/
+void well_stats_reset(struct well_sym *sym)
+{
+	if (!sym->stats)
+		return;
+	for (size_t i=0; i < WELL_STATS_SLOTS; i++) {
+		struct well_stats *st = &sym->stats[i].st;
+		__atomic_store_n(&st->reserves, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->blocks, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->reserve_fails, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->retries, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->release_fails, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&st->hwm, 0, __ATOMIC_RELAXED);
+	}
+}
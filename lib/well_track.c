@@ -0,0 +1,227 @@
+/*	well_track.c
+
+Ownership tracking for reservations: see well_track.h
+
+Each claim slot is owned through its 'owner' word:
+	FREE -> BUSY (by a reserver) -> owner -> BUSY (by a releaser) -> FREE.
+Whoever moves 'owner' to BUSY has the slot to themselves;
+	'pos', 'cnt' and 'stamp' are only written while holding it.
+*/
+#include <ndebug.h>
+#include <well_track.h>
+
+#include <stdlib.h>
+
+
+/*	now_ns_()
+*/
+static uint64_t now_ns_()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+
+/*	well_track_init()
+Track reservations from 'from' which are released into 'to',
+	with room for 'max_claims' outstanding at once.
+
+returns 0 on success
+*/
+int well_track_init(struct well_track *tr, struct well_sym *from, struct well_sym *to,
+			size_t max_claims)
+{
+	int err_cnt = 0;
+	NB_die_if(!tr || !from || !to || !max_claims, "");
+	tr->from = from;
+	tr->to = to;
+	tr->cnt = max_claims;
+	NB_die_if(!(
+		tr->claims = aligned_alloc(NLC_CACHE_LINE, sizeof(*tr->claims) * max_claims)
+		), "%zu claims", max_claims);
+	for (size_t i=0; i < max_claims; i++)
+		tr->claims[i] = (struct well_claim){ .owner = WELL_TRACK_FREE };
+
+die:
+	return err_cnt;
+}
+
+
+/*	well_track_deinit()
+*/
+void well_track_deinit(struct well_track *tr)
+{
+	free(tr->claims);
+	tr->claims = NULL;
+}
+
+
+/*	well_track_reserve()
+Reserve up to 'max_count' blocks on behalf of 'owner', recording the claim.
+
+Returns a 'struct well_res' like well_reserve();
+	'cnt' is also 0 if 'max_claims' reservations are already outstanding.
+*/
+struct well_res well_track_reserve(struct well_track *tr, uint64_t owner, size_t max_count)
+{
+	struct well_res res = { 0 };
+	if (owner == WELL_TRACK_FREE || owner == WELL_TRACK_BUSY)
+		return res;
+
+	/* start looking at a different slot for each owner */
+	for (size_t n=0, i = owner % tr->cnt; n < tr->cnt; n++, i = (i + 1) % tr->cnt) {
+		struct well_claim *c = &tr->claims[i];
+		uint64_t expect = WELL_TRACK_FREE;
+		if (!__atomic_compare_exchange_n(&c->owner, &expect, WELL_TRACK_BUSY,
+					0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			continue;
+
+		res = well_reserve(tr->from, max_count);
+		if (!res.cnt) {
+			__atomic_store_n(&c->owner, WELL_TRACK_FREE, __ATOMIC_RELEASE);
+			return res;
+		}
+		c->pos = res.pos;
+		c->cnt = res.cnt;
+		c->stamp = now_ns_();
+		__atomic_store_n(&c->owner, owner, __ATOMIC_RELEASE);
+		return res;
+	}
+	return res;
+}
+
+
+/*	take_()
+Find the slot 'owner' holds for the reservation at 'pos' and make it BUSY.
+
+returns the slot or NULL
+*/
+static struct well_claim *take_(struct well_track *tr, uint64_t owner, size_t pos)
+{
+	for (size_t i=0; i < tr->cnt; i++) {
+		struct well_claim *c = &tr->claims[i];
+		uint64_t expect = owner;
+		if (__atomic_load_n(&c->owner, __ATOMIC_RELAXED) != owner
+			|| __atomic_load_n(&c->pos, __ATOMIC_RELAXED) != pos)
+			continue;
+		if (!__atomic_compare_exchange_n(&c->owner, &expect, WELL_TRACK_BUSY,
+					0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			continue;
+		/* slot may have been recycled between the checks above */
+		if (c->pos == pos)
+			return c;
+		__atomic_store_n(&c->owner, owner, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/*	release_()
+Release the claim 'owner' holds at 'pos', if it is that claim's turn.
+*/
+static size_t release_(struct well_track *tr, uint64_t owner, size_t pos)
+{
+	struct well_claim *c = take_(tr, owner, pos);
+	if (!c)
+		return 0;
+
+	size_t ret = well_release_multi(tr->to, (struct well_res){ .cnt = c->cnt, .pos = c->pos });
+	__atomic_store_n(&c->owner, ret ? WELL_TRACK_FREE : owner, __ATOMIC_RELEASE);
+	return ret;
+}
+
+
+/*	well_track_release()
+Release 'res', which 'owner' obtained from well_track_reserve().
+
+returns 0 on failure (not yet this reservation's turn, OR the claim
+	was forced or reassigned away: see well_track_owns()),
+	'res.cnt' on success.
+*/
+size_t well_track_release(struct well_track *tr, uint64_t owner, struct well_res res)
+{
+	if (!res.cnt)
+		return 0;
+	return release_(tr, owner, res.pos);
+}
+
+
+/*	well_track_owns()
+Returns non-zero if 'owner' still holds 'res'.
+*/
+int well_track_owns(struct well_track *tr, uint64_t owner, struct well_res res)
+{
+	for (size_t i=0; i < tr->cnt; i++) {
+		struct well_claim *c = &tr->claims[i];
+		if (__atomic_load_n(&c->owner, __ATOMIC_ACQUIRE) == owner
+			&& __atomic_load_n(&c->pos, __ATOMIC_RELAXED) == res.pos)
+			return 1;
+	}
+	return 0;
+}
+
+
+/*	well_track_oldest()
+Copy the outstanding claim with the lowest position
+	(the one every later release waits for) into '*out'.
+
+returns 0 if found, 1 if nothing is outstanding
+*/
+int well_track_oldest(struct well_track *tr, struct well_claim *out)
+{
+	int found = 0;
+	for (size_t i=0; i < tr->cnt; i++) {
+		struct well_claim *c = &tr->claims[i];
+		uint64_t owner = __atomic_load_n(&c->owner, __ATOMIC_ACQUIRE);
+		if (owner == WELL_TRACK_FREE || owner == WELL_TRACK_BUSY)
+			continue;
+		struct well_claim snap = {
+			.owner = owner,
+			.pos = __atomic_load_n(&c->pos, __ATOMIC_RELAXED),
+			.cnt = __atomic_load_n(&c->cnt, __ATOMIC_RELAXED),
+			.stamp = __atomic_load_n(&c->stamp, __ATOMIC_RELAXED)
+		};
+		/* changed hands while we were reading */
+		if (__atomic_load_n(&c->owner, __ATOMIC_ACQUIRE) != owner)
+			continue;
+		if (!found || snap.pos < out->pos)
+			*out = snap;
+		found = 1;
+	}
+	return !found;
+}
+
+
+/*	well_track_force()
+Release 'claim' (as returned by well_track_oldest()) on behalf of its owner,
+	whatever state its blocks are in.
+
+returns the number of blocks released: 0 if 'claim' changed hands
+	or was released meanwhile, or if it is not yet its turn.
+*/
+size_t well_track_force(struct well_track *tr, const struct well_claim *claim)
+{
+	return release_(tr, claim->owner, claim->pos);
+}
+
+
+/*	well_track_reassign()
+Hand 'claim' (as returned by well_track_oldest()) to 'new_owner',
+	which may then finish it and well_track_release() it
+	as { .cnt = claim->cnt, .pos = claim->pos }.
+Its age starts over.
+
+returns 0 on success
+*/
+int well_track_reassign(struct well_track *tr, const struct well_claim *claim,
+			uint64_t new_owner)
+{
+	if (new_owner == WELL_TRACK_FREE || new_owner == WELL_TRACK_BUSY)
+		return 1;
+	struct well_claim *c = take_(tr, claim->owner, claim->pos);
+	if (!c)
+		return 1;
+	c->stamp = now_ns_();
+	__atomic_store_n(&c->owner, new_owner, __ATOMIC_RELEASE);
+	return 0;
+}
@@ -0,0 +1,385 @@
+/*	well_uring.c
+
+I/O into and out of reservations through io_uring: see well_uring.h
+
+Each reservation is one op, transferred in (at most) two segments:
+	up to the end of the buffer, and from its start.
+A segment's SQE carries '(op index << 1) | segment' as user_data.
+*/
+#include <ndebug.h>
+#include <well_uring.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+#endif
+
+
+/* longest single transfer: SQE lengths are 32 bits */
+#define SEG_MAX_ (1U << 30)
+
+
+#ifdef __linux__
+/*	seg_()
+Offset in the buffer, and length, of segment 'seg' of 'op'.
+*/
+static size_t seg_(const struct well *buf, const struct well_uring_op *op,
+			unsigned seg, size_t *offt)
+{
+	size_t len = op->res.cnt << buf->ct.blk_shift;
+	size_t start = (op->res.pos << buf->ct.blk_shift) & buf->ct.overflow;
+	size_t first = well_size(buf) - start;
+	if (len < first)
+		first = len;
+	if (!seg) {
+		*offt = start;
+		return first;
+	}
+	*offt = 0;
+	return len - first;
+}
+
+/*	issue_()
+Queue an SQE for what is left of segment 'seg' of the op in slot 'idx'.
+*/
+static void issue_(struct well_uring *ur, size_t idx, unsigned seg)
+{
+	struct well_uring_op *op = &ur->ops[idx];
+	size_t offt;
+	size_t len = seg_(ur->buf, op, seg, &offt) - op->done[seg];
+	if (len > SEG_MAX_)
+		len = SEG_MAX_;
+	uint64_t off = (uint64_t)-1;
+	if (op->off >= 0)
+		off = op->off + (seg ? seg_(ur->buf, op, 0, &(size_t){0}) : 0) + op->done[seg];
+
+	unsigned tail = ur->sq_local;
+	unsigned slot = tail & ur->sq_mask;
+	struct io_uring_sqe *sqe = (struct io_uring_sqe *)ur->sqes + slot;
+	*sqe = (struct io_uring_sqe){
+		.fd = op->fd,
+		.off = off,
+		.addr = (uintptr_t)ur->buf->ct.buf + offt + op->done[seg],
+		.len = len,
+		.user_data = (idx << 1) | seg
+	};
+	if (ur->fixed) {
+		sqe->opcode = op->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->buf_index = 0;
+	} else {
+		sqe->opcode = op->write ? IORING_OP_WRITE : IORING_OP_READ;
+	}
+	ur->sq_array[slot] = slot;
+	ur->sq_local = tail + 1;
+	__atomic_store_n(ur->sq_tail, ur->sq_local, __ATOMIC_RELEASE);
+	ur->sq_pending++;
+	op->busy++;
+}
+
+/*	start_()
+Start the op in slot 'idx': a stream op goes one segment at a time.
+*/
+static void start_(struct well_uring *ur, size_t idx)
+{
+	struct well_uring_op *op = &ur->ops[idx];
+	size_t offt;
+	op->state = WELL_URING_RUNNING;
+	issue_(ur, idx, 0);
+	if (op->off < 0)
+		ur->streaming = 1;
+	else if (seg_(ur->buf, op, 1, &offt))
+		issue_(ur, idx, 1);
+}
+
+/*	next_stream_()
+The running stream op is over: start the next one queued behind it.
+*/
+static void next_stream_(struct well_uring *ur)
+{
+	ur->streaming = 0;
+	for (size_t n = ur->head; n != ur->tail; n++) {
+		size_t idx = n % ur->depth;
+		if (ur->ops[idx].state == WELL_URING_QUEUED) {
+			start_(ur, idx);
+			return;
+		}
+	}
+}
+#endif
+
+
+/*	well_uring_init()
+Set up a ring for I/O into and out of 'buf' (after well_init()),
+	with room for 'depth' reservations in flight.
+
+returns 0 on success
+*/
+int well_uring_init(struct well_uring *ur, struct well *buf, size_t depth)
+{
+	int err_cnt = 0;
+	NB_die_if(!ur || !buf || !depth, "");
+	*ur = (struct well_uring){ .buf = buf, .fd = -1, .depth = depth };
+#ifdef __linux__
+	struct io_uring_params p = { 0 };
+	NB_die_if((
+		ur->fd = syscall(SYS_io_uring_setup, (unsigned)(depth * 2), &p)
+		) < 0, "io_uring_setup()");
+	NB_die_if(!(p.features & IORING_FEAT_SINGLE_MMAP), "kernel too old");
+
+	ur->ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (cq_sz > ur->ring_sz)
+		ur->ring_sz = cq_sz;
+	ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	void *map = mmap(NULL, ur->ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+	NB_die_if(map == MAP_FAILED, "mmap() ring");
+	ur->ring_map = map;
+	map = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	NB_die_if(map == MAP_FAILED, "mmap() SQEs");
+	ur->sqes = map;
+
+	char *r = ur->ring_map;
+	ur->sq_head = (unsigned *)(r + p.sq_off.head);
+	ur->sq_tail = (unsigned *)(r + p.sq_off.tail);
+	ur->sq_mask = *(unsigned *)(r + p.sq_off.ring_mask);
+	ur->sq_array = (unsigned *)(r + p.sq_off.array);
+	ur->sq_local = *ur->sq_tail;
+	ur->cq_head = (unsigned *)(r + p.cq_off.head);
+	ur->cq_tail = (unsigned *)(r + p.cq_off.tail);
+	ur->cq_mask = *(unsigned *)(r + p.cq_off.ring_mask);
+	ur->cqes = r + p.cq_off.cqes;
+
+	/* pinning the buffer may be refused (RLIMIT_MEMLOCK): not fatal */
+	struct iovec iov = { .iov_base = well_mem(buf), .iov_len = well_size(buf) };
+	ur->fixed = !syscall(SYS_io_uring_register, ur->fd, IORING_REGISTER_BUFFERS, &iov, 1);
+	NB_wrn_if(!ur->fixed, "buffer not registered: plain reads/writes");
+
+	NB_die_if(!(
+		ur->ops = calloc(depth, sizeof(*ur->ops))
+		), "");
+	return 0;
+#else
+	NB_die("io_uring not supported on this platform");
+#endif
+die:
+	well_uring_deinit(ur);
+	return err_cnt;
+}
+
+
+/*	well_uring_deinit()
+Tear down 'ur': nothing may be in flight (see well_uring_inflight()).
+*/
+void well_uring_deinit(struct well_uring *ur)
+{
+#ifdef __linux__
+	if (ur->sqes)
+		munmap(ur->sqes, ur->sqes_sz);
+	if (ur->ring_map)
+		munmap(ur->ring_map, ur->ring_sz);
+	if (ur->fd >= 0)
+		close(ur->fd);
+#endif
+	free(ur->ops);
+	*ur = (struct well_uring){ .fd = -1 };
+}
+
+
+/*	queue_()
+*/
+static int queue_(struct well_uring *ur, struct well_res res, struct well_sym *to,
+			int fd, int64_t off, uint8_t write)
+{
+#ifdef __linux__
+	if (!res.cnt || !well_uring_space(ur))
+		return 1;
+	size_t idx = ur->tail % ur->depth;
+	ur->ops[idx] = (struct well_uring_op){
+		.res = res,
+		.to = to,
+		.off = off < 0 ? -1 : off,
+		.fd = fd,
+		.write = write,
+		.state = WELL_URING_QUEUED
+	};
+	ur->tail++;
+	if (off >= 0 || !ur->streaming)
+		start_(ur, idx);
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+/*	well_uring_read()
+Fill reservation 'res' from 'fd' (at 'off', or its current position if negative),
+	then release it into 'to'.
+Goes to the kernel with the next well_uring_submit().
+
+returns 0 if queued, non-zero if 'ur' is full (see well_uring_space())
+*/
+int well_uring_read(struct well_uring *ur, struct well_res res, struct well_sym *to,
+			int fd, int64_t off)
+{
+	return queue_(ur, res, to, fd, off, 0);
+}
+
+/*	well_uring_write()
+Write reservation 'res' to 'fd' (at 'off', or its current position if negative),
+	then release it into 'to'.
+
+returns 0 if queued, non-zero if 'ur' is full
+*/
+int well_uring_write(struct well_uring *ur, struct well_res res, struct well_sym *to,
+			int fd, int64_t off)
+{
+	return queue_(ur, res, to, fd, off, 1);
+}
+
+
+/*	well_uring_submit()
+Submit everything queued and wait for at least 'wait_nr' completions
+	(only if anything is in flight).
+
+returns 0 on success
+*/
+int well_uring_submit(struct well_uring *ur, unsigned wait_nr)
+{
+	int err_cnt = 0;
+#ifdef __linux__
+	if (!well_uring_inflight(ur))
+		wait_nr = 0;
+	if (!ur->sq_pending && !wait_nr)
+		return 0;
+	int ret = syscall(SYS_io_uring_enter, ur->fd, ur->sq_pending, wait_nr,
+			wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (ret < 0) {
+		/* interrupted, or completions must be reaped first */
+		NB_die_if(errno != EINTR && errno != EAGAIN && errno != EBUSY,
+			"io_uring_enter()");
+		return 0;
+	}
+	ur->sq_pending -= ret;
+#endif
+die:
+	return err_cnt;
+}
+
+
+/*	well_uring_complete()
+Reap completions: resubmit short transfers, and release every reservation
+	which is done, oldest first - up to the first one which failed.
+
+returns number of blocks released
+*/
+size_t well_uring_complete(struct well_uring *ur)
+{
+	size_t released = 0;
+#ifdef __linux__
+	unsigned head = *ur->cq_head;
+	unsigned tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		const struct io_uring_cqe *cqe = (struct io_uring_cqe *)ur->cqes
+						+ (head & ur->cq_mask);
+		size_t idx = cqe->user_data >> 1;
+		unsigned seg = cqe->user_data & 1;
+		struct well_uring_op *op = &ur->ops[idx];
+		size_t offt;
+		size_t len = seg_(ur->buf, op, seg, &offt);
+		op->busy--;
+
+		if (cqe->res < 0) {
+			if (!op->err)
+				op->err = cqe->res;
+		} else if (!cqe->res) {
+			/* nothing more to read; nowhere to write */
+			if (!op->err)
+				op->err = op->write ? -EIO : -ENODATA;
+		} else {
+			op->done[seg] += cqe->res;
+			if (op->done[seg] < len && !op->err) {
+				issue_(ur, idx, seg);
+				continue;
+			}
+		}
+		if (op->busy)
+			continue;
+
+		if (op->err) {
+			op->state = WELL_URING_FAILED;
+		/* stream: second segment goes after the first */
+		} else if (op->off < 0 && !seg && seg_(ur->buf, op, 1, &offt)) {
+			issue_(ur, idx, 1);
+		} else {
+			op->state = WELL_URING_DONE;
+			if (op->off < 0)
+				next_stream_(ur);
+		}
+	}
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+	while (ur->head != ur->tail) {
+		struct well_uring_op *op = &ur->ops[ur->head % ur->depth];
+		if (op->state != WELL_URING_DONE)
+			break;
+		well_release_single(op->to, op->res.cnt);
+		released += op->res.cnt;
+		ur->head++;
+	}
+#endif
+	return released;
+}
+
+
+/*	well_uring_failed()
+If the oldest reservation in 'ur' failed, describe it:
+	'*res' is the reservation and '*done' how many of its bytes
+	were transferred (e.g. up to end-of-file).
+It is not released, and holds up everything behind it,
+	until well_uring_resolve().
+
+returns 0 if nothing failed, else -errno (-ENODATA: end-of-file)
+*/
+int well_uring_failed(const struct well_uring *ur, struct well_res *res, size_t *done)
+{
+	if (ur->head == ur->tail)
+		return 0;
+	const struct well_uring_op *op = &ur->ops[ur->head % ur->depth];
+	if (op->state != WELL_URING_FAILED)
+		return 0;
+	if (res)
+		*res = op->res;
+	if (done) {
+		/* the second segment only counts if the first is complete */
+		size_t offt;
+		*done = op->done[0];
+		if (op->done[0] == seg_(ur->buf, op, 0, &offt))
+			*done += op->done[1];
+	}
+	return op->err;
+}
+
+/*	well_uring_resolve()
+Release the failed reservation reported by well_uring_failed()
+	(having e.g. zeroed what was not transferred) and carry on.
+*/
+void well_uring_resolve(struct well_uring *ur)
+{
+	if (!well_uring_failed(ur, NULL, NULL))
+		return;
+	struct well_uring_op *op = &ur->ops[ur->head % ur->depth];
+	well_release_single(op->to, op->res.cnt);
+	ur->head++;
+#ifdef __linux__
+	if (op->off < 0)
+		next_stream_(ur);
+#endif
+}
@@ -0,0 +1,147 @@
+/*	well_alloc.c
+
+Test mmap()-backed wells:
+	- plain, THP and pre-faulted mappings are 2MiB-aligned, usable
+		by a producer and a consumer thread, and unmapped by well_alloc_deinit();
+	- binding to NUMA node 0 works (it always exists);
+	- conflicting huge page kinds are refused.
+hugetlbfs pages (2MiB, then 1GiB) are tried last: each kind the administrator
+	has not reserved is skipped with a warning.
+The test only reports a skip (exit code 77) if no pass at all could run.
+*/
+
+#include <well.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+#define BLK_SIZE	64
+#define BLK_CNT		(1 << 16)	/* 4MiB: more than one huge page */
+#define NUMITER		(4 * BLK_CNT)
+#define BATCH		100
+
+
+/*	consumer()
+Pop NUMITER sequence numbers; returns how many were out of order.
+*/
+static void *consumer(void *arg)
+{
+	struct well *buf = arg;
+	uint64_t out[BATCH * BLK_SIZE / sizeof(uint64_t)];
+	size_t bad = 0;
+	for (uint64_t next = 0; next < NUMITER; ) {
+		size_t n = well_pop(buf, out, BATCH);
+		if (!n) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t i=0; i < n; i++, next++)
+			bad += out[i * BLK_SIZE / sizeof(uint64_t)] != next;
+	}
+	return (void *)bad;
+}
+
+
+/*	test_pass()
+Map a well with 'flags' on 'node', check its placement,
+	push NUMITER sequence numbers through it to a consumer thread
+	and unmap it.
+
+returns 0 on success, -1 if hugetlbfs pages were asked for but not available
+*/
+static int test_pass(unsigned flags, int node)
+{
+	int err_cnt = 0;
+	struct well buf = { {0} };
+	pthread_t cons;
+	int cons_up = 0;
+	uint64_t in[BATCH * BLK_SIZE / sizeof(uint64_t)] = { 0 };
+
+	NB_die_if(well_params(BLK_SIZE, BLK_CNT, &buf), "");
+	if (well_alloc_init(&buf, flags, node)) {
+		if (flags & (WELL_ALLOC_HUGE_2M | WELL_ALLOC_HUGE_1G))
+			return -1;
+		NB_die("flags 0x%x node %d", flags, node);
+	}
+	NB_die_if(!(buf.ct.flags & WELL_F_MAPPED), "not marked as mapped");
+	NB_die_if(!!(buf.ct.flags & WELL_F_HUGE_1G) != !!(flags & WELL_ALLOC_HUGE_1G), "");
+	uintptr_t align = (flags & WELL_ALLOC_HUGE_1G) ? (uintptr_t)1 << 30 : (uintptr_t)1 << 21;
+	NB_die_if((uintptr_t)well_mem(&buf) & (align -1),
+		"%p not aligned to 0x%zx", well_mem(&buf), (size_t)align);
+
+	NB_die_if(pthread_create(&cons, NULL, consumer, &buf), "");
+	cons_up = 1;
+	for (uint64_t next = 0; next < NUMITER; ) {
+		size_t n = BATCH;
+		if (n > NUMITER - next)
+			n = NUMITER - next;
+		for (size_t i=0; i < n; i++)
+			in[i * BLK_SIZE / sizeof(uint64_t)] = next + i;
+		size_t done = well_push(&buf, in, n);
+		if (!done)
+			FAIL_DO();
+		next += done;
+	}
+	void *bad;
+	pthread_join(cons, &bad);
+	cons_up = 0;
+	NB_die_if(bad, "flags 0x%x: %zu out of order", flags, (size_t)bad);
+
+	well_alloc_deinit(&buf);
+	NB_die_if(well_mem(&buf), "buffer still set after deinit");
+	NB_die_if(buf.ct.flags & (WELL_F_MAPPED | WELL_F_HUGE_1G), "flags not cleared");
+
+die:
+	if (cons_up)
+		pthread_join(cons, NULL);
+	if (well_mem(&buf))
+		well_alloc_deinit(&buf);
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	struct well buf = { {0} };
+	unsigned ran = 0;
+
+	NB_die_if(test_pass(0, -1), "");
+	NB_die_if(test_pass(WELL_ALLOC_THP, -1), "");
+	NB_die_if(test_pass(WELL_ALLOC_PREFAULT, -1), "");
+	NB_die_if(test_pass(WELL_ALLOC_THP | WELL_ALLOC_PREFAULT, -1), "");
+	NB_die_if(test_pass(WELL_ALLOC_PREFAULT, 0), "");
+	ran += 5;
+
+	/* more than one huge page kind */
+	NB_die_if(well_params(BLK_SIZE, BLK_CNT, &buf), "");
+	NB_die_if(!well_alloc_init(&buf, WELL_ALLOC_HUGE_2M | WELL_ALLOC_THP, -1),
+		"accepted both hugetlbfs and THP");
+	NB_die_if(well_mem(&buf), "");
+
+	/* deinit of a well that was never mapped is harmless */
+	well_alloc_deinit(&buf);
+
+	int ret = test_pass(WELL_ALLOC_HUGE_2M | WELL_ALLOC_PREFAULT, -1);
+	NB_die_if(ret > 0, "");
+	if (ret < 0)
+		NB_wrn("no 2MiB hugetlbfs pages: skipping that pass");
+	else
+		ran++;
+	ret = test_pass(WELL_ALLOC_HUGE_1G, -1);
+	NB_die_if(ret > 0, "");
+	if (ret < 0)
+		NB_wrn("no 1GiB hugetlbfs pages: skipping that pass");
+	else
+		ran++;
+
+	if (!ran)
+		return 77;
+die:
+	return err_cnt;
+}
@@ -0,0 +1,122 @@
+/*	well_backoff.c
+
+Test adaptive backoff:
+	- phases go spin -> yield -> park;
+	- budgets adapt to the phase in which waits succeed, within policy bounds;
+	- well_reserve_backoff() returns once another thread releases.
+*/
+
+#include <well_backoff.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+
+static const struct well_backoff_policy pol = {
+	.spin_min = 8,
+	.spin_max = 1024,
+	.yield_max = 4,
+	.park_ns = 10000
+};
+
+
+/*	test_phases()
+*/
+static int test_phases()
+{
+	int err_cnt = 0;
+	struct well_backoff bo;
+	well_backoff_init(&bo, &pol);
+	NB_die_if(bo.spin_limit < pol.spin_min || bo.spin_limit > pol.spin_max,
+		"spin limit %u", bo.spin_limit);
+
+	int phase = WELL_BACKOFF_SPIN;
+	int prev = phase;
+	for (int i=0; i < 100 && phase != WELL_BACKOFF_PARK; i++) {
+		phase = well_backoff_once(&bo);
+		NB_die_if(phase < prev, "phase went back from %d to %d", prev, phase);
+		prev = phase;
+	}
+	NB_die_if(phase != WELL_BACKOFF_PARK, "never parked");
+
+	/* parking shrinks the spin budget */
+	uint32_t before = bo.spin_limit;
+	well_backoff_done(&bo);
+	NB_die_if(bo.spin_limit >= before, "spin limit %u -> %u after park",
+		before, bo.spin_limit);
+
+	/* spinning always pays: grows up to, never beyond, spin_max */
+	for (int i=0; i < 1000; i++) {
+		well_backoff_once(&bo);
+		well_backoff_done(&bo);
+	}
+	NB_die_if(bo.spin_limit != pol.spin_max, "spin limit %u", bo.spin_limit);
+
+	/* always parking: shrinks down to, never below, spin_min */
+	for (int i=0; i < 100; i++) {
+		while (well_backoff_once(&bo) != WELL_BACKOFF_PARK)
+			;
+		well_backoff_done(&bo);
+	}
+	NB_die_if(bo.spin_limit != pol.spin_min, "spin limit %u", bo.spin_limit);
+	NB_die_if(bo.yield_limit != pol.yield_max, "yield limit %u", bo.yield_limit);
+
+die:
+	return err_cnt;
+}
+
+
+/*	releaser()
+Release one block into 'rx' after a while.
+*/
+static void *releaser(void *arg)
+{
+	struct well *buf = arg;
+	usleep(20000);
+	well_release_single(&buf->rx, 1);
+	return NULL;
+}
+
+/*	test_reserve()
+*/
+static int test_reserve()
+{
+	int err_cnt = 0;
+	struct well buf = { {0} };
+	pthread_t tid;
+	int started = 0;
+	struct well_backoff bo;
+	well_backoff_init(&bo, &pol);
+
+	NB_die_if(well_params(sizeof(size_t), 16, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(pthread_create(&tid, NULL, releaser, &buf), "");
+	started = 1;
+
+	struct well_res res = well_reserve_backoff(&buf.rx, 4, &bo);
+	NB_die_if(res.cnt != 1, "reserved %zu", res.cnt);
+	/* waited long enough to park: budgets shrank */
+	NB_die_if(bo.spin_limit >= pol.spin_min + (pol.spin_max - pol.spin_min) / 2,
+		"spin limit %u", bo.spin_limit);
+
+die:
+	if (started)
+		pthread_join(tid, NULL);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	NB_die_if(test_phases(), "");
+	NB_die_if(test_reserve(), "");
+die:
+	return err_cnt;
+}
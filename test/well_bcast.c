@@ -0,0 +1,112 @@
+/*	well_bcast.c
+
+Test broadcast fan-out:
+	- every consumer sees every block, in order;
+	- a consumer which stops reading is detached by the producer
+		and does not hold up the others.
+*/
+
+#include <well_bcast.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <pthread.h>
+
+
+#define CONSUMER_CNT	3
+#define BLK_CNT		256
+#define NUMITER		500000
+#define RESERVATION	16
+#define MAX_STALL	10000	/* failed reserves before detaching */
+
+
+static struct well_bcast bc;
+static size_t stall_after = NUMITER; /* consumer 0 stops reading here */
+
+
+/*	consumer()
+Returns number of blocks seen out of order.
+*/
+static void *consumer(void *arg)
+{
+	size_t idx = (size_t)arg;
+	size_t bad = 0;
+	size_t stop = idx ? NUMITER : stall_after;
+
+	for (size_t i=0; i < stop; ) {
+		struct well_res res = well_bcast_read(&bc, idx, RESERVATION);
+		if (!res.cnt) {
+			/* detached for lagging (possible before stalling, if slow) */
+			if (!well_bcast_attached(&bc, idx))
+				break;
+			FAIL_DO();
+			continue;
+		}
+		size_t batch_bad = 0;
+		for (size_t j=0; j < res.cnt; j++, i++)
+			batch_bad += (WELL_DEREF(size_t, res.pos, j, &bc.buf) != i);
+		/* blocks may have been overwritten if we were detached meanwhile */
+		if (well_bcast_attached(&bc, idx))
+			bad += batch_bad;
+		well_bcast_done(&bc, idx, res);
+	}
+	return (void *)bad;
+}
+
+
+/*	run()
+*/
+static int run(size_t max_stall)
+{
+	int err_cnt = 0;
+	pthread_t tid[CONSUMER_CNT];
+	size_t started = 0;
+
+	NB_die_if(well_bcast_init(&bc, CONSUMER_CNT, sizeof(size_t), BLK_CNT, max_stall), "");
+	for (; started < CONSUMER_CNT; started++)
+		NB_die_if(pthread_create(&tid[started], NULL, consumer, (void *)started), "");
+
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_bcast_reserve(&bc, RESERVATION);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++, i++)
+			WELL_DEREF(size_t, res.pos, j, &bc.buf) = i;
+		well_bcast_publish(&bc, res);
+	}
+
+	for (; started; started--) {
+		void *bad;
+		pthread_join(tid[started -1], &bad);
+		NB_die_if(bad, "consumer %zu: %zu blocks out of order", started -1, (size_t)bad);
+	}
+	NB_die_if(stall_after < NUMITER
+		&& well_bcast_attached(&bc, 0), "stalled consumer never detached");
+	NB_die_if(!well_bcast_attached(&bc, 1), "consumer 1 detached");
+
+die:
+	for (; started; started--)
+		pthread_join(tid[started -1], NULL);
+	well_bcast_deinit(&bc);
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+
+	/* everyone keeps up */
+	NB_die_if(run(0), "");
+
+	/* consumer 0 stalls: producer must detach it to finish */
+	stall_after = NUMITER / 4;
+	NB_die_if(run(MAX_STALL), "");
+
+die:
+	return err_cnt;
+}
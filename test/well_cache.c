@@ -0,0 +1,186 @@
+/*	well_cache.c
+
+Test per-thread reservation caches:
+	- chunks never exceed 'cap';
+	- committed blocks are only visible once the chunk is done or flushed;
+	- flushing gives held blocks back, unless someone reserved after them;
+	- single-block producers/consumers move every block, in order;
+	- several producers with WELL_CACHE_OOO caches lose nothing.
+*/
+
+#include <well_cache.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+#define BLK_CNT		256
+#define CAP		32
+#define NUMITER		500000
+#define PRODUCERS	2
+#define FILLER		((size_t)-1)	/* ignored by consumer */
+
+
+static struct well buf;
+
+
+/*	test_flush()
+With every technique: each gives blocks back its own way.
+*/
+static int test_flush(uint8_t technique)
+{
+	int err_cnt = 0;
+	struct well_cache c;
+	buf = (struct well){ {0} };
+	NB_die_if(well_params(sizeof(size_t), BLK_CNT, &buf), "");
+	NB_die_if(well_init_technique(&buf, malloc(well_size(&buf)), technique), "");
+	well_cache_init(&c, &buf.tx, &buf.rx, CAP, 0);
+
+	for (size_t i=0; i < 3; i++) {
+		struct well_res res = well_cache_next(&c);
+		NB_die_if(res.cnt != 1, "next returned %zu", res.cnt);
+		WELL_DEREF(size_t, res.pos, 0, &buf) = i;
+		well_cache_commit(&c);
+	}
+	NB_die_if(c.res.cnt != CAP, "chunk of %zu, cap %d", c.res.cnt, CAP);
+	NB_die_if(well_cache_held(&c) != CAP - 3, "held %zu", well_cache_held(&c));
+	NB_die_if(buf.rx.avail, "%zu visible before flush", buf.rx.avail);
+	NB_die_if(well_cache_flush(&c), "held blocks not given back");
+	NB_die_if(buf.rx.avail != 3, "%zu visible after flush", buf.rx.avail);
+	NB_die_if(well_cache_held(&c), "held %zu after flush", well_cache_held(&c));
+	NB_die_if(buf.tx.avail != BLK_CNT - 3, "%zu free after flush", buf.tx.avail);
+
+	/* next chunk picks up where the last one was cut short */
+	NB_die_if(well_cache_next(&c).cnt != 1, "no refill");
+	NB_die_if(c.res.cnt != CAP || c.res.pos != 3, "chunk of %zu at %zu", c.res.cnt, c.res.pos);
+
+	/* can't move past the chunk while a block is outstanding */
+	while (well_cache_held(&c))
+		NB_die_if(!well_cache_next(&c).cnt, "");
+	NB_die_if(well_cache_next(&c).cnt, "refilled with uncommitted blocks");
+	for (size_t i=0; i < CAP; i++)
+		well_cache_commit(&c);
+	NB_die_if(buf.rx.avail != CAP + 3, "%zu visible after chunk done", buf.rx.avail);
+	NB_die_if(well_cache_next(&c).cnt != 1, "no refill");
+
+	/* a later reservation pins the held blocks */
+	struct well_res later = well_reserve(&buf.tx, 1);
+	NB_die_if(later.cnt != 1, "");
+	NB_die_if(well_cache_flush(&c) != CAP - 1, "gave back blocks under a later reservation");
+	NB_die_if(well_cache_held(&c) != CAP - 1, "");
+
+die:
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
+
+
+/*	producer()
+Push 'arg' consecutive values starting from 0, one block at a time.
+*/
+static void *producer(void *arg)
+{
+	size_t num = (size_t)arg;
+	struct well_cache c;
+	well_cache_init(&c, &buf.tx, &buf.rx, CAP, num < NUMITER ? WELL_CACHE_OOO : 0);
+
+	for (size_t i=0; i < num; ) {
+		struct well_res res = well_cache_next(&c);
+		if (!res.cnt) {
+			/* let the consumer see what we have before waiting */
+			well_cache_flush(&c);
+			FAIL_DO();
+			continue;
+		}
+		WELL_DEREF(size_t, res.pos, 0, &buf) = i++;
+		well_cache_commit(&c);
+	}
+	/* blocks which can't be given back would hold up the other producer's releases */
+	if (well_cache_flush(&c)) {
+		while (well_cache_held(&c)) {
+			struct well_res res = well_cache_next(&c);
+			WELL_DEREF(size_t, res.pos, 0, &buf) = FILLER;
+			well_cache_commit(&c);
+		}
+	}
+	return NULL;
+}
+
+/*	run()
+'producers' threads, one consumer (this one);
+	returns sum of values seen, or -1 if a single producer's values
+	were out of order.
+*/
+static size_t run(size_t producers)
+{
+	int err_cnt = 0;
+	pthread_t tid[PRODUCERS];
+	size_t started = 0;
+	size_t sum = 0;
+	void *ooo = NULL;
+
+	buf = (struct well){ {0} };
+	NB_die_if(well_params(sizeof(size_t), BLK_CNT, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(!(ooo = malloc(well_ooo_size(&buf))), "");
+	NB_die_if(well_ooo_init(&buf, ooo), "");
+
+	for (; started < producers; started++)
+		NB_die_if(pthread_create(&tid[started], NULL, producer,
+				(void *)(NUMITER / producers)), "");
+
+	struct well_cache c;
+	well_cache_init(&c, &buf.rx, &buf.tx, CAP, 0);
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_cache_next(&c);
+		if (!res.cnt) {
+			well_cache_flush(&c);
+			FAIL_DO();
+			continue;
+		}
+		size_t val = WELL_DEREF(size_t, res.pos, 0, &buf);
+		well_cache_commit(&c);
+		if (val == FILLER)
+			continue;
+		if (producers == 1 && val != i)
+			sum = (size_t)-1;
+		if (sum != (size_t)-1)
+			sum += val;
+		i++;
+	}
+
+die:
+	for (; started; started--)
+		pthread_join(tid[started -1], NULL);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	free(ooo);
+	return err_cnt ? (size_t)-1 : sum;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	const uint8_t techniques[] = { WELL_DO_CAS, WELL_DO_XCH, WELL_DO_MTX,
+					WELL_DO_SPL, WELL_DO_TKT };
+	for (size_t i=0; i < sizeof(techniques); i++)
+		NB_die_if(test_flush(techniques[i]), "%s", well_technique_name(techniques[i]));
+
+	size_t expect = (size_t)NUMITER * (NUMITER -1) / 2;
+	size_t sum = run(1);
+	NB_die_if(sum != expect, "1 producer: sum %zu != %zu", sum, expect);
+
+	size_t per = NUMITER / PRODUCERS;
+	expect = PRODUCERS * (per * (per -1) / 2);
+	sum = run(PRODUCERS);
+	NB_die_if(sum != expect, "%d producers: sum %zu != %zu", PRODUCERS, sum, expect);
+
+die:
+	return err_cnt;
+}
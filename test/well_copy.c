@@ -0,0 +1,140 @@
+/*	well_copy.c
+
+Test bulk copy-in/copy-out:
+	- data survives wrapping past the end of the buffer;
+	- pushing into a full well is partial, popping from an empty one is 0;
+	- large pushes (streaming stores) are seen by a consumer thread.
+*/
+
+#include <well.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+/*	test_wrap()
+*/
+static int test_wrap()
+{
+	int err_cnt = 0;
+	struct well buf = { {0} };
+	uint64_t in[48], out[48];
+	uint64_t next_in = 0, next_out = 0;
+
+	NB_die_if(well_params(sizeof(uint64_t), 64, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+
+	/* odd-sized batches walk every offset around the buffer */
+	for (size_t i=0; i < 100; i++) {
+		size_t n = 1 + i % 48;
+		for (size_t j=0; j < n; j++)
+			in[j] = next_in + j;
+		size_t pushed = well_push(&buf, in, n);
+		NB_die_if(pushed != n, "pushed %zu of %zu", pushed, n);
+		next_in += n;
+
+		size_t popped = well_pop(&buf, out, n);
+		NB_die_if(popped != n, "popped %zu of %zu", popped, n);
+		for (size_t j=0; j < n; j++, next_out++)
+			NB_die_if(out[j] != next_out, "got %lu expected %lu",
+				(unsigned long)out[j], (unsigned long)next_out);
+	}
+
+	/* full and empty */
+	NB_die_if(well_push(&buf, in, 48) != 48, "");
+	NB_die_if(well_push(&buf, in, 48) != 16, "push into full well not partial");
+	NB_die_if(well_push(&buf, in, 1), "push into full well");
+	NB_die_if(well_pop(&buf, out, 48) != 48, "");
+	NB_die_if(well_pop(&buf, out, 48) != 16, "");
+	NB_die_if(well_pop(&buf, out, 1), "pop from empty well");
+
+die:
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
+
+
+#define BIG_BLK		4096
+#define BIG_CNT		256
+#define BIG_BATCH	96	/* 384KiB: large enough to stream */
+#define BIG_ITER	64
+
+/*	consumer()
+Pops BIG_ITER batches, returns number of bad words.
+*/
+static void *consumer(void *arg)
+{
+	struct well *buf = arg;
+	size_t bad = 0;
+	uint64_t *out = malloc(BIG_BATCH * BIG_BLK);
+	size_t words = BIG_BATCH * BIG_BLK / sizeof(uint64_t);
+
+	for (size_t i=0; out && i < BIG_ITER * words; ) {
+		size_t n = well_pop(buf, out, BIG_BATCH);
+		if (!n) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < n * BIG_BLK / sizeof(uint64_t); j++, i++)
+			bad += (out[j] != i);
+	}
+	free(out);
+	return (void *)(out ? bad : (size_t)-1);
+}
+
+/*	test_stream()
+*/
+static int test_stream()
+{
+	int err_cnt = 0;
+	struct well buf = { {0} };
+	uint64_t *in = NULL;
+	pthread_t tid;
+	int started = 0;
+	size_t words = BIG_BATCH * BIG_BLK / sizeof(uint64_t);
+
+	NB_die_if(well_params(BIG_BLK, BIG_CNT, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(!(in = malloc(BIG_BATCH * BIG_BLK)), "");
+	NB_die_if(pthread_create(&tid, NULL, consumer, &buf), "");
+	started = 1;
+
+	for (size_t i=0; i < BIG_ITER; i++) {
+		for (size_t j=0; j < words; j++)
+			in[j] = i * words + j;
+		/* a full well takes part of a batch: push the rest after */
+		for (size_t done = 0; done < BIG_BATCH; ) {
+			size_t n = well_push(&buf, (char *)in + done * BIG_BLK,
+						BIG_BATCH - done);
+			if (!n)
+				FAIL_DO();
+			done += n;
+		}
+	}
+
+die:
+	if (started) {
+		void *bad;
+		pthread_join(tid, &bad);
+		NB_err_if(bad, "consumer: %zu bad words", (size_t)bad);
+	}
+	free(in);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	NB_die_if(test_wrap(), "");
+	NB_die_if(test_stream(), "");
+die:
+	return err_cnt;
+}
@@ -0,0 +1,141 @@
+/*	well_file.c
+
+Test file streaming:
+	worker threads fill a file through a well, in parallel;
+	then other workers read it back through a well and verify it.
+*/
+
+#include <well_file.h>
+
+#include <ndebug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+
+#define WORKER_CNT	3
+#define BLK_SIZE	16384
+#define BLK_CNT		8
+#define FILE_SZ		(BLK_SIZE * 300 + 1234)	/* last block is short */
+#define RESERVATION	3
+
+
+/*	pattern()
+Expected byte at file offset 'offt'.
+*/
+static inline unsigned char pattern(size_t offt)
+{
+	return offt * 31 + (offt >> 12);
+}
+
+
+static struct well_file *wf_shared = NULL;
+static size_t blk_seen = 0; /* number of blocks processed by all workers */
+
+/*	writer()
+*/
+static void *writer(void *arg)
+{
+	struct well_file *wf = wf_shared;
+	struct well_res res;
+
+	while ((res = well_file_next(wf, RESERVATION)).cnt) {
+		for (size_t i=0; i < res.cnt; i++) {
+			unsigned char *data = well_access(res.pos, i, &wf->buf);
+			size_t offt = well_file_offt(wf, res.pos, i);
+			size_t len = well_file_len(wf, res.pos, i);
+			for (size_t j=0; j < len; j++)
+				data[j] = pattern(offt + j);
+		}
+		__atomic_fetch_add(&blk_seen, res.cnt, __ATOMIC_RELAXED);
+		well_file_release(wf, res);
+	}
+	return NULL;
+}
+
+/*	reader()
+Returns number of corrupt bytes.
+*/
+static void *reader(void *arg)
+{
+	struct well_file *wf = wf_shared;
+	struct well_res res;
+	size_t bad = 0;
+
+	while ((res = well_file_next(wf, RESERVATION)).cnt) {
+		for (size_t i=0; i < res.cnt; i++) {
+			const unsigned char *data = well_access(res.pos, i, &wf->buf);
+			size_t offt = well_file_offt(wf, res.pos, i);
+			size_t len = well_file_len(wf, res.pos, i);
+			for (size_t j=0; j < len; j++)
+				bad += (data[j] != pattern(offt + j));
+		}
+		__atomic_fetch_add(&blk_seen, res.cnt, __ATOMIC_RELAXED);
+		well_file_release(wf, res);
+	}
+	return (void *)bad;
+}
+
+
+/*	run()
+Pump 'wf' from this thread while WORKER_CNT threads run 'worker'.
+Returns the sum of what workers returned.
+*/
+static size_t run(struct well_file *wf, void *(*worker)(void *))
+{
+	int err_cnt = 0;
+	pthread_t tid[WORKER_CNT];
+	size_t started = 0;
+	size_t ret = 0;
+
+	wf_shared = wf;
+	blk_seen = 0;
+	for (; started < WORKER_CNT; started++)
+		NB_die_if(pthread_create(&tid[started], NULL, worker, NULL), "");
+	NB_die_if(well_file_pump(wf), "");
+
+die:
+	for (size_t i=0; i < started; i++) {
+		void *res;
+		pthread_join(tid[i], &res);
+		ret += (size_t)res;
+	}
+	return ret + err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	struct well_file wf = { .fd = -1 };
+	char path[] = "/tmp/well_file_test.XXXXXX";
+	int fd = -1;
+
+	NB_die_if((
+		fd = mkstemp(path)
+		) == -1, "");
+	close(fd);
+
+	/* write */
+	NB_die_if(well_file_open_write(&wf, path, FILE_SZ, BLK_SIZE, BLK_CNT), "");
+	NB_die_if(run(&wf, writer), "");
+	well_file_close(&wf);
+	NB_die_if(blk_seen != (FILE_SZ + BLK_SIZE -1) / BLK_SIZE,
+		"wrote %zu blocks", blk_seen);
+
+	/* read back */
+	NB_die_if(well_file_open_read(&wf, path, BLK_SIZE, BLK_CNT), "");
+	NB_die_if(wf.file_sz != FILE_SZ, "file size %zu", wf.file_sz);
+	size_t bad = run(&wf, reader);
+	NB_die_if(bad, "%zu corrupt bytes", bad);
+	NB_die_if(blk_seen != wf.blk_total, "read %zu of %zu blocks", blk_seen, wf.blk_total);
+
+die:
+	well_file_close(&wf);
+	if (fd != -1)
+		unlink(path);
+	return err_cnt;
+}
@@ -0,0 +1,134 @@
+/*	well_group.c
+
+Test sharded well groups:
+	- with stealing: every block pushed is consumed exactly once;
+	- without stealing: each shard (one consumer each) is a FIFO.
+*/
+
+#include <well_group.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+#define SHARD_CNT	4	/* one producer and one consumer per shard */
+#define NUMITER		200000	/* blocks per producer */
+#define RESERVATION	16
+
+
+static struct well_group grp;
+static unsigned char *seen = NULL; /* [producer][seq]: times consumed */
+static size_t consumed = 0; /* total, all consumers */
+static size_t fifo_errors = 0;
+
+
+/*	producer()
+Push 'producer << 32 | seq' into the local shard.
+*/
+static void *producer(void *arg)
+{
+	size_t local = (size_t)arg;
+	for (size_t i=0; i < NUMITER; ) {
+		size_t want = NUMITER - i < RESERVATION ? NUMITER - i : RESERVATION;
+		struct well_gres res = well_group_produce(&grp, local, want);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++, i++)
+			WELL_DEREF(uint64_t, res.pos, j, res.shard) = (uint64_t)local << 32 | i;
+		well_group_produced(res);
+	}
+	return NULL;
+}
+
+/*	consumer()
+Consume until all blocks from all producers have been seen.
+Without stealing, also check that blocks arrive in the order pushed.
+*/
+static void *consumer(void *arg)
+{
+	size_t local = (size_t)arg;
+	size_t next = 0; /* expected seq when not stealing */
+
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < SHARD_CNT * NUMITER) {
+		struct well_gres res = well_group_consume(&grp, local, RESERVATION);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++) {
+			uint64_t val = WELL_DEREF(uint64_t, res.pos, j, res.shard);
+			size_t from = val >> 32;
+			size_t seq = val & UINT32_MAX;
+			__atomic_fetch_add(&seen[from * NUMITER + seq], 1, __ATOMIC_RELAXED);
+
+			if ((grp.flags & WELL_GROUP_NO_STEAL) && (from != local || seq != next++))
+				__atomic_fetch_add(&fifo_errors, 1, __ATOMIC_RELAXED);
+		}
+		__atomic_fetch_add(&consumed, res.cnt, __ATOMIC_RELAXED);
+		well_group_consumed(res);
+	}
+	return NULL;
+}
+
+
+/*	run()
+*/
+static int run(unsigned flags)
+{
+	int err_cnt = 0;
+	pthread_t tx[SHARD_CNT], rx[SHARD_CNT];
+	size_t tx_started = 0, rx_started = 0;
+
+	NB_die_if(well_group_init(&grp, SHARD_CNT, sizeof(uint64_t), 256, flags,
+			WELL_TECHNIQUE), "");
+	consumed = 0;
+	fifo_errors = 0;
+	NB_die_if(!(
+		seen = calloc(SHARD_CNT, NUMITER)
+		), "");
+
+	for (; rx_started < SHARD_CNT; rx_started++)
+		NB_die_if(pthread_create(&rx[rx_started], NULL, consumer, (void *)rx_started), "");
+	for (; tx_started < SHARD_CNT; tx_started++)
+		NB_die_if(pthread_create(&tx[tx_started], NULL, producer, (void *)tx_started), "");
+
+	/* consumers only stop once everything was produced */
+	for (; tx_started; tx_started--)
+		pthread_join(tx[tx_started -1], NULL);
+	for (; rx_started; rx_started--)
+		pthread_join(rx[rx_started -1], NULL);
+
+	for (size_t i=0; i < SHARD_CNT * NUMITER; i++)
+		NB_die_if(seen[i] != 1, "producer %zu seq %zu consumed %d times",
+			i / NUMITER, i % NUMITER, seen[i]);
+	NB_die_if(fifo_errors, "%zu blocks out of order", fifo_errors);
+
+die:
+	for (; tx_started; tx_started--)
+		pthread_join(tx[tx_started -1], NULL);
+	/* not everything was produced: stop consumers */
+	__atomic_store_n(&consumed, SHARD_CNT * NUMITER, __ATOMIC_RELAXED);
+	for (; rx_started; rx_started--)
+		pthread_join(rx[rx_started -1], NULL);
+
+	free(seen);
+	seen = NULL;
+	well_group_deinit(&grp);
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	NB_die_if(run(0), "stealing");
+	NB_die_if(run(WELL_GROUP_NO_STEAL), "no stealing");
+die:
+	return err_cnt;
+}
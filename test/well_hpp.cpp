@@ -0,0 +1,77 @@
+/*	well_hpp.cpp
+
+Test the C++ wrapper: typed RAII reservations and range-for iteration,
+	with multiple producers releasing out-of-order.
+*/
+
+#include <well.hpp>
+
+#include <ndebug.h>
+#include <pthread.h>
+
+
+struct item {
+	size_t	seq;
+	size_t	check;
+};
+
+static const size_t numiter = 100000; /* items per producer */
+static const size_t tx_thread_cnt = 2;
+
+typedef memorywell::Well<item, 64, memorywell::ooo, memorywell::single> well_t;
+
+
+/*	tx_thread()
+*/
+static void *tx_thread(void *arg)
+{
+	well_t *w = static_cast<well_t *>(arg);
+	size_t tally = 0;
+
+	for (size_t i=0; i < numiter; ) {
+		/* released on leaving scope */
+		auto res = w->produce_wait(numiter - i < 7 ? numiter - i : 7);
+		for (item &it : res) {
+			it.seq = i++;
+			it.check = ~it.seq;
+			tally += it.seq;
+		}
+	}
+	return reinterpret_cast<void *>(tally);
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	well_t w;
+	pthread_t tx[tx_thread_cnt];
+	size_t tx_sum = 0, rx_sum = 0;
+
+	NB_die_if(well_t::blk_size != 16, "blk_size %zu", well_t::blk_size);
+	NB_die_if(well_blk_count(w.c_well()) != 64,
+		"blk_count %zu", well_blk_count(w.c_well()));
+
+	for (size_t i=0; i < tx_thread_cnt; i++)
+		NB_die_if(pthread_create(&tx[i], NULL, tx_thread, &w), "");
+
+	for (size_t i=0; i < numiter * tx_thread_cnt; ) {
+		auto res = w.consume_wait(5);
+		for (size_t j=0; j < res.size(); j++, i++) {
+			NB_die_if(res[j].check != ~res[j].seq, "item %zu corrupt", i);
+			rx_sum += res[j].seq;
+		}
+	}
+
+	for (size_t i=0; i < tx_thread_cnt; i++) {
+		void *tmp;
+		pthread_join(tx[i], &tmp);
+		tx_sum += reinterpret_cast<size_t>(tmp);
+	}
+	NB_die_if(tx_sum != rx_sum, "%zu != %zu", tx_sum, rx_sum);
+
+die:
+	return err_cnt;
+}
@@ -0,0 +1,178 @@
+/*	well_notify.c
+
+Test eventfd notification:
+	- an empty side is not readable; a non-empty one is from the start;
+	- a burst of releases into an armed side signals exactly once;
+	- an epoll-driven consumer receives everything a bursty producer
+		sends, without ever timing out (no lost wake-ups);
+	- deinit while another thread keeps releasing never lets a write
+		reach whatever reuses the closed fd;
+	- wells shared between processes are refused.
+*/
+
+#include <well_notify.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+
+#define NUMITER		100000
+#define BURST		37
+#define CYCLES		2000
+
+
+static struct well buf = { {0} };
+static size_t seen = 0;
+static struct well churn = { {0} };
+static int churn_stop = 0;
+
+
+/*	producer()
+Push NUMITER values in bursts, pausing between bursts
+	so the consumer keeps going back to epoll_wait().
+*/
+static void *producer(void *arg)
+{
+	for (size_t i=0; i < NUMITER; ) {
+		for (size_t j=0; j < BURST && i < NUMITER; ) {
+			struct well_res res = well_reserve(&buf.tx, 1);
+			if (!res.cnt) {
+				usleep(10);
+				continue;
+			}
+			WELL_DEREF(size_t, res.pos, 0, &buf) = i++;
+			well_release_single(&buf.rx, 1);
+			j++;
+		}
+		usleep(50);
+	}
+	return NULL;
+}
+
+/*	churner()
+Bounce one block between the sides of 'churn' until told to stop:
+	every release into 'rx' may find it armed.
+*/
+static void *churner(void *arg)
+{
+	while (!__atomic_load_n(&churn_stop, __ATOMIC_RELAXED)) {
+		struct well_res res = well_reserve(&churn.tx, 1);
+		if (res.cnt)
+			well_release_single(&churn.rx, 1);
+		if ((res = well_reserve(&churn.rx, 1)).cnt)
+			well_release_single(&churn.tx, 1);
+	}
+	return NULL;
+}
+
+/*	consume()
+Check order, hand blocks back.
+*/
+static void consume(struct well_res res, void *arg)
+{
+	int *err = arg;
+	for (size_t i=0; i < res.cnt; i++)
+		if (WELL_DEREF(size_t, res.pos, i, &buf) != seen++)
+			*err = 1;
+	well_release_single(&buf.tx, res.cnt);
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	int ep = -1;
+	uint64_t cnt;
+	struct epoll_event ev;
+
+	NB_die_if(well_params(sizeof(size_t), 64, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+
+	/* tx starts out full: readable at once */
+	NB_die_if(well_notify_init(&buf.tx), "");
+	NB_die_if(read(well_notify_fd(&buf.tx), &cnt, sizeof(cnt)) != sizeof(cnt), "");
+	well_notify_deinit(&buf.tx);
+	NB_die_if(well_notify_fd(&buf.tx) != -1, "");
+
+	NB_die_if(well_notify_init(&buf.rx), "");
+	NB_die_if((ep = epoll_create1(0)) < 0, "");
+	ev = (struct epoll_event){ .events = EPOLLIN | EPOLLET };
+	NB_die_if(epoll_ctl(ep, EPOLL_CTL_ADD, well_notify_fd(&buf.rx), &ev), "");
+	NB_die_if(epoll_wait(ep, &ev, 1, 0), "empty side is readable");
+
+	/* burst into an armed side: one write */
+	for (size_t i=0; i < 10; i++) {
+		struct well_res res = well_reserve(&buf.tx, 1);
+		WELL_DEREF(size_t, res.pos, 0, &buf) = i;
+		well_release_single(&buf.rx, 1);
+	}
+	NB_die_if(epoll_wait(ep, &ev, 1, 0) != 1, "no event");
+	NB_die_if(read(well_notify_fd(&buf.rx), &cnt, sizeof(cnt)) != sizeof(cnt), "");
+	NB_die_if(cnt != 1, "%lu writes for one burst", (unsigned long)cnt);
+
+	/* re-arming with blocks left must say so */
+	NB_die_if(!well_notify_rearm(&buf.rx), "armed a non-empty side");
+	int bad = 0;
+	NB_die_if(well_notify_drain(&buf.rx, 4, consume, &bad) != 10 || bad, "");
+	NB_die_if(epoll_wait(ep, &ev, 1, 0), "drained side is readable");
+
+	/* threads: epoll-driven consumer */
+	pthread_t tid;
+	NB_die_if(pthread_create(&tid, NULL, producer, NULL), "");
+	seen = 0;
+	while (seen < NUMITER) {
+		NB_die_if(epoll_wait(ep, &ev, 1, 1000) != 1, "lost wake-up at %zu", seen);
+		well_notify_drain(&buf.rx, 16, consume, &bad);
+	}
+	pthread_join(tid, NULL);
+	NB_die_if(bad, "out of order");
+
+	/* deinit under concurrent releases: the fd it closed is reused at once */
+	NB_die_if(well_params(sizeof(size_t), 1, &churn), "");
+	NB_die_if(well_init(&churn, malloc(well_size(&churn))), "");
+	NB_die_if(pthread_create(&tid, NULL, churner, NULL), "");
+	int stray = 0;
+	for (size_t i=0; i < CYCLES && !stray; i++) {
+		NB_die_if(well_notify_init(&churn.rx), "");
+		for (int j=0; j < 100; j++)
+			well_notify_rearm(&churn.rx);
+		well_notify_deinit(&churn.rx);
+		int probe = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		NB_die_if(probe < 0, "");
+		sched_yield();
+		stray = read(probe, &cnt, sizeof(cnt)) != -1 || errno != EAGAIN;
+		close(probe);
+	}
+	__atomic_store_n(&churn_stop, 1, __ATOMIC_RELAXED);
+	pthread_join(tid, NULL);
+	NB_die_if(stray, "release wrote to a closed eventfd");
+	well_deinit(&churn);
+	free(well_mem(&churn));
+	churn = (struct well){ {0} };
+
+	/* shared between processes */
+	NB_die_if(well_params(sizeof(size_t), 4, &churn), "");
+	churn.ct.flags |= WELL_F_PSHARED;
+	NB_die_if(well_init(&churn, malloc(well_size(&churn))), "");
+	NB_die_if(!well_notify_init(&churn.rx), "accepted a shared well");
+	NB_die_if(well_notify_fd(&churn.rx) != -1, "");
+
+die:
+	if (ep >= 0)
+		close(ep);
+	well_notify_deinit(&buf.rx);
+	well_notify_deinit(&buf.tx);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	well_deinit(&churn);
+	free(well_mem(&churn));
+	return err_cnt;
+}
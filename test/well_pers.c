@@ -0,0 +1,290 @@
+/*	well_pers.c
+
+Test persistent wells:
+	- a child process produces and consumes, syncs, carries on a little
+		and dies without syncing again;
+	- reopening redelivers exactly what was committed but not consumed
+		as of that sync (values consumed after it come again: at-least-once),
+		and the well keeps working across many laps;
+	- a clean close leaves nothing to redeliver;
+	- a file with a different geometry is refused;
+	- with 'sync_ms', blocks become durable with no further activity;
+	- several producer and consumer threads crash mid-flight:
+		nothing durably committed is lost, only consumed blocks come again,
+		and each producer's blocks come again in order.
+*/
+
+#include <well_pers.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+
+#define BLK_CNT		128
+#define SYNC_PRODUCED	1000
+#define SYNC_CONSUMED	950
+#define LOST_PRODUCED	20	/* after the sync: lost */
+#define LOST_CONSUMED	30	/* after the sync: redelivered */
+#define NUMITER		5000
+
+#define THREADS		2	/* producers, and as many consumers */
+#define PER_PRODUCER	(1 << 20)	/* more than the child gets to */
+#define CRASH_AFTER	20000	/* blocks consumed */
+
+
+static struct well_pers wp;
+
+
+/*	produce()
+Commit values 'next' up to 'end', consuming (and checking) in step
+	until 'consume_to' is reached; returns number of errors.
+*/
+static int produce(uint64_t *next, uint64_t end, uint64_t *expect, uint64_t consume_to)
+{
+	int err_cnt = 0;
+	while (*next < end || *expect < consume_to) {
+		struct well_res res;
+		if (*next < end) {
+			size_t want = end - *next;
+			res = well_reserve(&wp.buf.tx, want < 3 ? want : 3);
+			if (!res.cnt) {
+				NB_die_if(well_pers_sync(&wp), "");
+			} else {
+				for (size_t i=0; i < res.cnt; i++) {
+					NB_die_if(well_pers_abs(&wp, res.pos, i) != *next, "");
+					WELL_DEREF(uint64_t, res.pos, i, &wp.buf) = (*next)++;
+				}
+				well_pers_commit(&wp, res);
+			}
+		}
+		if (*expect < consume_to) {
+			size_t want = consume_to - *expect;
+			res = well_reserve(&wp.buf.rx, want < 5 ? want : 5);
+			for (size_t i=0; i < res.cnt; i++)
+				NB_die_if(WELL_DEREF(uint64_t, res.pos, i, &wp.buf) != (*expect)++,
+					"value %zu out of order", (size_t)*expect -1);
+			if (res.cnt)
+				well_pers_done(&wp, res);
+		}
+	}
+die:
+	return err_cnt;
+}
+
+
+/*	child()
+Run up to the sync point and a little further, then crash.
+*/
+static void child(const char *path)
+{
+	int err_cnt = 0;
+	uint64_t next = 0, expect = 0;
+	NB_die_if(well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT, 0, 0), "");
+	NB_die_if(produce(&next, SYNC_PRODUCED, &expect, SYNC_CONSUMED), "");
+	NB_die_if(well_pers_sync(&wp), "");
+	NB_die_if(produce(&next, SYNC_PRODUCED + LOST_PRODUCED,
+			&expect, SYNC_CONSUMED + LOST_CONSUMED), "");
+die:
+	_exit(err_cnt);
+}
+
+
+/*	test_timer()
+Commit a few blocks and go quiet: the helper thread must sync them.
+*/
+static int test_timer(const char *path)
+{
+	int err_cnt = 0;
+	NB_die_if(well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT, 0, 20), "");
+	struct well_res res = well_reserve(&wp.buf.tx, 3);
+	NB_die_if(res.cnt != 3, "");
+	well_pers_commit(&wp, res);
+	for (int i=0; i < 100 && wp.hdr->tail != wp.base + 3; i++)
+		usleep(10000);
+	NB_die_if(wp.hdr->tail != wp.base + 3, "not synced after 1s of quiet");
+
+die:
+	well_pers_close(&wp);
+	return err_cnt;
+}
+
+
+/*
+	several producers and consumers crash
+*/
+static uint8_t *seen_log = NULL;	/* [producer][seq]: consumed (MAP_SHARED) */
+static size_t *seen_cnt = NULL;
+
+/*	mt_producer()
+Commit 'arg' << 32 | seq for seq counting up from 0.
+*/
+static void *mt_producer(void *arg)
+{
+	uint64_t tag = (uint64_t)(uintptr_t)arg << 32;
+	for (uint64_t seq = 0; seq < PER_PRODUCER; ) {
+		struct well_res res = well_reserve(&wp.buf.tx, 3);
+		if (!res.cnt) {
+			well_pers_sync(&wp);
+			sched_yield();
+			continue;
+		}
+		for (size_t i=0; i < res.cnt; i++)
+			WELL_DEREF(uint64_t, res.pos, i, &wp.buf) = tag | seq++;
+		well_pers_commit(&wp, res);
+	}
+	return NULL;
+}
+
+/*	mt_consumer()
+Log every value before marking it done, until the process dies.
+*/
+static void *mt_consumer(void *arg)
+{
+	for (;;) {
+		struct well_res res = well_reserve(&wp.buf.rx, 4);
+		if (!res.cnt) {
+			sched_yield();
+			continue;
+		}
+		for (size_t i=0; i < res.cnt; i++) {
+			uint64_t v = WELL_DEREF(uint64_t, res.pos, i, &wp.buf);
+			__atomic_store_n(&seen_log[(v >> 32) * PER_PRODUCER + (uint32_t)v], 1,
+				__ATOMIC_RELAXED);
+		}
+		__atomic_add_fetch(seen_cnt, res.cnt, __ATOMIC_RELAXED);
+		well_pers_done(&wp, res);
+		/* let a backlog build up */
+		sched_yield();
+	}
+	return NULL;
+}
+
+/*	mt_child()
+Run THREADS producers and consumers, syncing on a timer and every few blocks,
+	and die with all of them mid-flight.
+*/
+static void mt_child(const char *path)
+{
+	int err_cnt = 0;
+	pthread_t tid[THREADS * 2];
+	NB_die_if(well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT, 16, 1), "");
+	for (uintptr_t i=0; i < THREADS; i++) {
+		NB_die_if(pthread_create(&tid[i], NULL, mt_producer, (void *)i), "");
+		NB_die_if(pthread_create(&tid[THREADS + i], NULL, mt_consumer, NULL), "");
+	}
+	/* crash once a durable backlog guarantees something to redeliver */
+	for (size_t i=0; i < 10000; i++) {
+		if (__atomic_load_n(seen_cnt, __ATOMIC_RELAXED) >= CRASH_AFTER
+			&& __atomic_load_n(&wp.hdr->tail, __ATOMIC_RELAXED)
+				!= __atomic_load_n(&wp.hdr->head, __ATOMIC_RELAXED))
+			break;
+		usleep(1000);
+	}
+die:
+	_exit(err_cnt);
+}
+
+/*	test_mt_crash()
+*/
+static int test_mt_crash(const char *path)
+{
+	int err_cnt = 0;
+	size_t log_sz = THREADS * PER_PRODUCER + sizeof(size_t);
+	void *log = mmap(NULL, log_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	NB_die_if(log == MAP_FAILED, "");
+	seen_log = log;
+	seen_cnt = (size_t *)(seen_log + THREADS * PER_PRODUCER);
+
+	pid_t pid = fork();
+	NB_die_if(pid < 0, "");
+	if (!pid)
+		mt_child(path);
+	int status;
+	NB_die_if(waitpid(pid, &status, 0) != pid, "");
+	NB_die_if(!WIFEXITED(status) || WEXITSTATUS(status), "child failed");
+
+	/* redelivered: in order per producer */
+	NB_die_if(well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT, 0, 0), "");
+	uint64_t last[THREADS];
+	int any[THREADS] = { 0 };
+	struct well_res res;
+	while ((res = well_reserve(&wp.buf.rx, 8)).cnt) {
+		for (size_t i=0; i < res.cnt; i++) {
+			uint64_t v = WELL_DEREF(uint64_t, res.pos, i, &wp.buf);
+			size_t p = v >> 32;
+			uint64_t seq = (uint32_t)v;
+			NB_die_if(p >= THREADS || seq >= PER_PRODUCER, "bogus value 0x%lx",
+				(unsigned long)v);
+			NB_die_if(any[p] && seq <= last[p], "producer %zu: %lu after %lu",
+				p, (unsigned long)seq, (unsigned long)last[p]);
+			/* everything this producer committed before: consumed or here */
+			for (uint64_t s = any[p] ? last[p] + 1 : 0; s < seq; s++)
+				NB_die_if(!seen_log[p * PER_PRODUCER + s],
+					"producer %zu: %lu lost", p, (unsigned long)s);
+			last[p] = seq;
+			any[p] = 1;
+		}
+		well_pers_done(&wp, res);
+	}
+	NB_die_if(!any[0] && !any[1], "nothing redelivered: crash came too late?");
+	NB_die_if(well_pers_close(&wp), "");
+
+die:
+	if (log != MAP_FAILED)
+		munmap(log, log_sz);
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	char path[] = "/tmp/well_pers.XXXXXX";
+	int fd = -1;
+	NB_die_if((fd = mkstemp(path)) < 0, "");
+
+	/* crash */
+	pid_t pid = fork();
+	NB_die_if(pid < 0, "");
+	if (!pid)
+		child(path);
+	int status;
+	NB_die_if(waitpid(pid, &status, 0) != pid, "");
+	NB_die_if(!WIFEXITED(status) || WEXITSTATUS(status), "child failed");
+
+	/* resume */
+	NB_die_if(well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT, 16, 0), "");
+	NB_die_if(wp.buf.rx.avail != SYNC_PRODUCED - SYNC_CONSUMED,
+		"%zu queued after crash", wp.buf.rx.avail);
+	uint64_t next = SYNC_PRODUCED, expect = SYNC_CONSUMED;
+	NB_die_if(produce(&next, NUMITER, &expect, NUMITER - 10), "");
+	NB_die_if(well_pers_close(&wp), "");
+
+	/* clean close: only the 10 left unconsumed */
+	NB_die_if(well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT, 16, 5), "");
+	NB_die_if(wp.buf.rx.avail != 10, "%zu queued after close", wp.buf.rx.avail);
+	NB_die_if(produce(&next, NUMITER, &expect, NUMITER), "");
+	NB_die_if(well_pers_close(&wp), "");
+
+	NB_die_if(!well_pers_open(&wp, path, sizeof(uint64_t), BLK_CNT * 2, 0, 0),
+		"opened with wrong block count");
+
+	NB_die_if(ftruncate(fd, 0), "");
+	NB_die_if(test_timer(path), "");
+	NB_die_if(ftruncate(fd, 0), "");
+	NB_die_if(test_mt_crash(path), "");
+
+die:
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+	return err_cnt;
+}
@@ -0,0 +1,117 @@
+/*	well_pipe.c
+
+Test a 4-stage pipeline over a single well:
+	produce 'seq' -> double it (2 threads) -> add 1 -> verify in order.
+*/
+
+#include <well_pipe.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <pthread.h>
+
+
+#define NUMITER		1000000
+#define RESERVATION	32
+#define DOUBLERS	2
+
+
+static struct well_pipe pipe_;
+
+
+/*	producer()
+Stage 0.
+*/
+static void *producer(void *arg)
+{
+	for (size_t i=0; i < NUMITER; ) {
+		size_t want = NUMITER - i < RESERVATION ? NUMITER - i : RESERVATION;
+		struct well_res res = well_pipe_reserve(&pipe_, 0, want);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++, i++)
+			WELL_DEREF(size_t, res.pos, j, &pipe_.buf) = i;
+		well_pipe_release(&pipe_, 0, res);
+	}
+	return NULL;
+}
+
+/*	doubler()
+Stage 1: several threads.
+*/
+static size_t doubled = 0;
+static void *doubler(void *arg)
+{
+	while (__atomic_load_n(&doubled, __ATOMIC_RELAXED) < NUMITER) {
+		struct well_res res = well_pipe_reserve(&pipe_, 1, RESERVATION);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++)
+			WELL_DEREF(size_t, res.pos, j, &pipe_.buf) *= 2;
+		__atomic_fetch_add(&doubled, res.cnt, __ATOMIC_RELAXED);
+		well_pipe_release(&pipe_, 1, res);
+	}
+	return NULL;
+}
+
+/*	incrementer()
+Stage 2.
+*/
+static void *incrementer(void *arg)
+{
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_pipe_reserve(&pipe_, 2, RESERVATION);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++, i++)
+			WELL_DEREF(size_t, res.pos, j, &pipe_.buf) += 1;
+		well_pipe_release(&pipe_, 2, res);
+	}
+	return NULL;
+}
+
+
+/*	main()
+Stage 3: verify and hand blocks back to the producer.
+*/
+int main()
+{
+	int err_cnt = 0;
+	pthread_t tid[DOUBLERS + 2];
+	size_t started = 0;
+
+	NB_die_if(well_pipe_init(&pipe_, 4, sizeof(size_t), 256), "");
+
+	NB_die_if(pthread_create(&tid[started++], NULL, producer, NULL), "");
+	for (size_t i=0; i < DOUBLERS; i++)
+		NB_die_if(pthread_create(&tid[started++], NULL, doubler, NULL), "");
+	NB_die_if(pthread_create(&tid[started++], NULL, incrementer, NULL), "");
+
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_pipe_reserve(&pipe_, 3, RESERVATION);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++, i++) {
+			size_t val = WELL_DEREF(size_t, res.pos, j, &pipe_.buf);
+			NB_die_if(val != i * 2 + 1, "block %zu: %zu != %zu", i, val, i * 2 + 1);
+		}
+		well_pipe_release(&pipe_, 3, res);
+	}
+
+die:
+	/* on error, threads may never finish: just exit */
+	if (!err_cnt) {
+		for (size_t i=0; i < started; i++)
+			pthread_join(tid[i], NULL);
+		well_pipe_deinit(&pipe_);
+	}
+	return err_cnt;
+}
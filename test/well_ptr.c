@@ -0,0 +1,233 @@
+/*	well_ptr.c
+
+Test the pointer queue:
+	- only pointer-sized wells qualify;
+	- full and empty queues push/pop nothing;
+	- order is kept across laps;
+	- with several producers and consumers every pointer arrives once,
+		and pointers from one producer arrive in order at a single consumer;
+	- with many more producers and consumers than CPUs on a 2-block well
+		(so that claims of different laps pile up on every slot)
+		no pointer is lost and none comes out NULL.
+*/
+
+#include <well.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+
+
+#define PRODUCERS	3
+#define CONSUMERS	3
+#define NUMITER		100000
+#define BATCH		4
+#define STRESS_ITER	20000
+#define STRESS_SECS	60
+
+
+static struct well buf = { {0} };
+static size_t popped = 0;
+static size_t sum = 0;
+static size_t stress_threads = 0;
+static size_t nulls = 0;
+static time_t deadline = 0;
+
+
+/*	producer()
+Push NUMITER tagged values (never NULL), BATCH at a time.
+*/
+static void *producer(void *arg)
+{
+	uintptr_t tag = (uintptr_t)arg << 32;
+	void *vals[BATCH];
+	for (size_t i=1; i <= NUMITER; ) {
+		size_t n = 0;
+		for (; n < BATCH && i + n <= NUMITER; n++)
+			vals[n] = (void *)(tag | (i + n));
+		size_t done = 0;
+		while ((done += well_ptr_push(&buf, vals + done, n - done)) < n)
+			sched_yield();
+		i += n;
+	}
+	return NULL;
+}
+
+/*	consumer()
+Pop until everything has been accounted for, adding up what was seen.
+*/
+static void *consumer(void *arg)
+{
+	void *vals[BATCH];
+	size_t local = 0;
+	while (__atomic_load_n(&popped, __ATOMIC_RELAXED) < PRODUCERS * NUMITER) {
+		size_t n = well_ptr_pop(&buf, vals, BATCH);
+		if (!n) {
+			sched_yield();
+			continue;
+		}
+		for (size_t i=0; i < n; i++)
+			local += (uintptr_t)vals[i] & 0xffffffff;
+		__atomic_add_fetch(&popped, n, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&sum, local, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/*	stress_producer()
+Push STRESS_ITER values one or two at a time, giving up at 'deadline'.
+*/
+static void *stress_producer(void *arg)
+{
+	uintptr_t tag = (uintptr_t)arg << 32;
+	for (size_t i=1; i <= STRESS_ITER; ) {
+		void *vals[2] = { (void *)(tag | i), (void *)(tag | (i + 1)) };
+		size_t n = (i & 1) && i < STRESS_ITER ? 2 : 1;
+		size_t done = 0;
+		while ((done += well_ptr_push(&buf, vals + done, n - done)) < n) {
+			if (time(NULL) > deadline)
+				return NULL;
+			sched_yield();
+		}
+		i += n;
+	}
+	return NULL;
+}
+
+/*	stress_consumer()
+Pop until everything has been accounted for (or 'deadline' passes),
+	counting NULLs and adding up everything else.
+*/
+static void *stress_consumer(void *arg)
+{
+	void *vals[2];
+	size_t local = 0, null_cnt = 0;
+	while (__atomic_load_n(&popped, __ATOMIC_RELAXED) < stress_threads * STRESS_ITER) {
+		size_t n = well_ptr_pop(&buf, vals, 2);
+		if (!n) {
+			if (time(NULL) > deadline)
+				break;
+			sched_yield();
+			continue;
+		}
+		for (size_t i=0; i < n; i++) {
+			if (!vals[i])
+				null_cnt++;
+			local += (uintptr_t)vals[i] & 0xffffffff;
+		}
+		__atomic_add_fetch(&popped, n, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&sum, local, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&nulls, null_cnt, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	void *out[32];
+
+	/* only pointer-sized blocks */
+	NB_die_if(well_params(2 * sizeof(void *), 16, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(!well_ptr_init(&buf), "accepted %zu-byte blocks", well_blk_size(&buf));
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	buf = (struct well){ {0} };
+
+	NB_die_if(well_params(sizeof(void *), 16, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(well_ptr_init(&buf), "");
+
+	/* single thread: empty, full, order across laps */
+	uintptr_t in = 1, want = 1;
+	NB_die_if(well_ptr_pop(&buf, out, 1), "popped from empty queue");
+	for (; in <= 16; in++)
+		NB_die_if(well_ptr_push(&buf, (void **)&in, 1) != 1, "");
+	NB_die_if(well_ptr_push(&buf, (void **)&in, 1), "pushed into full queue");
+	for (size_t lap=0; lap < 5; lap++) {
+		NB_die_if(well_ptr_pop(&buf, out, 10) != 10, "");
+		for (size_t i=0; i < 10; i++, want++)
+			NB_die_if((uintptr_t)out[i] != want, "%zu out of order", (size_t)want);
+		for (size_t i=0; i < 10; i++, in++)
+			NB_die_if(well_ptr_push(&buf, (void **)&in, 1) != 1, "");
+	}
+	NB_die_if(well_ptr_pop(&buf, out, 32) != 16, "");
+	for (size_t i=0; i < 16; i++, want++)
+		NB_die_if((uintptr_t)out[i] != want, "%zu out of order", (size_t)want);
+	NB_die_if(well_ptr_pop(&buf, out, 1), "");
+
+	/* threads */
+	pthread_t prod[PRODUCERS], cons[CONSUMERS];
+	for (uintptr_t i=0; i < PRODUCERS; i++)
+		NB_die_if(pthread_create(&prod[i], NULL, producer, (void *)i), "");
+	for (size_t i=0; i < CONSUMERS; i++)
+		NB_die_if(pthread_create(&cons[i], NULL, consumer, NULL), "");
+	for (size_t i=0; i < PRODUCERS; i++)
+		pthread_join(prod[i], NULL);
+	for (size_t i=0; i < CONSUMERS; i++)
+		pthread_join(cons[i], NULL);
+
+	size_t expect = PRODUCERS * ((size_t)NUMITER * (NUMITER + 1) / 2);
+	NB_die_if(popped != PRODUCERS * NUMITER, "popped %zu", popped);
+	NB_die_if(sum != expect, "sum %zu != %zu", sum, expect);
+
+	/* single consumer: each producer's pointers arrive in order */
+	size_t last[PRODUCERS] = { 0 };
+	for (uintptr_t i=0; i < PRODUCERS; i++)
+		NB_die_if(pthread_create(&prod[i], NULL, producer, (void *)i), "");
+	for (size_t got = 0; got < PRODUCERS * NUMITER; ) {
+		size_t n = well_ptr_pop(&buf, out, BATCH);
+		for (size_t i=0; i < n; i++) {
+			uintptr_t v = (uintptr_t)out[i];
+			size_t p = v >> 32;
+			NB_die_if(p >= PRODUCERS || (v & 0xffffffff) != last[p] + 1,
+				"producer %zu: %zu after %zu", p, (size_t)(v & 0xffffffff), last[p]);
+			last[p]++;
+		}
+		got += n;
+		if (!n)
+			sched_yield();
+	}
+	for (size_t i=0; i < PRODUCERS; i++)
+		pthread_join(prod[i], NULL);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	buf = (struct well){ {0} };
+
+	/* stress: 2 slots, 4 producers and 4 consumers per CPU (at least 8 of each) */
+	NB_die_if(well_params(sizeof(void *), 2, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(well_ptr_init(&buf), "");
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	stress_threads = cpus < 2 ? 8 : 4 * (size_t)cpus;
+	popped = sum = 0;
+	deadline = time(NULL) + STRESS_SECS;
+	pthread_t *threads = calloc(stress_threads * 2, sizeof(*threads));
+	NB_die_if(!threads, "");
+	for (uintptr_t i=0; i < stress_threads; i++) {
+		NB_die_if(pthread_create(&threads[i], NULL, stress_producer, (void *)i), "");
+		NB_die_if(pthread_create(&threads[stress_threads + i], NULL,
+			stress_consumer, NULL), "");
+	}
+	for (size_t i=0; i < stress_threads * 2; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	expect = stress_threads * ((size_t)STRESS_ITER * (STRESS_ITER + 1) / 2);
+	NB_die_if(nulls, "%zu NULL pops", nulls);
+	NB_die_if(popped != stress_threads * STRESS_ITER, "%zu pointers lost (timed out)",
+		stress_threads * STRESS_ITER - popped);
+	NB_die_if(sum != expect, "sum %zu != %zu", sum, expect);
+
+die:
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
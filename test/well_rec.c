@@ -0,0 +1,130 @@
+/*	well_rec.c
+
+Test variable-length records:
+	multiple producers push records of varying length,
+	a single consumer verifies every record.
+*/
+
+#include <well_rec.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+#define NUMITER		100000	/* records per producer */
+#define TX_THREAD_CNT	2
+#define MAX_LEN		3000	/* Bytes of payload */
+
+
+/*	rec_len()
+Deterministic, wildly variable length for record 'seq'.
+*/
+static size_t rec_len(size_t seq)
+{
+	return sizeof(size_t) + (seq * 7919) % (MAX_LEN - sizeof(size_t));
+}
+
+/*	rec_fill()
+Payload is 'seq' followed by a pattern derived from it.
+*/
+static void rec_fill(unsigned char *payload, size_t seq, size_t len)
+{
+	memcpy(payload, &seq, sizeof(seq));
+	for (size_t i=sizeof(seq); i < len; i++)
+		payload[i] = seq + i;
+}
+
+
+/*	tx_thread()
+Each producer pushes the records whose 'seq' has its index as remainder.
+*/
+static struct well *well_shared = NULL;
+static void *tx_thread(void *arg)
+{
+	struct well *buf = well_shared;
+	size_t idx = (size_t)arg;
+	unsigned char payload[MAX_LEN];
+
+	for (size_t i=0; i < NUMITER; i++) {
+		size_t seq = i * TX_THREAD_CNT + idx;
+		size_t len = rec_len(seq);
+		rec_fill(payload, seq, len);
+
+		struct well_res res;
+		while (!(res = well_rec_reserve(buf, len)).cnt)
+			FAIL_DO();
+		well_rec_write(buf, res.pos, payload, len);
+		well_release_ooo(&buf->rx, res);
+	}
+	return NULL;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	struct well buf = { {0} };
+	void *ooo = NULL;
+	pthread_t tx[TX_THREAD_CNT];
+	size_t tx_started = 0;
+
+	/* small blocks: most records span many of them */
+	NB_die_if(well_params(64, 256, &buf), "");
+	NB_die_if(
+		well_init(&buf, malloc(well_size(&buf)))
+		, "size %zu", well_size(&buf));
+	NB_die_if(!(
+		ooo = malloc(well_ooo_size(&buf))
+		), "");
+	NB_die_if(well_ooo_init(&buf, ooo), "");
+
+	/* larger than the buffer: must never succeed */
+	struct well_res res = well_rec_reserve(&buf, well_size(&buf));
+	NB_die_if(res.cnt, "reserved %zu blocks for an impossible record", res.cnt);
+
+	well_shared = &buf;
+	for (; tx_started < TX_THREAD_CNT; tx_started++)
+		NB_die_if(pthread_create(&tx[tx_started], NULL, tx_thread, (void *)tx_started), "");
+
+	/* single consumer: records from each producer arrive in 'seq' order */
+	size_t next[TX_THREAD_CNT];
+	for (size_t i=0; i < TX_THREAD_CNT; i++)
+		next[i] = i;
+	struct well_rec_it it = { 0 };
+	unsigned char payload[MAX_LEN];
+	unsigned char expect[MAX_LEN];
+
+	for (size_t i=0; i < NUMITER * TX_THREAD_CNT; i++) {
+		while (!(res = well_rec_next(&buf, &it)).cnt)
+			FAIL_DO();
+
+		size_t len = well_rec_read(&buf, res.pos, payload, sizeof(payload));
+		size_t seq;
+		memcpy(&seq, payload, sizeof(seq));
+		NB_die_if(seq % TX_THREAD_CNT >= TX_THREAD_CNT
+			|| seq != next[seq % TX_THREAD_CNT],
+			"record %zu: seq %zu out of order", i, seq);
+		next[seq % TX_THREAD_CNT] += TX_THREAD_CNT;
+
+		NB_die_if(len != rec_len(seq), "seq %zu: len %zu != %zu", seq, len, rec_len(seq));
+		NB_die_if(res.cnt != well_rec_blocks(&buf, len),
+			"seq %zu: %zu blocks", seq, res.cnt);
+		rec_fill(expect, seq, len);
+		NB_die_if(memcmp(payload, expect, len), "seq %zu: payload corrupt", seq);
+
+		well_release_single(&buf.tx, res.cnt);
+	}
+	NB_die_if(it.cnt, "%zu blocks left over in iterator", it.cnt);
+
+die:
+	for (size_t i=0; i < tx_started; i++)
+		pthread_join(tx[i], NULL);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	free(ooo);
+	return err_cnt;
+}
@@ -0,0 +1,241 @@
+/*	well_resize.c
+
+Test online resize, for every technique:
+	- a well holding more data than the new size is left as it was;
+	- pointer queues and wells with extra sides are refused;
+	- data survives growing and shrinking, in order;
+	- producers and consumers running throughout lose nothing,
+		while the well is resized back and forth under them.
+*/
+
+#include <well.h>
+#include <well_fail.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+
+#define BLK_CNT		128
+#define NUMITER		200000
+#define PRODUCERS	2
+#define RES_MAX		8
+#define ID_SHIFT	48
+
+
+static struct well buf;
+static size_t consumed = 0;
+
+
+/*	resize_()
+Resize 'buf' to 'blk_cnt' blocks, freeing whichever buffer is not in use after.
+*/
+static int resize_(size_t blk_cnt, uint64_t *pause_ns)
+{
+	void *old = well_mem(&buf);
+	void *mem = malloc(blk_cnt * well_blk_size(&buf));
+	if (!mem)
+		return ENOMEM;
+	struct timespec timeout = { .tv_sec = 5 };
+	int ret = well_resize(&buf, mem, blk_cnt, &timeout, pause_ns);
+	free(ret ? mem : old);
+	return ret;
+}
+
+
+/*	test_static()
+Resize a well nobody is using.
+*/
+static int test_static(uint8_t technique)
+{
+	int err_cnt = 0;
+	buf = (struct well){ {0} };
+	NB_die_if(well_params(sizeof(size_t), BLK_CNT, &buf), "");
+	NB_die_if(well_init_technique(&buf, malloc(well_size(&buf)), technique), "");
+
+	/* wrap around once, leave 100 values in */
+	size_t next = 0, expect = 0;
+	for (size_t n=0; n < BLK_CNT + 100; n++) {
+		struct well_res res = well_reserve(&buf.tx, 1);
+		NB_die_if(res.cnt != 1, "");
+		WELL_DEREF(size_t, res.pos, 0, &buf) = next++;
+		well_release_single(&buf.rx, 1);
+		if (n < BLK_CNT) {
+			res = well_reserve(&buf.rx, 1);
+			NB_die_if(WELL_DEREF(size_t, res.pos, 0, &buf) != expect++, "");
+			well_release_single(&buf.tx, 1);
+		}
+	}
+
+	uint64_t pause;
+	NB_die_if(resize_(64, &pause) != ENOBUFS, "shrunk below contents");
+	NB_die_if(well_blk_count(&buf) != BLK_CNT, "");
+	NB_die_if(buf.rx.avail != 100 || buf.tx.avail != BLK_CNT - 100,
+		"rx %zu tx %zu after failed resize", buf.rx.avail, buf.tx.avail);
+	NB_die_if(resize_(3, NULL) == 0, "blk_cnt 3 accepted");
+
+	/* drain 50, shrink, then grow; fill up in between */
+	for (size_t n=0; n < 50; n++) {
+		struct well_res res = well_reserve(&buf.rx, 1);
+		NB_die_if(WELL_DEREF(size_t, res.pos, 0, &buf) != expect++, "");
+		well_release_single(&buf.tx, 1);
+	}
+	NB_die_if(resize_(64, &pause), "");
+	NB_die_if(well_blk_count(&buf) != 64, "");
+	NB_die_if(buf.rx.avail != 50 || buf.tx.avail != 14,
+		"rx %zu tx %zu after shrink", buf.rx.avail, buf.tx.avail);
+	struct well_res res = well_reserve(&buf.tx, -1);
+	NB_die_if(res.cnt != 14, "");
+	for (size_t i=0; i < res.cnt; i++)
+		WELL_DEREF(size_t, res.pos, i, &buf) = next++;
+	well_release_single(&buf.rx, res.cnt);
+
+	NB_die_if(resize_(1024, &pause), "");
+	NB_die_if(buf.rx.avail != 64 || buf.tx.avail != 1024 - 64, "");
+	while ((res = well_reserve(&buf.rx, 7)).cnt) {
+		for (size_t i=0; i < res.cnt; i++)
+			NB_die_if(WELL_DEREF(size_t, res.pos, i, &buf) != expect++,
+				"value %zu out of order", expect -1);
+		well_release_single(&buf.tx, res.cnt);
+	}
+	NB_die_if(expect != next, "read %zu of %zu", expect, next);
+
+die:
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
+
+
+/*	test_refused()
+Pointer queues and wells with an extra side keep blocks outside 'tx' and 'rx':
+	resizing them must fail and leave them be.
+*/
+static int test_refused()
+{
+	int err_cnt = 0;
+	struct well_sym extra;
+	int extra_up = 0;
+	buf = (struct well){ {0} };
+	NB_die_if(well_params(sizeof(void *), BLK_CNT, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+
+	NB_die_if(well_ptr_init(&buf), "");
+	NB_die_if(resize_(BLK_CNT * 2, NULL) == 0, "resized a pointer queue");
+	NB_die_if(well_blk_count(&buf) != BLK_CNT, "");
+
+	/* well_init() again: no longer a pointer queue */
+	well_deinit(&buf);
+	NB_die_if(well_init(&buf, well_mem(&buf)), "");
+	NB_die_if(resize_(BLK_CNT * 2, NULL), "");
+	NB_die_if(well_sym_init(&buf, &extra, NULL), "");
+	extra_up = 1;
+	NB_die_if(resize_(BLK_CNT, NULL) == 0, "resized a well with an extra side");
+	NB_die_if(well_blk_count(&buf) != BLK_CNT * 2, "");
+
+die:
+	if (extra_up)
+		well_sym_deinit(&extra);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
+
+
+/*	producer()
+Push NUMITER / PRODUCERS values tagged with producer 'arg'.
+*/
+static void *producer(void *arg)
+{
+	size_t id = (size_t)arg;
+	for (size_t i=0; i < NUMITER / PRODUCERS; ) {
+		struct well_res res = well_reserve(&buf.tx, RES_MAX);
+		if (!res.cnt) {
+			FAIL_DO();
+			continue;
+		}
+		for (size_t j=0; j < res.cnt; j++)
+			WELL_DEREF(size_t, res.pos, j, &buf) = (id << ID_SHIFT) | i++;
+		while (!well_release_multi(&buf.rx, res))
+			FAIL_DO();
+	}
+	return NULL;
+}
+
+/*	consumer()
+Check every producer's values arrive in order.
+*/
+static void *consumer(void *arg)
+{
+	int *err = arg;
+	size_t next[PRODUCERS] = { 0 };
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < NUMITER) {
+		struct well_res res = well_reserve_wait(&buf.rx, RES_MAX);
+		for (size_t j=0; j < res.cnt; j++) {
+			size_t val = WELL_DEREF(size_t, res.pos, j, &buf);
+			size_t id = val >> ID_SHIFT;
+			if (id >= PRODUCERS || (val & ((1UL << ID_SHIFT) -1)) != next[id]++)
+				*err = 1;
+		}
+		well_release_single(&buf.tx, res.cnt);
+		__atomic_add_fetch(&consumed, res.cnt, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/*	test_live()
+Resize back and forth while PRODUCERS and one consumer run.
+*/
+static int test_live(uint8_t technique)
+{
+	int err_cnt = 0;
+	int order_err = 0;
+	pthread_t tid[PRODUCERS +1];
+	size_t started = 0;
+	static const size_t sizes[] = { 16, 1024, 64, 256, 8 };
+	size_t resized = 0;
+
+	buf = (struct well){ {0} };
+	consumed = 0;
+	NB_die_if(well_params(sizeof(size_t), BLK_CNT, &buf), "");
+	NB_die_if(well_init_technique(&buf, malloc(well_size(&buf)), technique), "");
+
+	NB_die_if(pthread_create(&tid[started++], NULL, consumer, &order_err), "");
+	for (; started <= PRODUCERS; started++)
+		NB_die_if(pthread_create(&tid[started], NULL, producer,
+				(void *)(started -1)), "");
+
+	for (size_t i=0; __atomic_load_n(&consumed, __ATOMIC_RELAXED) < NUMITER; i++) {
+		int ret = resize_(sizes[i % (sizeof(sizes) / sizeof(sizes[0]))], NULL);
+		NB_die_if(ret && ret != ENOBUFS, "resize: %d", ret);
+		if (!ret)
+			resized++;
+		usleep(200);
+	}
+	NB_die_if(!resized, "never resized");
+
+die:
+	for (; started; started--)
+		pthread_join(tid[started -1], NULL);
+	NB_wrn_if(order_err, "values lost or out of order");
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt + order_err;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	NB_die_if(test_refused(), "");
+	for (uint8_t t=1; well_technique_name(t); t++) {
+		NB_die_if(test_static(t), "%s: static", well_technique_name(t));
+		NB_die_if(test_live(t), "%s: live", well_technique_name(t));
+	}
+die:
+	return err_cnt;
+}
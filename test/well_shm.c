@@ -0,0 +1,115 @@
+/*	well_shm.c
+
+Test a well shared between processes:
+	parent creates it and produces, a child attaches and consumes;
+	once as a forked child, once as a freshly exec()'d process
+	(with address space randomized anew).
+*/
+
+#include <well_shm.h>
+
+#include <ndebug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define NUMITER		1000000	/* blocks pushed through the well */
+#define RESERVATION	64
+#define TIMEOUT_SEC	10	/* don't hang forever if the other process dies */
+
+
+/*	consumer()
+Runs in the child: attach to 'name', verify every block is its sequence number.
+*/
+static int consumer(const char *name)
+{
+	int err_cnt = 0;
+	struct well *buf = NULL;
+	NB_die_if(well_shm_attach(name, &buf), "");
+
+	const struct timespec timeout = { .tv_sec = TIMEOUT_SEC };
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_reserve_timed(&buf->rx, RESERVATION, &timeout);
+		NB_die_if(!res.cnt, "timed out at block %zu", i);
+		for (size_t j=0; j < res.cnt; j++, i++)
+			NB_die_if(WELL_DEREF(size_t, res.pos, j, buf) != i,
+				"block %zu: %zu", i, WELL_DEREF(size_t, res.pos, j, buf));
+		well_release_single(&buf->tx, res.cnt);
+	}
+
+die:
+	well_shm_detach(buf);
+	return err_cnt;
+}
+
+
+/*	run()
+Create a well, produce into it for a child which attaches and consumes:
+	forked, or (if 'self' is not NULL) exec()'d as 'self attach <name>'.
+*/
+static int run(const char *self)
+{
+	int err_cnt = 0;
+	struct well *buf = NULL;
+	pid_t child = -1;
+	char name[64];
+	snprintf(name, sizeof(name), "/well_shm_test.%d.%s", (int)getpid(),
+		self ? "exec" : "fork");
+
+	NB_die_if(well_shm_create(name, sizeof(size_t), 1024, &buf), "");
+
+	/* must refuse to map over an existing mapping */
+	struct well *dup = NULL;
+	NB_die_if(!well_shm_attach(name, &dup), "attached twice at the same address");
+
+	NB_die_if((
+		child = fork()
+		) == -1, "");
+	if (!child && self) {
+		execl("/proc/self/exe", self, "attach", name, (char *)NULL);
+		_exit(127);
+	} else if (!child) {
+		/* child inherits the mapping: drop it to exercise a real attach */
+		well_shm_detach(buf);
+		_exit(consumer(name));
+	}
+
+	const struct timespec timeout = { .tv_sec = TIMEOUT_SEC };
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_reserve_timed(&buf->tx, RESERVATION, &timeout);
+		NB_die_if(!res.cnt, "timed out at block %zu", i);
+		for (size_t j=0; j < res.cnt; j++, i++)
+			WELL_DEREF(size_t, res.pos, j, buf) = i;
+		well_release_single(&buf->rx, res.cnt);
+	}
+
+	int status;
+	NB_die_if(waitpid(child, &status, 0) != child, "");
+	NB_die_if(!WIFEXITED(status) || WEXITSTATUS(status), "consumer failed");
+	child = -1;
+
+die:
+	if (child > 0)
+		waitpid(child, NULL, 0);
+	well_shm_destroy(name, buf);
+	return err_cnt;
+}
+
+
+/*	main()
+*/
+int main(int argc, char **argv)
+{
+	int err_cnt = 0;
+	/* exec()'d by run() */
+	if (argc == 3 && !strcmp(argv[1], "attach"))
+		return consumer(argv[2]);
+
+	NB_die_if(run(NULL), "forked consumer");
+	NB_die_if(run(argv[0]), "exec()'d consumer");
+die:
+	return err_cnt;
+}
@@ -0,0 +1,168 @@
+/*	well_sock.c
+
+Test batched datagram I/O over loopback UDP:
+	records of varying length are pushed into well 'out',
+	sent with well_sock_send(), received with well_sock_recv() into well 'in'
+	and checked for order, length and content.
+Also checks that truncated datagrams and flushed blocks are reported as such.
+*/
+
+#include <well_sock.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+#define BLK_SIZE	256
+#define BLK_CNT		128
+#define NUMITER		10000
+
+
+static struct well out = { {0} };
+static struct well in = { {0} };
+
+
+/*	len_of()
+Payload length of datagram 'i'.
+*/
+static inline size_t len_of(size_t i)
+{
+	return (i * 37) % (BLK_SIZE - sizeof(struct well_rec_hdr) + 1);
+}
+
+/*	byte_of()
+Byte 'j' of datagram 'i'.
+*/
+static inline unsigned char byte_of(size_t i, size_t j)
+{
+	return (i + j * 3) & 0xff;
+}
+
+/*	udp_bound()
+Open a UDP socket bound to an ephemeral loopback port; returns it in 'addr'.
+*/
+static int udp_bound(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	*addr = (struct sockaddr_in){
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	if (bind(fd, (struct sockaddr *)addr, len)
+		|| getsockname(fd, (struct sockaddr *)addr, &len))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	int rx = -1, tx = -1;
+	struct sockaddr_in rx_addr, tx_addr;
+	struct well_sock ws_in, ws_out;
+
+	NB_die_if(well_params(BLK_SIZE, BLK_CNT, &out), "");
+	NB_die_if(well_init(&out, aligned_alloc(BLK_SIZE, well_size(&out))), "");
+	NB_die_if(well_params(BLK_SIZE, BLK_CNT, &in), "");
+	NB_die_if(well_init(&in, aligned_alloc(BLK_SIZE, well_size(&in))), "");
+
+	NB_die_if((rx = udp_bound(&rx_addr)) < 0, "rx socket: %s", strerror(errno));
+	NB_die_if((tx = udp_bound(&tx_addr)) < 0, "tx socket: %s", strerror(errno));
+	NB_die_if(connect(tx, (struct sockaddr *)&rx_addr, sizeof(rx_addr)), "");
+
+	NB_die_if(well_sock_init(&ws_out, &out, &out.rx, &out.tx, tx), "");
+	NB_die_if(well_sock_init(&ws_in, &in, &in.tx, &in.rx, rx), "");
+
+	/* the receive buffer of a loopback socket holds well over BLK_CNT
+	 * small datagrams: send a well's worth, then drain it
+	 */
+	size_t sent = 0, pushed = 0, got = 0;
+	while (got < NUMITER) {
+		struct well_res res;
+		while (pushed < NUMITER && (res = well_reserve(&out.tx, 1)).cnt) {
+			size_t len = len_of(pushed);
+			unsigned char *d = well_rec_data(&out, res.pos);
+			for (size_t j=0; j < len; j++)
+				d[j] = byte_of(pushed, j);
+			((struct well_rec_hdr *)well_access(res.pos, 0, &out))->len = len;
+			well_release_single(&out.rx, 1);
+			pushed++;
+		}
+
+		size_t n;
+		errno = 0;
+		while ((n = well_sock_send(&ws_out, WELL_SOCK_BATCH, MSG_DONTWAIT)))
+			sent += n;
+		NB_die_if(sent < pushed && errno != EAGAIN && errno != ENOBUFS,
+			"send: %s", strerror(errno));
+
+		struct pollfd pfd = { .fd = rx, .events = POLLIN };
+		while (got < sent && poll(&pfd, 1, 1000) > 0) {
+			n = well_sock_recv(&ws_in, WELL_SOCK_BATCH, MSG_DONTWAIT);
+			NB_die_if(!n, "recv: %s", strerror(errno));
+			while ((res = well_reserve(&in.rx, BLK_CNT)).cnt) {
+				for (size_t i=0; i < res.cnt; i++, got++) {
+					size_t len = well_rec_len(&in, res.pos + i);
+					NB_die_if(len != len_of(got),
+						"datagram %zu: len %zu != %zu", got, len, len_of(got));
+					const unsigned char *d = well_rec_data(&in, res.pos + i);
+					for (size_t j=0; j < len; j++)
+						NB_die_if(d[j] != byte_of(got, j),
+							"datagram %zu byte %zu", got, j);
+				}
+				well_release_single(&in.tx, res.cnt);
+			}
+		}
+		NB_die_if(got < sent, "lost datagrams: got %zu of %zu", got, sent);
+	}
+	NB_die_if(well_reserve(&in.rx, 1).cnt, "extra datagram");
+
+	/* longer than a block: truncated to the payload */
+	char big[BLK_SIZE * 2];
+	memset(big, 'x', sizeof(big));
+	NB_die_if(send(tx, big, sizeof(big), 0) != sizeof(big), "");
+	NB_die_if(well_sock_recv(&ws_in, 1, 0) != 1, "");
+	struct well_res res = well_reserve(&in.rx, 2);
+	NB_die_if(res.cnt != 1, "");
+	NB_die_if(well_rec_len(&in, res.pos) != well_sock_payload(&in),
+		"truncated datagram len %zu", well_rec_len(&in, res.pos));
+	well_release_single(&in.tx, 1);
+
+	/* nothing to receive: blocks stay held, flush releases them empty */
+	NB_die_if(well_sock_recv(&ws_in, 4, MSG_DONTWAIT), "");
+	size_t held = ws_in.held.cnt;
+	NB_die_if(held < 4, "held %zu", held);
+	well_sock_flush(&ws_in);
+	NB_die_if(ws_in.held.cnt, "");
+	res = well_reserve(&in.rx, BLK_CNT);
+	NB_die_if(res.cnt != held, "flushed %zu of %zu", res.cnt, held);
+	for (size_t i=0; i < res.cnt; i++)
+		NB_die_if(well_rec_len(&in, res.pos + i), "flushed block not empty");
+	well_release_single(&in.tx, res.cnt);
+
+die:
+	if (rx >= 0)
+		close(rx);
+	if (tx >= 0)
+		close(tx);
+	well_deinit(&out);
+	free(well_mem(&out));
+	well_deinit(&in);
+	free(well_mem(&in));
+	return err_cnt;
+}
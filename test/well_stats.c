@@ -0,0 +1,133 @@
+/*	well_stats.c
+
+Test per-side counters (when built with WELL_STATS):
+	- reservations, blocks and failures are counted on the side reserved from;
+	- out-of-turn releases and the high-water mark on the side released into;
+	- counts from several threads add up.
+Without WELL_STATS, snapshots must read all zeroes.
+*/
+
+#include <well_stats.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+
+#define THREADS		4
+#define NUMITER		100000
+
+
+static struct well buf = { {0} };
+
+
+#ifdef WELL_STATS
+/*	worker()
+Move NUMITER single blocks tx -> rx -> tx.
+*/
+static void *worker(void *arg)
+{
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_reserve(&buf.tx, 1);
+		if (!res.cnt) {
+			sched_yield();
+			continue;
+		}
+		well_release_ooo(&buf.rx, res);
+		while (!(res = well_reserve(&buf.rx, 1)).cnt)
+			sched_yield();
+		well_release_ooo(&buf.tx, res);
+		i++;
+	}
+	return NULL;
+}
+#endif
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	void *stats = NULL;
+	void *ooo = NULL;
+	struct well_stats st;
+
+	NB_die_if(well_params(sizeof(size_t), 64, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(!(ooo = malloc(well_ooo_size(&buf))), "");
+	NB_die_if(well_ooo_init(&buf, ooo), "");
+
+#ifndef WELL_STATS
+	NB_die_if(well_stats_size(&buf), "stats take space when compiled out");
+	NB_die_if(well_stats_init(&buf, NULL), "");
+	struct well_res r = well_reserve(&buf.tx, 1);
+	well_release_ooo(&buf.rx, r);
+	well_stats_read(&buf.rx, &st);
+	NB_die_if(st.hwm || st.reserves, "counting while compiled out");
+#else
+	NB_die_if(!(
+		stats = aligned_alloc(NLC_CACHE_LINE, well_stats_size(&buf))
+		), "");
+	NB_die_if(well_stats_init(&buf, stats), "");
+
+	/* single thread: exact counts */
+	struct well_res a = well_reserve(&buf.tx, 10);
+	struct well_res b = well_reserve(&buf.tx, 100);
+	struct well_res c = well_reserve(&buf.tx, 1);
+	NB_die_if(a.cnt != 10 || b.cnt != 54 || c.cnt, "");
+	NB_die_if(well_release_multi(&buf.rx, b), "out of turn release succeeded");
+	NB_die_if(well_release_multi(&buf.rx, a) != 10, "");
+	NB_die_if(well_release_multi(&buf.rx, b) != 54, "");
+
+	well_stats_read(&buf.tx, &st);
+	NB_die_if(st.reserves != 2 || st.blocks != 64 || st.reserve_fails != 1,
+		"tx: reserves %lu blocks %lu fails %lu", (unsigned long)st.reserves,
+		(unsigned long)st.blocks, (unsigned long)st.reserve_fails);
+	well_stats_read(&buf.rx, &st);
+	NB_die_if(st.release_fails != 1 || st.hwm != 64,
+		"rx: release fails %lu hwm %lu", (unsigned long)st.release_fails,
+		(unsigned long)st.hwm);
+
+	/* drain back, then reset */
+	a = well_reserve(&buf.rx, 64);
+	well_release_single(&buf.tx, a.cnt);
+	well_stats_reset(&buf.tx);
+	well_stats_reset(&buf.rx);
+	well_stats_read(&buf.rx, &st);
+	NB_die_if(st.reserves || st.hwm, "reset left counts");
+	/* single-side releases were used: start over on a fresh well */
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	buf = (struct well){ {0} };
+	NB_die_if(well_params(sizeof(size_t), 64, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(well_ooo_init(&buf, ooo), "");
+	NB_die_if(well_stats_init(&buf, stats), "");
+
+	/* threads: totals add up across slots */
+	pthread_t tid[THREADS];
+	for (size_t i=0; i < THREADS; i++)
+		NB_die_if(pthread_create(&tid[i], NULL, worker, NULL), "");
+	for (size_t i=0; i < THREADS; i++)
+		pthread_join(tid[i], NULL);
+
+	well_stats_read(&buf.tx, &st);
+	NB_die_if(st.reserves != THREADS * NUMITER || st.blocks != THREADS * NUMITER,
+		"tx: reserves %lu blocks %lu", (unsigned long)st.reserves,
+		(unsigned long)st.blocks);
+	well_stats_read(&buf.rx, &st);
+	NB_die_if(st.reserves != THREADS * NUMITER, "rx: reserves %lu",
+		(unsigned long)st.reserves);
+	NB_die_if(!st.hwm || st.hwm > 64, "rx hwm %lu", (unsigned long)st.hwm);
+#endif
+
+die:
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	free(ooo);
+	free(stats);
+	return err_cnt;
+}
@@ -17,6 +17,7 @@ Not good for benchmarking speed: uses a fixed number of runs
 #include <stdlib.h>
 #include <pthread.h>
 #include <getopt.h>
+#include <stdbool.h>
 #include <nonlibc.h> /* timing */
 
 
@@ -28,12 +29,41 @@ static size_t tx_thread_cnt = 1;
 static pthread_t *tx = NULL;
 static size_t rx_thread_cnt = 1;
 static pthread_t *rx = NULL;
+static void *ooo = NULL; /* completion bitmaps */
 
 static size_t reservation = 1; /* how many blocks to reserve at once */
+static bool do_wait = false; /* park on futex instead of FAIL_DO() */
+static bool do_ooo = false; /* multi-threaded release with well_release_ooo() */
+static uint8_t technique = WELL_TECHNIQUE; /* WELL_DO_* */
 
 static size_t waits = 0; /* how many times did threads wait? */
 
 
+/*	reserve()
+Reserve either by parking or by FAIL_DO() spinning.
+*/
+static struct well_res reserve(struct well_sym *from, size_t ask)
+{
+	struct well_res res;
+	if (do_wait)
+		return well_reserve_wait(from, ask);
+	while (!(res = well_reserve(from, ask)).cnt)
+		FAIL_DO();
+	return res;
+}
+
+/*	release_multi()
+Release in-order (retrying) or out-of-order.
+*/
+static void release_multi(struct well_sym *to, struct well_res res)
+{
+	if (do_ooo)
+		well_release_ooo(to, res);
+	else while (!well_release_multi(to, res))
+		FAIL_DO();
+}
+
+
 /*	tx_thread()
 */
 void *tx_single(void* arg)
@@ -47,8 +77,7 @@ void *tx_single(void* arg)
 	for (size_t i=0; i < num; i += res.cnt) {
 		size_t ask = i + reservation < num ? reservation : num - i;
 
-		while (!(res = well_reserve(&buf->tx, ask)).cnt)
-			FAIL_DO();
+		res = reserve(&buf->tx, ask);
 
 		for (size_t j=0; j < res.cnt; j++)
 			tally += WELL_DEREF(size_t, res.pos, j, buf) = i + j;
@@ -69,14 +98,12 @@ void *tx_multi(void* arg)
 	for (size_t i=0; i < num; i += res.cnt) {
 		size_t ask = i + reservation < num ? reservation : num - i;
 
-		while (!(res = well_reserve(&buf->tx, ask)).cnt)
-			FAIL_DO();
+		res = reserve(&buf->tx, ask);
 
 		for (size_t j=0; j < res.cnt; j++)
 			tally += WELL_DEREF(size_t, res.pos, j, buf) = i + j;
 
-		while (!well_release_multi(&buf->rx, res))
-			FAIL_DO();
+		release_multi(&buf->rx, res);
 	}
 
 	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
@@ -97,8 +124,7 @@ void *rx_single(void* arg)
 	for (size_t i=0; i < num; i += res.cnt) {
 		size_t ask = i + reservation < num ? reservation : num - i;
 
-		while (!(res = well_reserve(&buf->rx, ask)).cnt)
-			FAIL_DO();
+		res = reserve(&buf->rx, ask);
 
 		for (size_t j=0; j < res.cnt; j++) {
 			size_t temp = WELL_DEREF(size_t, res.pos, j, buf);
@@ -121,16 +147,14 @@ void *rx_multi(void* arg)
 	for (size_t i=0; i < num; i += res.cnt) {
 		size_t ask = i + reservation < num ? reservation : num - i;
 
-		while (!(res = well_reserve(&buf->rx, ask)).cnt)
-			FAIL_DO();
+		res = reserve(&buf->rx, ask);
 
 		for (size_t j=0; j < res.cnt; j++) {
 			size_t temp = WELL_DEREF(size_t, res.pos, j, buf);
 			tally += temp;
 		}
 
-		while (!well_release_multi(&buf->tx, res))
-			FAIL_DO();
+		release_multi(&buf->tx, res);
 	}
 
 	__atomic_fetch_add(&waits, wait_count, __ATOMIC_RELAXED);
@@ -154,6 +178,9 @@ Options:\n\
 -r, --reservation <res>	:	(Attempt to) reserve <res> blocks at once.\n\
 -t, --tx-threads	:	Number of TX threads.\n\
 -x, --rx-threads	:	Number of RX threads.\n\
+-T, --technique <name>	:	Contention technique: cas|xch|mtx|spl|tkt.\n\
+-w, --wait		:	Park on futex instead of spinning when reserving.\n\
+-o, --ooo		:	Release out-of-order when multi-threaded.\n\
 -h, --help		:	Print this message and exit.\n",
 		pgm_name);
 }
@@ -179,10 +206,13 @@ int main(int argc, char **argv)
 		{ "reservation",required_argument,	0,	'r'},
 		{ "tx-threads",	required_argument,	0,	't'},
 		{ "rx-threads",	required_argument,	0,	'x'},
+		{ "technique",	required_argument,	0,	'T'},
+		{ "wait",	no_argument,		0,	'w'},
+		{ "ooo",	no_argument,		0,	'o'},
 		{ "help",	no_argument,		0,	'h'}
 	};
 
-	while ((opt = getopt_long(argc, argv, "n:c:r:t:x:h", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "n:c:r:t:x:T:woh", long_options, NULL)) != -1) {
 		switch(opt)
 		{
 			case 'n':
@@ -214,6 +244,20 @@ int main(int argc, char **argv)
 				NB_die_if(opt != 1, "invalid rx_thread_cnt '%s'", optarg);
 				break;
 
+			case 'T':
+				NB_die_if(!(
+					technique = well_technique_parse(optarg)
+					), "invalid technique '%s'", optarg);
+				break;
+
+			case 'w':
+				do_wait = true;
+				break;
+
+			case 'o':
+				do_ooo = true;
+				break;
+
 			case 'h':
 				usage(argv[0]);
 				goto die;
@@ -254,8 +298,14 @@ int main(int argc, char **argv)
 		well_params(blk_size, blk_cnt, &buf)
 		, "");
 	NB_die_if(
-		well_init(&buf, malloc(well_size(&buf)))
+		well_init_technique(&buf, malloc(well_size(&buf)), technique)
 		, "size %zu", well_size(&buf));
+	if (do_ooo) {
+		NB_die_if(!(
+			ooo = malloc(well_ooo_size(&buf))
+			), "");
+		NB_die_if(well_ooo_init(&buf, ooo), "");
+	}
 
 	void *(*tx_t)(void *) = tx_single;
 	if (tx_thread_cnt > 1)
@@ -315,13 +365,14 @@ int main(int argc, char **argv)
 		numiter, blk_size, blk_cnt, reservation);
 	printf("TX threads %zu; RX threads %zu\n",
 		tx_thread_cnt, rx_thread_cnt);
-	printf("waits: %zu\n", waits);
+	printf("waits: %zu%s\n", waits, do_wait ? " (futex)" : "");
 	printf("cpu time %.4lfs; wall time %.4lfs\n",
 		nlc_timing_cpu(t), nlc_timing_wall(t));
 
 die:
 	well_deinit(&buf);
 	free(well_mem(&buf));
+	free(ooo);
 	free(tx);
 	free(rx);
 	return err_cnt;
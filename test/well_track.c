@@ -0,0 +1,159 @@
+/*	well_track.c
+
+Test recovery of abandoned reservations:
+	- the oldest outstanding claim is reported, with its owner and age;
+	- forcing it releases the claims queued behind it;
+	- an owner whose claim was forced or reassigned can no longer release it;
+	- with threads: one consumer abandons a reservation,
+		a watchdog forces it and the pipeline completes.
+*/
+
+#include <well_track.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+
+#define THREADS		4
+#define NUMITER		100000
+#define STALE_NS	(200 * 1000000UL)
+
+
+static struct well buf = { {0} };
+static struct well_track tr = { 0 };
+static size_t done = 0;
+
+
+/*	producer()
+Push NUMITER single blocks into 'rx'.
+*/
+static void *producer(void *arg)
+{
+	for (size_t i=0; i < NUMITER; ) {
+		struct well_res res = well_reserve(&buf.tx, 1);
+		if (!res.cnt) {
+			sched_yield();
+			continue;
+		}
+		while (!well_release_multi(&buf.rx, res))
+			sched_yield();
+		i++;
+	}
+	return NULL;
+}
+
+/*	consumer()
+Take blocks back out through 'tr' until all are accounted for.
+Consumer 1 walks away from its first reservation.
+*/
+static void *consumer(void *arg)
+{
+	uint64_t owner = (uintptr_t)arg;
+	int abandon = (owner == 1);
+
+	while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < NUMITER) {
+		struct well_res res = well_track_reserve(&tr, owner, 1);
+		if (!res.cnt) {
+			sched_yield();
+			continue;
+		}
+		__atomic_add_fetch(&done, res.cnt, __ATOMIC_RELEASE);
+		if (abandon) {
+			abandon = 0;
+			continue;
+		}
+		while (!well_track_release(&tr, owner, res)) {
+			if (!well_track_owns(&tr, owner, res))
+				break;
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	struct well_claim cl;
+
+	NB_die_if(well_params(sizeof(size_t), 64, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(well_track_init(&tr, &buf.tx, &buf.rx, 4), "");
+
+	/* single thread */
+	NB_die_if(!well_track_oldest(&tr, &cl), "empty tracker reports a claim");
+	NB_die_if(well_track_reserve(&tr, WELL_TRACK_FREE, 1).cnt, "reserved with reserved owner id");
+
+	struct well_res a = well_track_reserve(&tr, 1, 10);
+	struct well_res b = well_track_reserve(&tr, 2, 10);
+	struct well_res c = well_track_reserve(&tr, 3, 10);
+	struct well_res d = well_track_reserve(&tr, 4, 10);
+	NB_die_if(a.cnt != 10 || b.cnt != 10 || c.cnt != 10 || d.cnt != 10, "");
+	NB_die_if(well_track_reserve(&tr, 5, 1).cnt, "reserved past max_claims");
+
+	NB_die_if(well_track_release(&tr, 2, b), "out of turn release succeeded");
+	NB_die_if(well_track_release(&tr, 3, b), "released someone else's claim");
+
+	NB_die_if(well_track_oldest(&tr, &cl), "");
+	NB_die_if(cl.owner != 1 || cl.pos != a.pos || cl.cnt != a.cnt,
+		"oldest: owner %lu pos %zu", (unsigned long)cl.owner, cl.pos);
+	NB_die_if(well_claim_age(&cl) > 1000000000UL, "age %lu",
+		(unsigned long)well_claim_age(&cl));
+
+	NB_die_if(well_track_force(&tr, &cl) != 10, "force failed");
+	NB_die_if(well_track_owns(&tr, 1, a), "owner still holds forced claim");
+	NB_die_if(well_track_release(&tr, 1, a), "released forced claim twice");
+	NB_die_if(well_track_force(&tr, &cl), "forced a stale claim");
+	NB_die_if(well_track_release(&tr, 2, b) != 10, "");
+
+	/* reassign: the new owner finishes the job */
+	NB_die_if(well_track_oldest(&tr, &cl), "");
+	NB_die_if(cl.owner != 3 || cl.pos != c.pos, "");
+	NB_die_if(well_track_reassign(&tr, &cl, 9), "");
+	NB_die_if(!well_track_reassign(&tr, &cl, 9), "reassigned a stale claim");
+	NB_die_if(well_track_release(&tr, 3, c), "old owner released reassigned claim");
+	NB_die_if(well_track_owns(&tr, 3, c) || !well_track_owns(&tr, 9, c), "");
+	NB_die_if(well_track_release(&tr, 9, c) != 10, "");
+	NB_die_if(well_track_release(&tr, 4, d) != 10, "");
+	NB_die_if(!well_track_oldest(&tr, &cl), "claims left outstanding");
+	NB_die_if(well_reserve(&buf.rx, 64).cnt != 40, "");
+
+	/* start over on a fresh well */
+	well_track_deinit(&tr);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	buf = (struct well){ {0} };
+	NB_die_if(well_params(sizeof(size_t), 64, &buf), "");
+	NB_die_if(well_init(&buf, malloc(well_size(&buf))), "");
+	NB_die_if(well_track_init(&tr, &buf.rx, &buf.tx, THREADS), "");
+
+	/* threads: watchdog forces the abandoned claim */
+	pthread_t prod, cons[THREADS];
+	NB_die_if(pthread_create(&prod, NULL, producer, NULL), "");
+	for (uintptr_t i=0; i < THREADS; i++)
+		NB_die_if(pthread_create(&cons[i], NULL, consumer, (void *)(i + 1)), "");
+
+	size_t forced = 0;
+	while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < NUMITER || !well_track_oldest(&tr, &cl)) {
+		if (!well_track_oldest(&tr, &cl) && well_claim_age(&cl) > STALE_NS)
+			forced += well_track_force(&tr, &cl);
+		sched_yield();
+	}
+
+	pthread_join(prod, NULL);
+	for (size_t i=0; i < THREADS; i++)
+		pthread_join(cons[i], NULL);
+	NB_die_if(forced != 1, "forced %zu blocks", forced);
+	NB_die_if(done != NUMITER, "%zu consumed", done);
+
+die:
+	well_track_deinit(&tr);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
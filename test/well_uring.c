@@ -0,0 +1,193 @@
+/*	well_uring.c
+
+Test io_uring I/O into and out of reservations:
+	- a file is read into the well at offsets and written back out of it
+		(reads and writes in flight at once, completing in any order),
+		end-of-file is reported with the number of bytes read;
+	- a pipe is read in order, one reservation at a time.
+Skipped (exit code 77) where io_uring is not available.
+*/
+
+#include <well_uring.h>
+
+#include <ndebug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+
+#define BLK_SIZE	4096
+#define BLK_CNT		64
+#define FILE_SZ		(1024 * BLK_SIZE + 100)	/* last block is short */
+#define PIPE_SZ		(300 * BLK_SIZE)
+
+
+static struct well buf = { {0} };
+static int pipe_fd[2] = { -1, -1 };
+
+
+/*	pattern()
+Byte 'i' of the test data.
+*/
+static inline unsigned char pattern(size_t i)
+{
+	return (i * 7 + (i >> 12)) & 0xff;
+}
+
+/*	writer()
+Feed the pipe in odd-sized pieces, then close it.
+*/
+static void *writer(void *arg)
+{
+	unsigned char chunk[1000];
+	for (size_t i=0; i < PIPE_SZ; ) {
+		size_t n = sizeof(chunk);
+		if (n > PIPE_SZ - i)
+			n = PIPE_SZ - i;
+		for (size_t j=0; j < n; j++)
+			chunk[j] = pattern(i + j);
+		ssize_t ret = write(pipe_fd[1], chunk, n);
+		if (ret <= 0)
+			break;
+		i += ret;
+	}
+	close(pipe_fd[1]);
+	pipe_fd[1] = -1;
+	return NULL;
+}
+
+/*	available()
+*/
+static int available()
+{
+	struct io_uring_params p = { 0 };
+	int fd = syscall(SYS_io_uring_setup, 4, &p);
+	if (fd < 0)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+
+/*	main()
+*/
+int main()
+{
+	int err_cnt = 0;
+	char in_path[] = "/tmp/well_uring_in.XXXXXX";
+	char out_path[] = "/tmp/well_uring_out.XXXXXX";
+	int in = -1, out = -1;
+	unsigned char *data = NULL, *check = NULL;
+	struct well_uring rd = { .fd = -1 }, wr = { .fd = -1 };
+
+	if (!available()) {
+		NB_wrn("io_uring not available: skipping");
+		return 77;
+	}
+
+	NB_die_if(well_params(BLK_SIZE, BLK_CNT, &buf), "");
+	NB_die_if(well_init(&buf, aligned_alloc(BLK_SIZE, well_size(&buf))), "");
+	NB_die_if(well_uring_init(&rd, &buf, 8), "");
+	NB_die_if(well_uring_init(&wr, &buf, 8), "");
+
+	/* source file */
+	NB_die_if(!(data = malloc(FILE_SZ)) || !(check = malloc(FILE_SZ)), "");
+	for (size_t i=0; i < FILE_SZ; i++)
+		data[i] = pattern(i);
+	NB_die_if((in = mkstemp(in_path)) < 0, "");
+	NB_die_if((out = mkstemp(out_path)) < 0, "");
+	unlink(in_path);
+	unlink(out_path);
+	NB_die_if(write(in, data, FILE_SZ) != FILE_SZ, "");
+
+	/* file -> well -> file; reservations of 3 blocks loop around the buffer */
+	size_t rd_off = 0, wr_off = 0, end = 0;
+	int eof = 0;
+	while (!eof || well_uring_inflight(&rd) || well_uring_inflight(&wr)
+		|| wr_off < end)
+	{
+		struct well_res res;
+		while (!eof && well_uring_space(&rd) && (res = well_reserve(&buf.tx, 3)).cnt) {
+			NB_die_if(well_uring_read(&rd, res, &buf.rx, in, rd_off), "");
+			rd_off += res.cnt * BLK_SIZE;
+		}
+		while (well_uring_space(&wr) && (res = well_reserve(&buf.rx, 3)).cnt) {
+			NB_die_if(well_uring_write(&wr, res, &buf.tx, out, wr_off), "");
+			wr_off += res.cnt * BLK_SIZE;
+		}
+		NB_die_if(well_uring_submit(&rd, 0), "");
+		NB_die_if(well_uring_submit(&wr, 0), "");
+		well_uring_complete(&rd);
+		well_uring_complete(&wr);
+
+		/* the read straddling end-of-file, and any after it */
+		size_t done;
+		int err = well_uring_failed(&rd, &res, &done);
+		if (err) {
+			NB_die_if(err != -ENODATA, "read: %s", strerror(-err));
+			if (!eof)
+				end = res.pos * BLK_SIZE + done;
+			eof = 1;
+			well_uring_resolve(&rd);
+		}
+		NB_die_if(well_uring_failed(&wr, NULL, NULL), "write failed");
+		if (!eof || well_uring_inflight(&rd) || well_uring_inflight(&wr))
+			NB_die_if(well_uring_submit(&wr, 1), "");
+	}
+	NB_die_if(end != FILE_SZ, "end-of-file at %zu", end);
+	NB_die_if(pread(out, check, FILE_SZ, 0) != FILE_SZ, "");
+	NB_die_if(memcmp(data, check, FILE_SZ), "file mangled");
+
+	/* pipe: current position, in order */
+	NB_die_if(pipe(pipe_fd), "");
+	pthread_t tid;
+	NB_die_if(pthread_create(&tid, NULL, writer, NULL), "");
+	size_t got = 0;
+	for (eof = 0; !eof || well_uring_inflight(&rd); ) {
+		struct well_res res;
+		while (!eof && well_uring_space(&rd) && (res = well_reserve(&buf.tx, 5)).cnt)
+			NB_die_if(well_uring_read(&rd, res, &buf.rx, pipe_fd[0], -1), "");
+		NB_die_if(well_uring_submit(&rd, 1), "");
+		well_uring_complete(&rd);
+
+		while ((res = well_reserve(&buf.rx, BLK_CNT)).cnt) {
+			for (size_t i=0; i < res.cnt; i++) {
+				unsigned char *b = well_access(res.pos, i, &buf);
+				for (size_t j=0; j < BLK_SIZE && got < PIPE_SZ; j++, got++)
+					NB_die_if(b[j] != pattern(got), "pipe byte %zu", got);
+			}
+			well_release_single(&buf.tx, res.cnt);
+		}
+		size_t done;
+		int err = well_uring_failed(&rd, &res, &done);
+		if (err) {
+			NB_die_if(err != -ENODATA, "read: %s", strerror(-err));
+			NB_die_if(done % BLK_SIZE, "pipe ended mid-block");
+			/* bytes past the end are not checked */
+			eof = 1;
+			well_uring_resolve(&rd);
+		}
+	}
+	pthread_join(tid, NULL);
+	NB_die_if(got != PIPE_SZ, "read %zu of %d from pipe", got, PIPE_SZ);
+
+die:
+	well_uring_deinit(&rd);
+	well_uring_deinit(&wr);
+	if (in >= 0)
+		close(in);
+	if (out >= 0)
+		close(out);
+	if (pipe_fd[0] >= 0)
+		close(pipe_fd[0]);
+	free(data);
+	free(check);
+	well_deinit(&buf);
+	free(well_mem(&buf));
+	return err_cnt;
+}
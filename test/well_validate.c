@@ -1,6 +1,8 @@
 #include <well.h>
 #include <ndebug.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h> /* usleep */
 
 
 /*	test_zero()
@@ -35,6 +37,208 @@ int test_zero(struct well *buf)
 }
 
 
+/*	waiter()
+Park on 'rx' until a block is released into it.
+*/
+static void *waiter(void *arg)
+{
+	struct well *buf = arg;
+	struct well_res res = well_reserve_wait(&buf->rx, 1);
+	if (res.cnt)
+		well_release_single(&buf->tx, res.cnt);
+	return (void *)res.cnt;
+}
+
+
+/*	test_wait()
+A timed reservation from an empty side must time out;
+	a parked thread must be woken by a release.
+*/
+int test_wait(struct well *buf)
+{
+	int err_cnt = 0;
+	const struct timespec timeout = { .tv_sec = 0, .tv_nsec = 10000000 }; /* 10ms */
+	struct well_res res;
+
+	res = well_reserve_timed(&buf->rx, 1, &timeout);
+	NB_die_if(res.cnt, "reserve from empty rx returned %zu", res.cnt);
+
+	pthread_t thr;
+	NB_die_if(pthread_create(&thr, NULL, waiter, buf), "");
+	usleep(10000); /* give waiter time to park */
+	res = well_reserve_timed(&buf->tx, 1, &timeout);
+	NB_err_if(res.cnt != 1, "reserve from tx returned %zu", res.cnt);
+	well_release_single(&buf->rx, res.cnt);
+
+	void *ret;
+	pthread_join(thr, &ret);
+	NB_err_if((size_t)ret != 1, "waiter reserved %zu", (size_t)ret);
+	NB_err_if(buf->rx.waiters, "%u waiters still registered", buf->rx.waiters);
+
+die:
+	return err_cnt;
+}
+
+
+/*	test_ooo()
+Reservations released out-of-order must only be published
+	once the earliest of them is released;
+	and then all at once.
+Loop enough times to go around the buffer (and flip the bitmap) repeatedly.
+*/
+int test_ooo()
+{
+	int err_cnt = 0;
+	struct well ooo_buf = { {0} };
+	struct well *buf = &ooo_buf;
+	void *ooo = NULL;
+
+	NB_die_if(well_params(sizeof(size_t), 16, buf), "");
+	NB_die_if(
+		well_init(buf, malloc(well_size(buf)))
+		, "size %zu", well_size(buf));
+	NB_die_if(!(
+		ooo = malloc(well_ooo_size(buf))
+		), "");
+	NB_die_if(well_ooo_init(buf, ooo), "");
+	size_t cnt = well_blk_count(buf);
+
+	for (size_t i=0; i < cnt * 4; i++) {
+		struct well_res a = well_reserve(&buf->tx, 1);
+		struct well_res b = well_reserve(&buf->tx, 2);
+		struct well_res c = well_reserve(&buf->tx, 3);
+		NB_die_if(a.cnt != 1 || b.cnt != 2 || c.cnt != 3,
+			"reserved %zu %zu %zu", a.cnt, b.cnt, c.cnt);
+
+		well_release_ooo(&buf->rx, c);
+		well_release_ooo(&buf->rx, b);
+		NB_die_if(buf->rx.avail, "%zu published before gap closed", buf->rx.avail);
+		well_release_ooo(&buf->rx, a);
+		NB_die_if(buf->rx.avail != 6, "%zu published, expected 6", buf->rx.avail);
+
+		/* drain the other way, releasing with varying offsets */
+		a = well_reserve(&buf->rx, 1 + (i % 3));
+		b = well_reserve(&buf->rx, 6);
+		well_release_ooo(&buf->tx, b);
+		well_release_ooo(&buf->tx, a);
+		NB_die_if(buf->tx.avail != cnt, "tx avail %zu != %zu", buf->tx.avail, cnt);
+		NB_die_if(buf->rx.avail, "rx avail %zu after drain", buf->rx.avail);
+	}
+
+die:
+	well_deinit(buf);
+	free(well_mem(buf));
+	free(ooo);
+	return err_cnt;
+}
+
+
+/*	test_mirror()
+A reservation wrapping past the end of a mirrored buffer
+	must be contiguous in memory.
+*/
+int test_mirror()
+{
+	int err_cnt = 0;
+	struct well mirror_buf = { {0} };
+	struct well *buf = &mirror_buf;
+
+	/* 4KiB: one page on most systems */
+	NB_die_if(well_params(64, 64, buf), "");
+	NB_die_if(well_mirror_init(buf), "");
+	NB_die_if(!well_contiguous(buf), "mirrored well not contiguous");
+
+	/* move 'pos' close to the end of the buffer */
+	struct well_res res = well_reserve(&buf->tx, 60);
+	well_release_single(&buf->rx, res.cnt);
+	res = well_reserve(&buf->rx, 60);
+	well_release_single(&buf->tx, res.cnt);
+
+	res = well_reserve(&buf->tx, 8);
+	NB_die_if(res.cnt != 8, "reserved %zu", res.cnt);
+	unsigned char *flat = well_access(res.pos, 0, buf);
+	for (size_t i=0; i < res.cnt << 6; i++)
+		flat[i] = i;
+	for (size_t j=0; j < res.cnt; j++) {
+		unsigned char *blk = well_access(res.pos, j, buf);
+		NB_err_if(blk[1] != (unsigned char)((j << 6) + 1),
+			"block %zu: %d", j, blk[1]);
+	}
+	well_release_single(&buf->rx, res.cnt);
+
+die:
+	well_mirror_deinit(buf);
+	return err_cnt;
+}
+
+
+/*	test_techniques()
+Every technique must be selectable at init, and its specialized
+	entry points must agree with the generic ones.
+*/
+static const struct {
+	const char	*name;
+	struct well_res	(*reserve)(struct well_sym *, size_t);
+	void		(*release_single)(struct well_sym *, size_t);
+	size_t		(*release_multi)(struct well_sym *, struct well_res);
+} specialized[] = {
+	{ "cas", well_reserve_cas, well_release_single_cas, well_release_multi_cas },
+	{ "XCH", well_reserve_xch, well_release_single_xch, well_release_multi_xch },
+	{ "Mtx", well_reserve_mtx, well_release_single_mtx, well_release_multi_mtx },
+	{ "spl", well_reserve_spl, well_release_single_spl, well_release_multi_spl },
+	{ "Tkt", well_reserve_tkt, well_release_single_tkt, well_release_multi_tkt }
+};
+
+int test_techniques()
+{
+	int err_cnt = 0;
+	void *mem = NULL;
+	struct well tech_buf;
+	struct well *buf = &tech_buf;
+	NB_die_if(well_technique_parse("nope"), "parsed a bogus technique");
+
+	for (size_t i=0; i < sizeof(specialized) / sizeof(specialized[0]); i++) {
+		uint8_t tech = well_technique_parse(specialized[i].name);
+		NB_die_if(!tech, "could not parse '%s'", specialized[i].name);
+
+		tech_buf = (struct well){ {0} };
+		NB_die_if(well_params(sizeof(size_t), 16, buf), "");
+		if (!mem)
+			NB_die_if(!(mem = malloc(well_size(buf))), "");
+		NB_die_if(well_init_technique(buf, mem, tech), "");
+		NB_err_if(well_technique(buf) != tech || buf->rx.technique != tech,
+			"%s: technique %u", specialized[i].name, well_technique(buf));
+
+		/* tx releases with _multi(), rx with _single():
+			alternate generic and specialized calls on each side
+		*/
+		const char *n = specialized[i].name;
+		struct well_res res = well_reserve(&buf->tx, 10);
+		NB_err_if(res.cnt != 10, "%s: reserved %zu", n, res.cnt);
+		NB_err_if(specialized[i].release_multi(&buf->rx, res) != 10, "%s", n);
+
+		res = specialized[i].reserve(&buf->rx, 16);
+		NB_err_if(res.cnt != 10, "%s: reserved %zu", n, res.cnt);
+		well_release_single(&buf->tx, res.cnt);
+
+		res = specialized[i].reserve(&buf->tx, 16);
+		NB_err_if(res.cnt != 16, "%s: reserved %zu", n, res.cnt);
+		NB_err_if(well_release_multi(&buf->rx, res) != 16, "%s", n);
+
+		res = well_reserve(&buf->rx, 16);
+		NB_err_if(res.cnt != 16, "%s: reserved %zu", n, res.cnt);
+		specialized[i].release_single(&buf->tx, res.cnt);
+		NB_err_if(buf->tx.avail != 16, "%s: tx avail %zu", n, buf->tx.avail);
+
+		well_deinit(buf);
+	}
+
+die:
+	free(mem);
+	return err_cnt;
+}
+
+
 /*	main()
 */
 int main()
@@ -58,6 +262,10 @@ int main()
 
 	/* run tests */
 	err_cnt += test_zero(&buf);
+	err_cnt += test_wait(&buf);
+	err_cnt += test_ooo();
+	err_cnt += test_mirror();
+	err_cnt += test_techniques();
 
 die:
 	well_deinit(&buf);